@@ -17,6 +17,7 @@ MainWindow::MainWindow(QWidget *parent)
     m_readThread = new ReadThread();
     connect(m_readThread, &ReadThread::updateImage, ui->playimage, &PlayImage::updateImage, Qt::DirectConnection);
     connect(m_readThread, &ReadThread::playState, this, &MainWindow::on_playState);
+    connect(ui->playimage, &PlayImage::visibilityChanged, m_readThread, &ReadThread::setVisible);
 
 
 }
@@ -66,6 +67,11 @@ void MainWindow::on_pauseButton_clicked()
         ui->pauseButton->setText("暂停");
     }
 }
+
+void MainWindow::on_smoothCheckBox_toggled(bool checked)
+{
+    ui->playimage->setSmoothScaling(checked);     // 双线性平滑，缩小显示时锯齿更少，CPU占用更高
+}
 void MainWindow::on_playState(ReadThread::PlayState state)
 {
     if (state == ReadThread::play)
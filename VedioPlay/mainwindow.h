@@ -26,6 +26,8 @@ private slots:
 
     void on_pauseButton_clicked();
 
+    void on_smoothCheckBox_toggled(bool checked);
+
 private:
     Ui::MainWindow *ui;
     VideoDecoder * decoder;
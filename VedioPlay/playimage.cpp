@@ -1,5 +1,13 @@
 #include "playimage.h"
+#include "visibilitywatcher.h"
+#include <QMouseEvent>
 #include <QPainter>
+#include <QWheelEvent>
+#include <QtMath>
+
+#define ZOOM_STEP 1.25      // 滚轮每一格的放大倍数
+#define MAX_ZOOM  16        // 最大放大倍数
+
 PlayImage::PlayImage(QWidget *parent) : QWidget(parent)
 {
     // 适用调色板设置背景色
@@ -7,14 +15,35 @@ PlayImage::PlayImage(QWidget *parent) : QWidget(parent)
     palette.setColor(QPalette::Window, Qt::black);   //设置背景黑色
     this->setPalette(palette);
     this->setAutoFillBackground(true);
+
+    m_visibility = new VisibilityWatcher(this);
+    connect(m_visibility, &VisibilityWatcher::visibilityChanged, this, &PlayImage::visibilityChanged);
 }
 /**
- * @brief        传入Qimage图片显示
+ * @brief        传入Qimage图片显示（解码线程中直接调用）：放入信箱替换还没有显示的帧，
+ *               只在上一帧已经被取走时投递一次事件，GUI线程落后时不会堆积图像和事件
  * @param image
  */
 void PlayImage::updateImage(const QImage& image)
 {
-    updatePixmap(QPixmap::fromImage(image));
+    if(m_mailbox.post(image))
+    {
+        QMetaObject::invokeMethod(this, &PlayImage::takeImage, Qt::QueuedConnection);
+    }
+}
+
+qint64 PlayImage::droppedFrames() const
+{
+    return m_mailbox.dropped();
+}
+
+void PlayImage::takeImage()
+{
+    QImage image;
+    if(m_mailbox.take(&image))
+    {
+        updatePixmap(QPixmap::fromImage(image));   // QPixmap只能在GUI线程中创建
+    }
 }
 
 /**
@@ -23,9 +52,17 @@ void PlayImage::updateImage(const QImage& image)
  */
 void PlayImage::updatePixmap(const QPixmap &pixmap)
 {
-    m_mutex.lock();
     m_pixmap = pixmap;
-    m_mutex.unlock();
+    update();
+}
+
+/**
+ * @brief        小窗口缩小显示时平滑缩放可以减少锯齿和闪烁，代价是每帧缩放耗时增加
+ * @param smooth
+ */
+void PlayImage::setSmoothScaling(bool smooth)
+{
+    m_smooth = smooth;
     update();
 }
 
@@ -44,12 +81,113 @@ void PlayImage::paintEvent(QPaintEvent *event)
         // 先将QImage转换为QPixmap再进行缩放则耗时比较少，并且稳定，不会因为缩放图片大小而产生太大影响
         QPixmap pixmap1 = QPixmap::fromImage(m_image).scaled(this->size(), Qt::KeepAspectRatio);
 #endif
-        m_mutex.lock();
-        QPixmap pixmap = m_pixmap.scaled(this->size(), Qt::KeepAspectRatio);
-        m_mutex.unlock();
+        // 局部放大时只截取显示的区域再缩放，缩放的像素数与放大倍数成反比
+        QRect source = sourceRect();
+        QPixmap visible = (source == m_pixmap.rect()) ? m_pixmap : m_pixmap.copy(source);
+        QPixmap pixmap = visible.scaled(this->size(), Qt::KeepAspectRatio,
+                                        m_smooth ? Qt::SmoothTransformation : Qt::FastTransformation);
         int x = (this->width() - pixmap.width()) / 2;
         int y = (this->height() - pixmap.height()) / 2;
         painter.drawPixmap(x, y, pixmap);
     }
     QWidget::paintEvent(event);
 }
+
+/**
+ * @brief        区域限制在图像范围内，最大放大MAX_ZOOM倍
+ * @param region
+ */
+void PlayImage::setZoom(const QRectF &region)
+{
+    qreal w = qBound(1.0 / MAX_ZOOM, region.width(), 1.0);
+    qreal h = qBound(1.0 / MAX_ZOOM, region.height(), 1.0);
+    m_zoom = QRectF(qBound(0.0, region.x(), 1.0 - w), qBound(0.0, region.y(), 1.0 - h), w, h);
+    update();
+    emit zoomChanged(m_zoom);
+}
+
+QRectF PlayImage::zoom() const
+{
+    return m_zoom;
+}
+
+bool PlayImage::isShown() const
+{
+    return m_visibility->isVisible();
+}
+
+QRect PlayImage::sourceRect() const
+{
+    qreal w = m_pixmap.width();
+    qreal h = m_pixmap.height();
+    QRect rect = QRectF(m_zoom.x() * w, m_zoom.y() * h, m_zoom.width() * w, m_zoom.height() * h).toAlignedRect();
+    return rect & m_pixmap.rect();
+}
+
+QRectF PlayImage::displayRect() const
+{
+    QSizeF size = QSizeF(sourceRect().size()).scaled(QSizeF(this->size()), Qt::KeepAspectRatio);
+    return QRectF(QPointF((this->width() - size.width()) / 2, (this->height() - size.height()) / 2), size);
+}
+
+/**
+ * @brief       以光标下的图像位置为中心缩放
+ * @param event
+ */
+void PlayImage::wheelEvent(QWheelEvent *event)
+{
+    qreal steps = event->angleDelta().y() / 120.0;
+    QRectF display = displayRect();
+    if(steps == 0 || m_pixmap.isNull() || display.isEmpty())
+    {
+        QWidget::wheelEvent(event);
+        return;
+    }
+    QPointF pos = event->position() - display.topLeft();
+    QPointF anchor(m_zoom.x() + pos.x() / display.width() * m_zoom.width(),
+                   m_zoom.y() + pos.y() / display.height() * m_zoom.height());
+    qreal factor = qPow(ZOOM_STEP, -steps);
+    setZoom(QRectF(anchor - (anchor - m_zoom.topLeft()) * factor, m_zoom.size() * factor));
+    event->accept();
+}
+
+void PlayImage::mousePressEvent(QMouseEvent *event)
+{
+    if(event->button() != Qt::LeftButton)
+    {
+        QWidget::mousePressEvent(event);
+        return;
+    }
+    m_dragging = true;
+    m_dragPos = event->position();
+    m_dragZoom = m_zoom;
+}
+
+/**
+ * @brief       拖动平移，移动距离按显示大小换算为图像坐标
+ * @param event
+ */
+void PlayImage::mouseMoveEvent(QMouseEvent *event)
+{
+    QRectF display = displayRect();
+    if(!m_dragging || display.isEmpty())
+    {
+        QWidget::mouseMoveEvent(event);
+        return;
+    }
+    QPointF delta = event->position() - m_dragPos;
+    setZoom(m_dragZoom.translated(-delta.x() / display.width() * m_dragZoom.width(),
+                                  -delta.y() / display.height() * m_dragZoom.height()));
+}
+
+void PlayImage::mouseReleaseEvent(QMouseEvent *event)
+{
+    m_dragging = false;
+    QWidget::mouseReleaseEvent(event);
+}
+
+void PlayImage::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    setZoom(QRectF(0, 0, 1, 1));
+    event->accept();
+}
@@ -2,7 +2,11 @@
 #define PLAYIMAGE_H
 
 #include <QWidget>
-#include <qmutex.h>
+#include <QImage>
+#include <QRectF>
+#include "framemailbox.h"
+
+class VisibilityWatcher;
 
 class PlayImage : public QWidget
 {
@@ -10,17 +14,40 @@ class PlayImage : public QWidget
 public:
     explicit PlayImage(QWidget *parent = nullptr);
 
-    void updateImage(const QImage& image);
-    void updatePixmap(const QPixmap& pixmap);
+    void updateImage(const QImage& image);       // 可以在解码线程中直接调用，只保留最新一帧
+    void updatePixmap(const QPixmap& pixmap);    // 只能在GUI线程中调用
+    qint64 droppedFrames() const;               // 没有显示就被新帧替换的帧数
+    void setSmoothScaling(bool smooth);         // 缩放时使用双线性平滑（默认最近邻，速度快）
+    void setZoom(const QRectF& region);         // 局部放大显示的图像区域（归一化坐标，y向下），鼠标滚轮缩放、拖动平移、双击还原
+    QRectF zoom() const;
+    bool isShown() const;                       // 是否能被看到（没有隐藏、最小化、被遮挡或裁剪）
 
 signals:
+    void zoomChanged(const QRectF& region);
+    void visibilityChanged(bool visible);       // 读取线程据此在不可见时降低解码开销
 
 protected:
     void paintEvent(QPaintEvent *event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+
+private:
+    void takeImage();                           // GUI线程中取出信箱中最新的一帧
+    QRect  sourceRect() const;                  // 放大区域在图像中的像素范围
+    QRectF displayRect() const;                 // 放大区域在窗口中的显示位置
 
 private:
-    QPixmap m_pixmap;
-    QMutex m_mutex;
+    QPixmap m_pixmap;                           // 只在GUI线程中访问
+    FrameMailbox<QImage> m_mailbox;             // 解码线程到GUI线程的无锁最新帧信箱
+    bool m_smooth = false;
+    QRectF  m_zoom = QRectF(0, 0, 1, 1);        // 显示的图像区域
+    bool    m_dragging = false;
+    QPointF m_dragPos;                          // 开始拖动时的鼠标位置和放大区域
+    QRectF  m_dragZoom;
+    VisibilityWatcher* m_visibility = nullptr;
 };
 
 #endif // PLAYIMAGE_H
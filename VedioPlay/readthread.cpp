@@ -57,6 +57,36 @@ const QString &ReadThread::url()
     return m_url;
 }
 
+/**
+ * @brief         与暂停相同，只设置标志，由读取线程在下一次读取前切换解码方式
+ * @param visible
+ */
+void ReadThread::setVisible(bool visible)
+{
+    m_visible = visible;
+}
+
+/**
+ * @brief 不可见时只解码关键帧并且不转换图像，仍然读取全部数据包，保持连接和播放进度。
+ *        跳过的帧是后面非关键帧的参考，恢复可见后从下一个关键帧开始显示
+ */
+void ReadThread::updateVisibility()
+{
+    bool hidden = !m_visible;
+    if(hidden == m_hidden) return;
+    m_hidden = hidden;
+    m_videoDecode->setKeyFrameOnly(hidden);
+    if(hidden)
+    {
+        qDebug() << "显示不可见，只解码关键帧：" << m_url;
+    }
+    else
+    {
+        m_waitKey = true;
+        qDebug() << "恢复显示：" << m_url;
+    }
+}
+
 
 
 
@@ -71,6 +101,7 @@ void  sleepMsec(int msec)
 
 void ReadThread::run()
 {
+    m_waitKey = false;
     bool ret = m_videoDecode->open(m_url);         // 打开网络流时会比较慢，如果放到Ui线程会卡
     if(ret)
     {
@@ -91,8 +122,8 @@ void ReadThread::run()
         {
             sleepMsec(200);
         }
-        QImage image = m_videoDecode->read();  // 读取视频图像
-        if(!image.isNull())
+        updateVisibility();
+        if(m_videoDecode->readFrame())          // 读取并解码一帧
         {
             // 1倍速播放
 #if 1
@@ -100,7 +131,13 @@ void ReadThread::run()
 #else
             sleepMsec(int(m_videoDecode->pts() - m_etime2.elapsed()));         // 支持后退（如果能读取到视频，但一直不显示可以把这一行代码注释试试）
 #endif
-            emit updateImage(image);
+            if(m_hidden) continue;              // 不可见时不转换图像
+            if(m_waitKey)
+            {
+                if(!m_videoDecode->isKeyFrame()) continue;
+                m_waitKey = false;
+            }
+            emit updateImage(m_videoDecode->toImage());
         }
         else
         {
@@ -23,10 +23,14 @@ public:
     void pause(bool flag);                      // 暂停视频
     void close();                               // 关闭视频
     const QString& url();                       // 获取打开的视频地址
+    void setVisible(bool visible);              // 显示是否可见，不可见时不转换图像、只解码关键帧
 
 protected:
     void run() override;
 
+private:
+    void updateVisibility();                    // 在读取线程中按可见性切换解码方式
+
 signals:
     void updateImage(const QImage& image);      // 将读取到的视频图像发送出去
     void playState(PlayState state);            // 视频播放状态发送改变时触发
@@ -36,6 +40,9 @@ private:
     QString m_url;                              // 打开的视频地址
     bool m_play   = false;                      // 播放控制
     bool m_pause  = false;                      // 暂停控制
+    bool m_visible = true;                      // 显示是否可见（GUI线程设置）
+    bool m_hidden  = false;                     // 读取线程当前是否按不可见解码
+    bool m_waitKey = false;                     // 恢复可见后等待下一个关键帧再显示
     QElapsedTimer m_etime1;                     // 控制视频播放速度（更精确，但不支持视频后退）
     QTime         m_etime2;                     // 控制视频播放速度（支持视频后退）
 };
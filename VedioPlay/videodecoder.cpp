@@ -21,6 +21,13 @@ extern "C" {        // 用C规则编译指定的代码
 #define ERROR_LEN 1024  // 异常信息数组长度
 #define PRINT_LOG 1
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define USE_SSE2 0
+#endif
+
 
 VideoDecoder::VideoDecoder()
 {
@@ -118,6 +125,7 @@ bool VideoDecoder::open(const QString &url)
         free();
         return false;
     }
+    setKeyFrameOnly(m_keyOnly);
 
     // 分配AVPacket并将其字段设置为默认值。
     m_packet = av_packet_alloc();
@@ -139,21 +147,24 @@ bool VideoDecoder::open(const QString &url)
         free();
         return false;
     }
-    // 分配图像空间
-    int size = av_image_get_buffer_size(AV_PIX_FMT_RGBA, m_size.width(), m_size.height(), 4);
-
-    m_buffer = new uchar[size + 1000];    // 这里多分配1000个字节就基本不会出现拷贝超出的情况了，反正不缺这点内存
-    //    m_image = new QImage(m_buffer, m_size.width(), m_size.height(), QImage::Format_RGBA8888);
-    // 这种方式分配内存大部分情况下也可以，但是因为存在拷贝超出数组的情况，delete时也会报错
     m_end = false;
     return true;
 }
 
 QImage VideoDecoder::read()
+{
+    return readFrame() ? toImage() : QImage();
+}
+
+/**
+ * @brief  读取一个数据包并尝试取出一帧，解码后的帧保留到转换或下一次读取，不可见时可以只解码不转换
+ * @return 取出一帧时返回true
+ */
+bool VideoDecoder::readFrame()
 {
     if(!m_formatContext)
     {
-        return QImage();
+        return false;
     }
     // 读取下一帧数据
     int readRet = av_read_frame(m_formatContext, m_packet);
@@ -190,19 +201,34 @@ QImage VideoDecoder::read()
         {
             m_end = true;     // 当无法读取到AVPacket并且解码器中也没有数据时表示读取完成
         }
-        return QImage();
+        return false;
     }
 
     m_pts = m_frame->pts;
+    return true;
+}
+
+/**
+ * @brief  最后解码的一帧转换为RGBA，每次转换到新分配的QImage中：图像放入显示信箱后在GUI线程中才转换为QPixmap，
+ *         共用一个转换缓冲时下一帧会覆盖还没有显示的图像，关闭后缓冲释放时信箱中的图像也会失效
+ * @return 没有解码的帧时返回空图像
+ */
+QImage VideoDecoder::toImage()
+{
+    if(!m_frame || !m_frame->data[0])
+    {
+        return QImage();
+    }
+    AVFrame* frame = reduceTo8Bit() ? m_reduced : m_frame;   // 10/12位视频先缩减为8位，QPainter显示只需要8位
 
     // 为什么图像转换上下文要放在这里初始化呢，是因为m_frame->format，如果使用硬件解码，解码出来的图像格式和m_codecContext->pix_fmt的图像格式不一样，就会导致无法转换为QImage
     if(!m_swsContext)
     {
         // 获取缓存的图像转换上下文。首先校验参数是否一致，如果校验不通过就释放资源；然后判断上下文是否存在，如果存在直接复用，如不存在进行分配、初始化操作
         m_swsContext = sws_getCachedContext(m_swsContext,
-                                            m_frame->width,                     // 输入图像的宽度
-                                            m_frame->height,                    // 输入图像的高度
-                                            (AVPixelFormat)m_frame->format,     // 输入图像的像素格式
+                                            frame->width,                       // 输入图像的宽度
+                                            frame->height,                      // 输入图像的高度
+                                            (AVPixelFormat)frame->format,       // 输入图像的像素格式
                                             m_size.width(),                     // 输出图像的宽度
                                             m_size.height(),                    // 输出图像的高度
                                             AV_PIX_FMT_RGBA,                    // 输出图像的像素格式
@@ -220,24 +246,123 @@ QImage VideoDecoder::read()
         }
     }
 
-    // AVFrame转QImage
-    uchar* data[]  = {m_buffer};
-    int    lines[4];
-    av_image_fill_linesizes(lines, AV_PIX_FMT_RGBA, m_frame->width);  // 使用像素格式pix_fmt和宽度填充图像的平面线条大小。
-    ret = sws_scale(m_swsContext,             // 缩放上下文
-                    m_frame->data,            // 原图像数组
-                    m_frame->linesize,        // 包含源图像每个平面步幅的数组
-                    0,                        // 开始位置
-                    m_frame->height,          // 行数
-                    data,                     // 目标图像数组
-                    lines);                   // 包含目标图像每个平面的步幅的数组
-    QImage image(m_buffer, m_frame->width, m_frame->height, QImage::Format_RGBA8888);
+    // AVFrame转QImage，直接转换到QImage的像素缓冲中，不需要再拷贝
+    QImage image(m_size, QImage::Format_RGBA8888);
+    if(image.isNull())
+    {
+        av_frame_unref(m_frame);
+        return QImage();
+    }
+    uchar* data[]  = {image.bits()};
+    int    lines[] = {int(image.bytesPerLine())};
+    sws_scale(m_swsContext,             // 缩放上下文
+              frame->data,              // 原图像数组
+              frame->linesize,          // 包含源图像每个平面步幅的数组
+              0,                        // 开始位置
+              frame->height,            // 行数
+              data,                     // 目标图像数组
+              lines);                   // 包含目标图像每个平面的步幅的数组
     av_frame_unref(m_frame);
 
     return image;
 
 }
 
+bool VideoDecoder::isKeyFrame()
+{
+    return m_frame && m_frame->key_frame;
+}
+
+/**
+ * @brief         只解码关键帧时其它帧在解码器中直接丢弃，仍然读取全部数据包，保持连接和播放进度
+ * @param keyOnly
+ */
+void VideoDecoder::setKeyFrameOnly(bool keyOnly)
+{
+    m_keyOnly = keyOnly;
+    if(m_codecContext)
+    {
+        m_codecContext->skip_frame = keyOnly ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+    }
+}
+
+/**
+ * @brief       一行16位采样右移后饱和打包为8位，SSE2每次处理16个采样
+ * @param src
+ * @param dst
+ * @param count 采样数
+ * @param shift 右移位数（10位：2，12位：4，P010高位对齐：8）
+ */
+static void reduceRow(const uint16_t* src, uint8_t* dst, int count, int shift)
+{
+    int i = 0;
+#if USE_SSE2
+    const __m128i bits = _mm_cvtsi32_si128(shift);
+    for(; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+        a = _mm_srl_epi16(a, bits);
+        b = _mm_srl_epi16(b, bits);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(a, b));
+    }
+#endif
+    for(; i < count; i++)
+    {
+        dst[i] = uint8_t(src[i] >> shift);
+    }
+}
+
+/**
+ * @brief  yuv420p10/yuv420p12缩减为yuv420p，P010（硬件解码常用）缩减为nv12，
+ *         sws_scale直接从高位深转换为RGBA的耗时大约是8位的两倍
+ * @return m_frame不是支持的高位深格式时返回false
+ */
+bool VideoDecoder::reduceTo8Bit()
+{
+    int shift = 0;
+    AVPixelFormat format = AV_PIX_FMT_YUV420P;
+    switch (m_frame->format)
+    {
+    case AV_PIX_FMT_YUV420P10LE: shift = 2; break;
+    case AV_PIX_FMT_YUV420P12LE: shift = 4; break;
+    case AV_PIX_FMT_P010LE:      shift = 8; format = AV_PIX_FMT_NV12; break;
+    default: return false;
+    }
+    if(!m_reduced)
+    {
+        m_reduced = av_frame_alloc();
+        if(!m_reduced) return false;
+    }
+    if(m_reduced->width != m_frame->width || m_reduced->height != m_frame->height || m_reduced->format != format)
+    {
+        av_frame_unref(m_reduced);
+        m_reduced->width  = m_frame->width;
+        m_reduced->height = m_frame->height;
+        m_reduced->format = format;
+        if(av_frame_get_buffer(m_reduced, 0) < 0)
+        {
+            av_frame_unref(m_reduced);
+            return false;
+        }
+    }
+
+    int chromaWidth  = (m_frame->width + 1) / 2;
+    int chromaHeight = (m_frame->height + 1) / 2;
+    int planes = (format == AV_PIX_FMT_NV12) ? 2 : 3;
+    for(int p = 0; p < planes; p++)
+    {
+        int width  = (p == 0) ? m_frame->width : (format == AV_PIX_FMT_NV12 ? chromaWidth * 2 : chromaWidth);   // nv12的UV交错，每行采样数加倍
+        int height = (p == 0) ? m_frame->height : chromaHeight;
+        for(int y = 0; y < height; y++)
+        {
+            reduceRow(reinterpret_cast<const uint16_t*>(m_frame->data[p] + y * m_frame->linesize[p]),
+                      m_reduced->data[p] + y * m_reduced->linesize[p], width, shift);
+        }
+    }
+    return true;
+}
+
 void VideoDecoder::showError(int err)
 {
 #if PRINT_LOG
@@ -318,10 +443,9 @@ void VideoDecoder::free()
     {
         av_frame_free(&m_frame);
     }
-    if(m_buffer)
+    if(m_reduced)
     {
-        delete [] m_buffer;
-        m_buffer = nullptr;
+        av_frame_free(&m_reduced);
     }
 }
 qreal VideoDecoder::rationalToDouble(AVRational* rational)
@@ -24,11 +24,16 @@ public:
 
     bool open(const QString& url=  QString());
     QImage read();
+    bool readFrame();                             // 读取并解码一帧，成功时可以用toImage()转换
+    QImage toImage();                             // 把最后解码的一帧转换为QImage
+    bool isKeyFrame();                            // 最后解码的一帧是否为关键帧
+    void setKeyFrameOnly(bool keyOnly);           // 只解码关键帧（显示不可见时降低解码开销）
     void close();
     bool isEnd();
     const qint64& pts();
 
 private:
+    bool reduceTo8Bit();                          // 10/12位YUV缩减为8位保存到m_reduced，不是高位深格式时返回false
     void showError(int err);                      // 显示ffmpeg执行错误时的错误信息
     qreal rationalToDouble(AVRational* rational); // 将AVRational转换为double
     void clear();                                 // 清空读取缓冲
@@ -40,6 +45,7 @@ private:
     SwsContext* m_swsContext = nullptr;
     AVPacket* m_packet = nullptr;
     AVFrame*  m_frame  = nullptr;                 // 解码后的视频帧
+    AVFrame*  m_reduced = nullptr;                // 高位深视频缩减为8位后的帧（yuv420p/nv12），sws从8位转换快很多
     int m_videoIndex = 0;
     qint64 m_totalTime = 0;//总时长和总帧数
     qint64 m_totalFrames  = 0;
@@ -49,7 +55,7 @@ private:
     QSize  m_size;              //分辨率大小,QSize是QT中的一个用于表示二维的类
     char * m_error = nullptr;
     bool m_end = false;
-    uchar * m_buffer = nullptr; //这是用来存储yuv转rgba之后的数据
+    bool m_keyOnly = false;                       // 只解码关键帧，重新打开后保持
 
 };
 
@@ -0,0 +1,182 @@
+#include "filtergraph.h"
+#include <QDebug>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/avutil.h>
+#include <libavutil/frame.h>
+}
+
+/**
+ * @brief         创建时不分配资源，第一帧到达时才知道输入格式
+ * @param filters 滤镜描述，如"yadif"、"crop=640:360:0:0,fps=5"
+ * @param threads 滤镜图线程数，与解码线程分开计算
+ */
+FilterGraph::FilterGraph(const QString &filters, int threads)
+    : m_filters(filters), m_threads(qMax(1, threads))
+{
+}
+
+FilterGraph::~FilterGraph()
+{
+    free();
+}
+
+/**
+ * @brief       送入一帧，只增加引用计数（AV_BUFFERSRC_FLAG_KEEP_REF），调用者仍然持有frame。
+ *              输入尺寸或像素格式变化时重新创建滤镜图，旧滤镜图中缓存的帧丢弃
+ * @param frame 时间戳单位为毫秒
+ * @return      滤镜不可用时返回false，调用者可以直接使用未处理的帧
+ */
+bool FilterGraph::push(const AVFrame *frame)
+{
+    m_timer.start();
+    if(!frame)
+    {
+        if(!m_graph)
+        {
+            m_end = true;                         // 还没有帧送入过，直接结束
+        }
+        else if(!m_flushed)
+        {
+            av_buffersrc_add_frame_flags(m_source, nullptr, 0);
+        }
+        m_flushed = true;
+        return true;
+    }
+    if(m_failed) return false;
+    if(!m_graph || frame->width != m_width || frame->height != m_height || frame->format != m_format)
+    {
+        free();
+        if(!init(frame))
+        {
+            free();
+            m_failed = true;
+            return false;
+        }
+    }
+    int ret = av_buffersrc_add_frame_flags(m_source, const_cast<AVFrame*>(frame), AV_BUFFERSRC_FLAG_KEEP_REF);
+    m_cost += m_timer.nsecsElapsed();
+    return ret >= 0;
+}
+
+/**
+ * @brief       取出一帧，返回的帧由调用者释放引用
+ * @param frame
+ * @return
+ */
+bool FilterGraph::pull(AVFrame *frame)
+{
+    if(!m_graph) return false;
+
+    m_timer.start();
+    int ret = av_buffersink_get_frame(m_sink, frame);
+    m_cost += m_timer.nsecsElapsed();
+    if(ret == AVERROR_EOF)
+    {
+        m_end = true;
+    }
+    return ret >= 0;
+}
+
+bool FilterGraph::isEnd()
+{
+    return m_end;
+}
+
+void FilterGraph::reset()
+{
+    free();
+    m_flushed = false;
+    m_end     = false;
+    m_failed  = false;
+}
+
+QString FilterGraph::filters() const
+{
+    return m_filters;
+}
+
+qint64 FilterGraph::takeCost()
+{
+    qint64 cost = m_cost;
+    m_cost = 0;
+    return cost;
+}
+
+/**
+ * @brief       按第一帧的参数创建 buffer -> 用户滤镜 -> buffersink
+ * @param frame
+ * @return
+ */
+bool FilterGraph::init(const AVFrame *frame)
+{
+    m_graph = avfilter_graph_alloc();
+    if(!m_graph) return false;
+    m_graph->nb_threads  = m_threads;
+    m_graph->thread_type = AVFILTER_THREAD_SLICE;
+
+    AVRational sar = frame->sample_aspect_ratio;
+    if(sar.num <= 0 || sar.den <= 0)
+    {
+        sar = AVRational{1, 1};
+    }
+    QString args = QString("video_size=%1x%2:pix_fmt=%3:time_base=1/1000:pixel_aspect=%4/%5")
+                       .arg(frame->width).arg(frame->height).arg(frame->format).arg(sar.num).arg(sar.den);
+    int ret = avfilter_graph_create_filter(&m_source, avfilter_get_by_name("buffer"), "in",
+                                           args.toUtf8().constData(), nullptr, m_graph);
+    if(ret < 0) return false;
+    ret = avfilter_graph_create_filter(&m_sink, avfilter_get_by_name("buffersink"), "out", nullptr, nullptr, m_graph);
+    if(ret < 0) return false;
+
+    // 用户滤镜的输入连接到buffer的输出，输出连接到buffersink
+    AVFilterInOut* outputs = avfilter_inout_alloc();
+    AVFilterInOut* inputs  = avfilter_inout_alloc();
+    if(outputs && inputs)
+    {
+        outputs->name       = av_strdup("in");
+        outputs->filter_ctx = m_source;
+        outputs->pad_idx    = 0;
+        outputs->next       = nullptr;
+        inputs->name        = av_strdup("out");
+        inputs->filter_ctx  = m_sink;
+        inputs->pad_idx     = 0;
+        inputs->next        = nullptr;
+        ret = avfilter_graph_parse_ptr(m_graph, m_filters.toUtf8().constData(), &inputs, &outputs, nullptr);
+        if(ret >= 0)
+        {
+            ret = avfilter_graph_config(m_graph, nullptr);
+        }
+    }
+    else
+    {
+        ret = AVERROR(ENOMEM);
+    }
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    if(ret < 0)
+    {
+        qWarning() << "创建滤镜失败：" << m_filters;
+        return false;
+    }
+
+    m_width  = frame->width;
+    m_height = frame->height;
+    m_format = frame->format;
+    return true;
+}
+
+void FilterGraph::free()
+{
+    if(m_graph)
+    {
+        avfilter_graph_free(&m_graph);            // 同时释放m_source、m_sink
+    }
+    m_source = nullptr;
+    m_sink   = nullptr;
+    m_width  = 0;
+    m_height = 0;
+    m_format = -1;
+}
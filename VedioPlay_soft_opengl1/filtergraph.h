@@ -0,0 +1,49 @@
+#ifndef FILTERGRAPH_H
+#define FILTERGRAPH_H
+
+#include <QString>
+#include <QElapsedTimer>
+
+struct AVFilterGraph;
+struct AVFilterContext;
+struct AVFrame;
+
+/**
+ * @brief 解码后、转换为RGBA之前的libavfilter处理（如yadif去隔行、crop、scale、fps降帧），
+ *        帧只传递引用不拷贝。第一帧到达或输入格式变化时按帧参数创建滤镜图，
+ *        一帧输入可能得到0帧（fps降帧）或多帧（yadif=1）输出。不是线程安全的，由解码线程使用
+ */
+class FilterGraph
+{
+public:
+    FilterGraph(const QString& filters, int threads);
+    ~FilterGraph();
+
+    bool push(const AVFrame* frame);              // 送入一帧（增加引用），为空时表示输入结束
+    bool pull(AVFrame* frame);                    // 取出一帧处理后的图像，没有输出时返回false
+    bool isEnd();                                 // 输入结束后所有帧都已经取出
+    void reset();                                 // 清空滤镜中缓存的帧（跳转后调用），下一帧到达时重新创建
+    QString filters() const;
+    qint64 takeCost();                            // 上次调用之后送入、取出的累计耗时（纳秒），由解码器按帧统计
+
+private:
+    bool init(const AVFrame* frame);
+    void free();
+
+private:
+    QString m_filters;                            // 滤镜描述，与ffmpeg -vf参数相同
+    int m_threads = 1;                            // 滤镜图的线程数（只有支持slice线程的滤镜有效）
+    AVFilterGraph*   m_graph  = nullptr;
+    AVFilterContext* m_source = nullptr;          // buffer
+    AVFilterContext* m_sink   = nullptr;          // buffersink
+    int  m_width  = 0;                            // 创建滤镜图时的输入参数，变化时重新创建
+    int  m_height = 0;
+    int  m_format = -1;
+    bool m_flushed = false;                       // 已经送入结束标志
+    bool m_end = false;
+    bool m_failed = false;                        // 创建失败后不再重试，直到reset
+    QElapsedTimer m_timer;
+    qint64 m_cost = 0;                            // 没有取走的处理耗时（纳秒）
+};
+
+#endif // FILTERGRAPH_H
@@ -0,0 +1,290 @@
+#include "framebus.h"
+#include "memorybudget.h"
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavutil/frame.h>
+}
+
+FrameSubscriber::FrameSubscriber(Policy policy, int capacity, int session, QObject *parent)
+    : QObject(parent), m_policy(policy), m_session(session)
+{
+    m_capacity = (policy == LatestOnly) ? 1 : qMax(1, capacity);
+}
+
+FrameSubscriber::~FrameSubscriber()
+{
+    VideoFrame frame;
+    if(m_mailbox.take(&frame))
+    {
+        MemoryBudget::instance()->release(m_session, MemoryBudget::FrameQueue, frameBytes(frame));
+    }
+    while(!m_queue.isEmpty())
+    {
+        MemoryBudget::instance()->release(m_session, MemoryBudget::FrameQueue, frameBytes(m_queue.dequeue()));
+    }
+}
+
+bool FrameSubscriber::take(VideoFrame *frame)
+{
+    if(m_policy == LatestOnly)
+    {
+        if(!m_mailbox.take(frame)) return false;
+        MemoryBudget::instance()->release(m_session, MemoryBudget::FrameQueue, frameBytes(*frame));
+        return true;
+    }
+    QMutexLocker locker(&m_mutex);
+    if(m_queue.isEmpty()) return false;
+    *frame = m_queue.dequeue();
+    MemoryBudget::instance()->release(m_session, MemoryBudget::FrameQueue, frameBytes(*frame));
+    return true;
+}
+
+int FrameSubscriber::pending()
+{
+    if(m_policy == LatestOnly) return m_mailbox.hasNew() ? 1 : 0;
+    QMutexLocker locker(&m_mutex);
+    return m_queue.size();
+}
+
+qint64 FrameSubscriber::dropped()
+{
+    return m_dropped.loadRelaxed() + m_mailbox.dropped();
+}
+
+FrameSubscriber::Policy FrameSubscriber::policy() const
+{
+    return m_policy;
+}
+
+/**
+ * @brief        不活动时发布的帧直接忽略（不转换、不上传），已经在队列中的帧仍然可以取出
+ * @param active
+ */
+void FrameSubscriber::setActive(bool active)
+{
+    m_active.storeRelease(active ? 1 : 0);
+}
+
+bool FrameSubscriber::isActive() const
+{
+    return m_active.loadAcquire();
+}
+
+void FrameSubscriber::setImageRequired(bool required)
+{
+    m_imageRequired.storeRelease(required ? 1 : 0);
+}
+
+bool FrameSubscriber::isImageRequired() const
+{
+    return m_imageRequired.loadAcquire();
+}
+
+void FrameSubscriber::setDisplaySize(const QSize &size)
+{
+    m_displayWidth.storeRelaxed(qMax(0, size.width()));
+    m_displayHeight.storeRelaxed(qMax(0, size.height()));
+}
+
+QSize FrameSubscriber::displaySize() const
+{
+    return QSize(m_displayWidth.loadRelaxed(), m_displayHeight.loadRelaxed());
+}
+
+/**
+ * @brief       放入一帧，队列满时丢弃最早的帧，超出进程内存预算时丢弃这一帧。只在队列由空变为非空时通知，
+ *              订阅者处理慢时不会堆积大量信号
+ * @param frame
+ */
+void FrameSubscriber::push(const VideoFrame &frame)
+{
+    if(!isActive()) return;
+    if(m_policy == LatestOnly)
+    {
+        pushLatest(frame);
+        return;
+    }
+    MemoryBudget* budget = MemoryBudget::instance();
+    m_mutex.lock();
+    bool notify = m_queue.isEmpty();
+    while(m_queue.size() >= m_capacity)
+    {
+        budget->release(m_session, MemoryBudget::FrameQueue, frameBytes(m_queue.dequeue()));
+        m_dropped++;
+    }
+    if(!budget->reserve(m_session, MemoryBudget::FrameQueue, frameBytes(frame)))
+    {
+        // 超出预算时丢弃排队的旧帧而不是新帧，否则队列空了以后显示会一直停在旧画面
+        while(!m_queue.isEmpty())
+        {
+            budget->release(m_session, MemoryBudget::FrameQueue, frameBytes(m_queue.dequeue()));
+            m_dropped++;
+        }
+        budget->add(m_session, MemoryBudget::FrameQueue, frameBytes(frame));
+    }
+    m_queue.enqueue(frame);
+    m_mutex.unlock();
+
+    if(notify)
+    {
+        emit frameAvailable();
+    }
+}
+
+/**
+ * @brief       显示只需要最新一帧：放入信箱替换没有取走的帧，被替换的帧立即释放，
+ *              只在之前的帧已经被取走时通知，显示线程落后时不会堆积排队的信号和图像
+ * @param frame
+ */
+void FrameSubscriber::pushLatest(const VideoFrame &frame)
+{
+    // 信箱最多保存一帧，超出预算时也放入最新一帧（直接记账），被替换的帧立即释放，不会继续增长
+    MemoryBudget* budget = MemoryBudget::instance();
+    budget->add(m_session, MemoryBudget::FrameQueue, frameBytes(frame));
+    VideoFrame superseded;
+    bool notify = m_mailbox.post(frame, &superseded);
+    if(!notify)
+    {
+        budget->release(m_session, MemoryBudget::FrameQueue, frameBytes(superseded));
+    }
+    else
+    {
+        emit frameAvailable();
+    }
+}
+
+/**
+ * @brief       每个订阅者队列中的一帧都按图像大小记账（多个订阅者共享同一帧时会重复计算，按上限估计），
+ *              没有转换为图像的高位深帧按解码帧的缓冲区大小记账
+ * @param frame
+ * @return
+ */
+qint64 FrameSubscriber::frameBytes(const VideoFrame &frame)
+{
+    if(!frame.image.isNull() || !frame.frame) return frame.image.sizeInBytes();
+    qint64 bytes = 0;
+    for(int i = 0; i < AV_NUM_DATA_POINTERS && frame.frame->buf[i]; i++)
+    {
+        bytes += qint64(frame.frame->buf[i]->size);
+    }
+    return bytes;
+}
+
+
+FrameBus::FrameBus(QObject *parent) : QObject(parent)
+{
+}
+
+void FrameBus::setMemorySession(int session)
+{
+    QMutexLocker locker(&m_mutex);
+    m_session = session;
+}
+
+int FrameBus::memorySession()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_session;
+}
+
+/**
+ * @brief          添加订阅者
+ * @param policy   队列策略
+ * @param capacity Bounded时的队列长度
+ * @return         由总线管理生命周期，不再使用时调用unsubscribe
+ */
+FrameSubscriber *FrameBus::subscribe(FrameSubscriber::Policy policy, int capacity)
+{
+    QMutexLocker locker(&m_mutex);
+    FrameSubscriber* subscriber = new FrameSubscriber(policy, capacity, m_session, this);
+    m_subscribers.append(subscriber);
+    return subscriber;
+}
+
+void FrameBus::unsubscribe(FrameSubscriber *subscriber)
+{
+    m_mutex.lock();
+    bool found = m_subscribers.removeOne(subscriber);
+    if(found)
+    {
+        m_dropped += subscriber->dropped();       // 保留已经取消的订阅者丢弃的帧数，统计只增不减
+    }
+    m_mutex.unlock();                             // 移除后发布线程不会再访问这个订阅者
+    if(found)
+    {
+        subscriber->deleteLater();
+    }
+}
+
+/**
+ * @brief       同一帧分发给所有订阅者，只增加引用计数
+ * @param frame
+ */
+void FrameBus::publish(const VideoFrame &frame)
+{
+    QMutexLocker locker(&m_mutex);
+    for(FrameSubscriber* subscriber : qAsConst(m_subscribers))
+    {
+        subscriber->push(frame);
+    }
+}
+
+int FrameBus::subscriberCount()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_subscribers.size();
+}
+
+int FrameBus::activeSubscriberCount()
+{
+    QMutexLocker locker(&m_mutex);
+    int count = 0;
+    for(FrameSubscriber* subscriber : qAsConst(m_subscribers))
+    {
+        count += subscriber->isActive();
+    }
+    return count;
+}
+
+bool FrameBus::imageRequired()
+{
+    QMutexLocker locker(&m_mutex);
+    for(FrameSubscriber* subscriber : qAsConst(m_subscribers))
+    {
+        if(subscriber->isActive() && subscriber->isImageRequired()) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief  同一路视频显示在多个窗口时按最大的窗口选择码流，宽、高分别取最大值
+ * @return
+ */
+QSize FrameBus::displaySize()
+{
+    QMutexLocker locker(&m_mutex);
+    QSize size;
+    for(FrameSubscriber* subscriber : qAsConst(m_subscribers))
+    {
+        if(!subscriber->isActive()) continue;
+        size = size.expandedTo(subscriber->displaySize());
+    }
+    return size.isEmpty() ? QSize() : size;
+}
+
+/**
+ * @brief         所有订阅者队列中等待处理的帧数和累计丢弃的帧数（包括已经取消的订阅者），用于运行指标
+ * @param pending
+ * @param dropped
+ */
+void FrameBus::statistics(int *pending, qint64 *dropped)
+{
+    QMutexLocker locker(&m_mutex);
+    *pending = 0;
+    *dropped = m_dropped;
+    for(FrameSubscriber* subscriber : qAsConst(m_subscribers))
+    {
+        *pending += subscriber->pending();
+        *dropped += subscriber->dropped();
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef FRAMEBUS_H
+#define FRAMEBUS_H
+
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QSize>
+#include <QAtomicInteger>
+#include "framemailbox.h"
+
+struct AVFrame;
+
+/**
+ * @brief 总线上传递的一帧，图像和解码帧都是引用计数共享，多个订阅者之间不拷贝
+ */
+struct VideoFrame
+{
+    QImage image;                                 // 转换后的RGBA图像，启用高位深直通时为空（只有frame）
+    QSharedPointer<AVFrame> frame;                // 解码帧的引用（分析、截图使用），图像来自缓存时为空
+    qint64 pts = -1;                              // 帧时间（毫秒）
+    int    stream = 0;                            // 播放会话编号（跟踪使用）
+    qint64 published = -1;                        // 发布时的跟踪时钟，跟踪关闭时为-1
+};
+
+/**
+ * @brief 一个订阅者的帧队列，由FrameBus创建和释放
+ */
+class FrameSubscriber : public QObject
+{
+    Q_OBJECT
+public:
+    enum Policy             // 队列策略
+    {
+        LatestOnly,         // 只保留最新的一帧（显示）
+        Bounded             // 最多保留capacity帧，满时丢弃最早的一帧并计数（录制、分析）
+    };
+
+    bool take(VideoFrame* frame);                 // 取出最早的一帧，队列为空时返回false
+    int  pending();                               // 队列中的帧数
+    qint64 dropped();                             // 队列满（或超出内存预算）被丢弃的帧数
+    Policy policy() const;
+    void setActive(bool active);                  // 显示不可见时设置为false，不再接收帧；没有活动订阅者时读取线程降低解码开销
+    bool isActive() const;
+    void setImageRequired(bool required);         // 只能显示RGBA图像（如MosaicView），有这样的活动订阅者时高位深视频也转换
+    bool isImageRequired() const;
+    void setDisplaySize(const QSize& size);       // 清晰显示需要的视频分辨率（显示区域的物理像素，局部放大时按倍数换算），用于选择码流
+    QSize displaySize() const;
+
+signals:
+    void frameAvailable();                        // 队列由空变为非空（在发布线程中触发），收到后需要把队列取空
+
+private:
+    friend class FrameBus;
+    FrameSubscriber(Policy policy, int capacity, int session, QObject* parent);
+    ~FrameSubscriber() override;
+    void push(const VideoFrame& frame);
+    void pushLatest(const VideoFrame& frame);     // LatestOnly：放入无锁信箱
+    static qint64 frameBytes(const VideoFrame& frame);   // 内存记账使用的大小
+
+private:
+    QMutex m_mutex;                               // 只用于Bounded队列
+    QQueue<VideoFrame> m_queue;
+    FrameMailbox<VideoFrame> m_mailbox;           // LatestOnly使用无锁信箱，显示线程取帧不加锁
+    Policy m_policy = LatestOnly;
+    int    m_capacity = 1;
+    QAtomicInteger<qint64> m_dropped = 0;         // 队列满或超出内存预算丢弃的帧数（不包括信箱替换的帧）
+    int    m_session = 0;                         // 内存记账会话
+    QAtomicInt m_active = 1;                      // 是否接收帧
+    QAtomicInt m_imageRequired = 0;               // 是否需要RGBA图像
+    QAtomicInt m_displayWidth = 0;                // 需要的视频分辨率，0表示没有设置（宽高分开保存，短暂不一致不影响选择）
+    QAtomicInt m_displayHeight = 0;
+};
+
+/**
+ * @brief 帧总线：一路解码发布一次，任意多个订阅者（多个显示窗口、分析、截图等）各自按自己的队列策略取帧。线程安全
+ */
+class FrameBus : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FrameBus(QObject *parent = nullptr);
+
+    void setMemorySession(int session);           // 订阅者队列内存记账的播放会话（在订阅之前设置）
+    int  memorySession();                         // 显示窗口的纹理也记在这个会话下
+
+    FrameSubscriber* subscribe(FrameSubscriber::Policy policy = FrameSubscriber::LatestOnly, int capacity = 1);
+    void unsubscribe(FrameSubscriber* subscriber); // 取消订阅，返回后不会再收到帧，订阅者稍后自动释放
+    void publish(const VideoFrame& frame);         // 发布一帧（在解码线程中调用）
+    int  subscriberCount();
+    int  activeSubscriberCount();                 // 可见（接收帧）的订阅者数量
+    bool imageRequired();                         // 是否有活动的订阅者需要RGBA图像（不能只使用解码帧）
+    QSize displaySize();                          // 可见订阅者中最大的显示分辨率，都没有设置时为空
+    void statistics(int* pending, qint64* dropped);   // 所有订阅者等待处理的帧数、累计丢弃的帧数
+
+private:
+    QMutex m_mutex;
+    QList<FrameSubscriber*> m_subscribers;
+    int m_session = 0;
+    qint64 m_dropped = 0;                         // 已经取消的订阅者丢弃的帧数
+};
+
+#endif // FRAMEBUS_H
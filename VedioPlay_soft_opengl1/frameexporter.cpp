@@ -0,0 +1,353 @@
+#include "frameexporter.h"
+#include "memorybudget.h"
+#include "videodecoder.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThread>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * @brief 编码一帧（解码帧的引用或已经转换好的QImage）
+ */
+class EncodeTask : public QRunnable
+{
+public:
+    EncodeTask(FrameExporter* exporter, AVFrame* frame, const QImage& image, const QString& fileName, qint64 bytes)
+        : m_exporter(exporter), m_frame(frame), m_image(image), m_fileName(fileName), m_bytes(bytes)
+    {
+    }
+    ~EncodeTask() override
+    {
+        free();
+    }
+
+    void run() override
+    {
+        bool ok = false;
+        if(m_frame)
+        {
+            ok = encode(m_exporter->m_quality.loadAcquire());
+            free();                              // 尽快释放引用，解码器可以复用这块内存
+        }
+        else
+        {
+            ok = m_image.save(m_fileName, nullptr, m_exporter->m_quality.loadAcquire());
+        }
+        if(!ok)
+        {
+            qWarning() << "导出帧失败：" << m_fileName;
+        }
+        m_image = QImage();
+        emit m_exporter->frameExported(m_fileName, ok);
+        m_exporter->release(m_bytes);
+    }
+
+private:
+    /**
+     * @brief         根据文件后缀选择编码器，把m_frame编码为一张图片并写入文件，
+     *                编码器支持解码帧的像素格式时直接编码，否则转换为损失最小的格式
+     * @param quality JPEG/WebP质量（1~100），PNG无损忽略
+     * @return
+     */
+    bool encode(int quality)
+    {
+        QString suffix = QFileInfo(m_fileName).suffix().toLower();
+        AVCodecID id = AV_CODEC_ID_NONE;
+        if(suffix == "png")                          id = AV_CODEC_ID_PNG;
+        else if(suffix == "jpg" || suffix == "jpeg") id = AV_CODEC_ID_MJPEG;
+        else if(suffix == "webp")                    id = AV_CODEC_ID_WEBP;     // 需要ffmpeg编译时启用libwebp
+        const AVCodec* codec = avcodec_find_encoder(id);
+        if(!codec)
+        {
+            qWarning() << "没有可以使用的图片编码器：" << m_fileName;
+            return false;
+        }
+        AVPixelFormat srcFormat = AVPixelFormat(m_frame->format);
+        AVPixelFormat dstFormat = srcFormat;
+        if(codec->pix_fmts)
+        {
+            dstFormat = avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, srcFormat, 0, nullptr);
+        }
+
+        m_context = avcodec_alloc_context3(codec);
+        m_packet  = av_packet_alloc();
+        if(!m_context || !m_packet) return false;
+        m_context->width        = m_frame->width;
+        m_context->height       = m_frame->height;
+        m_context->pix_fmt      = dstFormat;
+        m_context->color_range  = m_frame->color_range;
+        m_context->time_base    = AVRational{1, 25};
+        m_context->thread_count = 1;                 // 多张图片已经在线程池中并行
+        m_context->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;   // 允许MJPEG直接编码非full range的YUV420P
+
+        AVDictionary* dict = nullptr;
+        if(id == AV_CODEC_ID_MJPEG)
+        {
+            m_context->flags |= AV_CODEC_FLAG_QSCALE;
+            m_context->global_quality = FF_QP2LAMBDA * (2 + (100 - quality) * 29 / 99);   // 质量1~100对应qscale 31~2
+        }
+        else if(id == AV_CODEC_ID_WEBP)
+        {
+            av_dict_set_int(&dict, "quality", quality, 0);
+        }
+        int ret = avcodec_open2(m_context, codec, &dict);
+        if(dict)
+        {
+            av_dict_free(&dict);
+        }
+        if(ret < 0) return false;
+
+        const AVFrame* frame = m_frame;
+        if(dstFormat != srcFormat)
+        {
+            if(!convert(dstFormat)) return false;
+            frame = m_converted;
+        }
+        if(avcodec_send_frame(m_context, frame) < 0) return false;
+        avcodec_send_frame(m_context, nullptr);      // 只编码一帧，直接结束
+
+        QFile file(m_fileName);
+        if(!file.open(QIODevice::WriteOnly)) return false;
+        bool ok = false;
+        while(avcodec_receive_packet(m_context, m_packet) == 0)
+        {
+            ok = file.write(reinterpret_cast<const char*>(m_packet->data), m_packet->size) == m_packet->size;
+            av_packet_unref(m_packet);
+        }
+        return ok;
+    }
+
+    bool convert(AVPixelFormat format)
+    {
+        m_converted = av_frame_alloc();
+        if(!m_converted) return false;
+        m_converted->width  = m_frame->width;
+        m_converted->height = m_frame->height;
+        m_converted->format = format;
+        if(av_frame_get_buffer(m_converted, 0) < 0) return false;
+
+        SwsContext* sws = sws_getContext(m_frame->width, m_frame->height, AVPixelFormat(m_frame->format),
+                                         m_frame->width, m_frame->height, format,
+                                         SWS_BICUBIC, nullptr, nullptr, nullptr);
+        if(!sws) return false;
+        sws_scale(sws, m_frame->data, m_frame->linesize, 0, m_frame->height, m_converted->data, m_converted->linesize);
+        sws_freeContext(sws);
+        return true;
+    }
+
+    void free()
+    {
+        if(m_context)
+        {
+            avcodec_free_context(&m_context);
+        }
+        if(m_packet)
+        {
+            av_packet_free(&m_packet);
+        }
+        if(m_converted)
+        {
+            av_frame_free(&m_converted);
+        }
+        if(m_frame)
+        {
+            av_frame_free(&m_frame);
+        }
+    }
+
+private:
+    FrameExporter* m_exporter = nullptr;
+    AVFrame* m_frame = nullptr;                   // 解码帧的引用
+    QImage   m_image;
+    QString  m_fileName;
+    AVCodecContext* m_context = nullptr;
+    AVFrame*  m_converted = nullptr;              // 编码器不支持解码帧的像素格式时转换后的帧
+    AVPacket* m_packet = nullptr;
+    qint64    m_bytes = 0;                        // 记账的内存大小
+};
+
+/**
+ * @brief 批量导出：使用单独的解码器跳转到开始位置，把范围内的每一帧交给编码线程，编码跟不上时等待
+ */
+class RangeExportTask : public QRunnable
+{
+public:
+    RangeExportTask(FrameExporter* exporter, const QString& url, qint64 start, qint64 end,
+                    const QString& dir, const QString& suffix)
+        : m_exporter(exporter), m_url(url), m_start(start), m_end(end), m_dir(dir), m_suffix(suffix)
+    {
+    }
+
+    void run() override
+    {
+        VideoDecoder decoder;
+        int  count = 0;
+        bool ok = QDir().mkpath(m_dir) && decoder.open(m_url) && decoder.seek(m_start);
+        while(ok && !m_exporter->m_cancel.loadAcquire())
+        {
+            const AVFrame* frame = decoder.readFrame();
+            if(!frame)
+            {
+                if(decoder.isEnd()) break;
+                continue;
+            }
+            qint64 pts = decoder.pts();
+            if(pts < m_start) continue;          // 跳转到关键帧后，开始位置之前的帧不导出
+            if(pts > m_end) break;
+
+            QString fileName = QDir(m_dir).filePath(QString("%1.%2").arg(pts, 9, 10, QChar('0')).arg(m_suffix));
+            if(!m_exporter->exportFrame(frame, fileName, true)) break;   // 取消
+            count++;
+        }
+        decoder.close();
+        emit m_exporter->rangeExported(count, ok && !m_exporter->m_cancel.loadAcquire());
+    }
+
+private:
+    FrameExporter* m_exporter = nullptr;
+    QString m_url;
+    qint64  m_start = 0;
+    qint64  m_end   = 0;
+    QString m_dir;
+    QString m_suffix;
+};
+
+
+FrameExporter::FrameExporter(QObject *parent) : QObject(parent)
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));   // 留一半线程给解码
+    m_rangePool.setMaxThreadCount(1);
+}
+
+FrameExporter::~FrameExporter()
+{
+    cancel();
+}
+
+void FrameExporter::setMaxPending(int count)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxPending = qMax(1, count);
+    m_condition.wakeAll();
+}
+
+void FrameExporter::setQuality(int quality)
+{
+    m_quality.storeRelease(qBound(1, quality, 100));
+}
+
+/**
+ * @brief          导出一帧，只增加引用计数，编码在线程池中执行，完成后触发frameExported
+ * @param frame    解码后的帧，调用返回后可以继续解码
+ * @param fileName 后缀决定格式（.png/.jpg/.webp）
+ * @param wait     队列满时是否等待，false时直接丢弃这一帧
+ * @return         队列满被丢弃或取消时返回false
+ */
+bool FrameExporter::exportFrame(const AVFrame *frame, const QString &fileName, bool wait)
+{
+    if(!frame) return false;
+    qint64 bytes = 0;
+    for(int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++)
+    {
+        bytes += qint64(frame->buf[i]->size);    // 引用的缓冲区在编码完成前不能被解码器复用
+    }
+    if(!acquire(bytes, wait)) return false;
+
+    AVFrame* ref = av_frame_clone(frame);
+    if(!ref)
+    {
+        release(bytes);
+        return false;
+    }
+    m_pool.start(new EncodeTask(this, ref, QImage(), fileName, bytes));
+    return true;
+}
+
+/**
+ * @brief          导出已经转换好的图像（比如逐帧后退时来自GOP缓存的图像），在线程池中使用QImage::save保存
+ * @param image
+ * @param fileName
+ * @param wait
+ * @return
+ */
+bool FrameExporter::exportImage(const QImage &image, const QString &fileName, bool wait)
+{
+    if(image.isNull()) return false;
+    qint64 bytes = image.sizeInBytes();
+    if(!acquire(bytes, wait)) return false;
+
+    m_pool.start(new EncodeTask(this, nullptr, image, fileName, bytes));
+    return true;
+}
+
+/**
+ * @brief        批量导出一段时间内的所有帧，文件名为帧时间（毫秒），完成后触发rangeExported
+ * @param url    本地视频文件
+ * @param start  开始时间（毫秒）
+ * @param end    结束时间（毫秒）
+ * @param dir    保存目录
+ * @param suffix 图片格式
+ */
+void FrameExporter::exportRange(const QString &url, qint64 start, qint64 end, const QString &dir, const QString &suffix)
+{
+    cancel();
+    m_cancel.storeRelease(0);
+    m_rangePool.start(new RangeExportTask(this, url, start, end, dir, suffix));
+}
+
+void FrameExporter::cancel()
+{
+    m_mutex.lock();
+    m_cancel.storeRelease(1);
+    m_condition.wakeAll();                       // 唤醒等待队列的批量导出线程
+    m_mutex.unlock();
+    m_rangePool.waitForDone();
+    m_pool.waitForDone();
+}
+
+int FrameExporter::pending()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pending;
+}
+
+/**
+ * @brief       截图（不等待）超出内存预算时丢弃；批量导出已经由队列长度限制，超出预算时仍然记账，
+ *              避免其它模块占满预算时导出一直无法继续
+ * @param bytes
+ * @param wait
+ * @return
+ */
+bool FrameExporter::acquire(qint64 bytes, bool wait)
+{
+    QMutexLocker locker(&m_mutex);
+    while(m_pending >= m_maxPending)
+    {
+        if(!wait || m_cancel.loadAcquire()) return false;
+        m_condition.wait(&m_mutex);
+    }
+    if(!MemoryBudget::instance()->reserve(0, MemoryBudget::FrameQueue, bytes))
+    {
+        if(!wait) return false;
+        MemoryBudget::instance()->add(0, MemoryBudget::FrameQueue, bytes);
+    }
+    m_pending++;
+    return true;
+}
+
+void FrameExporter::release(qint64 bytes)
+{
+    MemoryBudget::instance()->release(0, MemoryBudget::FrameQueue, bytes);
+    QMutexLocker locker(&m_mutex);
+    m_pending--;
+    m_condition.wakeAll();
+}
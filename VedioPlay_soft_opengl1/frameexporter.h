@@ -0,0 +1,55 @@
+#ifndef FRAMEEXPORTER_H
+#define FRAMEEXPORTER_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+struct AVFrame;
+
+/**
+ * @brief 截图、导出帧：只增加解码帧的引用（不拷贝、不转换为RGBA），在后台线程池中用ffmpeg编码为PNG/JPEG/WebP。
+ *        等待编码的帧数有上限，超过时截图直接丢弃，批量导出等待（背压），防止解码速度比编码快时内存一直增长。
+ *        等待编码的帧计入进程内存预算（MemoryBudget::FrameQueue），超出预算时截图同样丢弃
+ */
+class FrameExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FrameExporter(QObject *parent = nullptr);
+    ~FrameExporter() override;
+
+    void setMaxPending(int count);                // 等待编码的最大帧数
+    void setQuality(int quality);                 // JPEG/WebP质量（1~100）
+    bool exportFrame(const AVFrame* frame, const QString& fileName, bool wait = false);  // 导出解码帧，格式由后缀决定
+    bool exportImage(const QImage& image, const QString& fileName, bool wait = false);   // 导出已经转换好的图像（来自缓存的帧）
+    void exportRange(const QString& url, qint64 start, qint64 end,
+                     const QString& dir, const QString& suffix = "png");  // 批量导出[start, end]毫秒内的所有帧（异步）
+    void cancel();                                // 取消批量导出，等待已经提交的帧编码完成
+    int  pending();                               // 正在等待编码的帧数
+
+signals:
+    void frameExported(const QString& fileName, bool ok);   // 一帧导出完成（在编码线程中触发）
+    void rangeExported(int count, bool ok);                 // 批量导出完成
+
+private:
+    friend class EncodeTask;
+    friend class RangeExportTask;
+    bool acquire(qint64 bytes, bool wait);        // 申请一个编码队列位置并记账，队列满时等待或返回false
+    void release(qint64 bytes);                   // 一帧编码完成时调用
+
+private:
+    QThreadPool m_pool;                           // 编码线程
+    QThreadPool m_rangePool;                      // 批量导出的解码线程，与编码线程分开，等待队列时不会占用编码线程
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    int m_pending = 0;                            // 已经提交还没有编码完成的帧数
+    int m_maxPending = 8;
+    QAtomicInt m_quality = 90;
+    QAtomicInt m_cancel = 0;                      // 取消批量导出标志
+};
+
+#endif // FRAMEEXPORTER_H
@@ -0,0 +1,292 @@
+#include "framepresenter.h"
+#include "playimage.h"
+#include "tracer.h"
+#include "metrics.h"
+#include <QStringList>
+#include <QtMath>
+#define HISTOGRAM_MIN   -10     // 误差直方图范围（毫秒），超出范围的计入两端
+#define HISTOGRAM_STEP  2
+#define HISTOGRAM_SIZE  20
+#define QUEUE_FRAMES    8       // 等待显示的最大帧数
+
+FramePresenter::FramePresenter(PlayImage *view, QObject *parent)
+    : QObject(parent), m_view(view)
+{
+    m_histogram.fill(0, HISTOGRAM_SIZE + 2);
+    m_clock.start();
+    connect(m_view, &PlayImage::frameSwapped, this, &FramePresenter::on_frameSwapped);
+    connect(m_view, &PlayImage::visibilityChanged, this, &FramePresenter::on_visibilityChanged);
+    connect(m_view, &PlayImage::displaySizeChanged, this, &FramePresenter::on_displaySizeChanged);
+}
+
+FramePresenter::~FramePresenter()
+{
+    setFrameBus(nullptr);
+}
+
+/**
+ * @brief     通过无锁信箱订阅最新一帧：读取线程已经按帧时间发送，显示线程取出后放入自己的等待队列，
+ *            只在刷新前选择到了显示时间的帧；界面线程卡住超过一帧时长时中间的帧在信箱中直接替换，不加锁也不堆积
+ * @param bus
+ */
+void FramePresenter::setFrameBus(FrameBus *bus)
+{
+    if(m_subscriber)
+    {
+        m_frameBus->unsubscribe(m_subscriber);
+        m_subscriber = nullptr;
+    }
+    m_frameBus = bus;
+    m_pending.clear();
+    m_baseValid = false;
+    m_session = bus ? bus->memorySession() : 0;   // 内存记账和指标使用同一个会话编号
+    m_view->setMemorySession(m_session);
+    if(!bus) return;
+
+    m_subscriber = bus->subscribe(FrameSubscriber::LatestOnly);
+    m_subscriber->setActive(m_view->isShown());
+    m_subscriber->setDisplaySize(m_view->displaySize());
+    FrameSubscriber* subscriber = m_subscriber;
+    connect(subscriber, &FrameSubscriber::frameAvailable, this, [this, subscriber]() {
+        if(subscriber == m_subscriber)
+        {
+            on_frameAvailable();
+        }
+    }, Qt::QueuedConnection);
+}
+
+void FramePresenter::setSpeed(qreal speed)
+{
+    if(speed <= 0) return;
+    m_speed = speed;
+    m_baseValid = false;                          // 按新的倍速重新对齐
+}
+
+void FramePresenter::setDelay(int msec)
+{
+    m_delay = qMax(0, msec);
+    m_baseValid = false;
+}
+
+qint64 FramePresenter::repeatedRefreshes() const
+{
+    return m_repeated;
+}
+
+qint64 FramePresenter::skippedFrames() const
+{
+    return m_skipped;
+}
+
+/**
+ * @brief  误差直方图只列出非空的区间
+ * @return
+ */
+QString FramePresenter::report() const
+{
+    QStringList buckets;
+    for(int i = 0; i < m_histogram.size(); i++)
+    {
+        if(m_histogram.at(i) == 0) continue;
+        int low = HISTOGRAM_MIN + (i - 1) * HISTOGRAM_STEP;
+        QString range;
+        if(i == 0)                               range = QString("<%1").arg(HISTOGRAM_MIN);
+        else if(i == m_histogram.size() - 1)     range = QString(">=%1").arg(low);
+        else                                     range = QString("%1~%2").arg(low).arg(low + HISTOGRAM_STEP);
+        buckets << QString("%1:%2").arg(range).arg(m_histogram.at(i));
+    }
+    qint64 replaced = m_subscriber ? m_subscriber->dropped() : 0;   // 界面线程来不及取走、在信箱中被替换的帧
+    return QString("刷新间隔%1 ms，显示%2帧，多显示%3次刷新，跳过%4帧，信箱替换%5帧，呈现误差(ms) %6")
+        .arg(m_interval, 0, 'f', 2).arg(m_presented).arg(m_repeated).arg(m_skipped).arg(replaced).arg(buckets.join(' '));
+}
+
+void FramePresenter::resetStatistics()
+{
+    m_histogram.fill(0);
+    m_presented = 0;
+    m_repeated  = 0;
+    m_skipped   = 0;
+}
+
+/**
+ * @brief 取出所有新到达的帧，没有在逐次刷新时请求一次重绘，由交换完成开始调度
+ */
+void FramePresenter::on_frameAvailable()
+{
+    VideoFrame frame;
+    while(m_subscriber->take(&frame))
+    {
+        if(frame.published >= 0)
+        {
+            Tracer::instance()->complete("signal hop", frame.published, frame.stream, frame.pts);
+        }
+        if(m_pending.size() >= QUEUE_FRAMES)
+        {
+            m_pending.dequeue();
+            m_skipped++;
+            Metrics::instance()->add("vedioplay_present_skipped_frames_total", m_session);
+        }
+        m_pending.enqueue(frame);
+    }
+    if(!m_ticking && !m_pending.isEmpty())
+    {
+        m_ticking = true;
+        m_view->update();
+    }
+}
+
+/**
+ * @brief 一次交换完成：更新刷新间隔估计，记录上一次设置的帧的实际呈现时间，
+ *        再选择下一次刷新时应该显示的帧（显示时间离下一次刷新最近的最新一帧）
+ */
+void FramePresenter::on_frameSwapped()
+{
+    qreal t = now();
+    qreal interval = t - m_lastSwap;
+    if(m_lastSwap >= 0 && interval > m_interval * 0.5 && interval < m_interval * 1.5)
+    {
+        m_interval = m_interval * 0.95 + interval * 0.05;   // 只用连续刷新的间隔，空闲后的第一次交换不计入
+    }
+    m_lastSwap = t;
+
+    if(m_presentPending)
+    {
+        m_presentPending = false;
+        addError(t - m_presentDue);
+        m_refreshes = 1;
+    }
+    else if(m_currentPts >= 0)
+    {
+        m_refreshes++;
+    }
+    if(!m_ticking) return;
+
+    qreal next = t + m_interval;                 // 下一次刷新的时间
+    bool found = false;
+    VideoFrame frame;
+    qreal due = 0;
+    while(!m_pending.isEmpty())
+    {
+        qreal frontDue = dueTime(m_pending.head());
+        if(frontDue > next + m_interval / 2) break;   // 离之后的刷新更近，留到之后
+        if(found)
+        {
+            m_skipped++;                          // 同一次刷新有多帧到期，只显示最新的
+            Metrics::instance()->add("vedioplay_present_skipped_frames_total", m_session);
+        }
+        frame = m_pending.dequeue();
+        due = frontDue;
+        found = true;
+    }
+    if(found)
+    {
+        present(frame, due);
+    }
+    else if(!m_pending.isEmpty())
+    {
+        m_view->update();                         // 当前帧再显示一次刷新，保持逐次刷新的节奏
+    }
+    else
+    {
+        m_ticking = false;                        // 没有等待的帧，停止刷新直到新帧到达
+    }
+}
+
+/**
+ * @brief         不可见时不再接收帧，等待的帧丢弃；重新可见后按新到达的帧重新对齐
+ * @param visible
+ */
+void FramePresenter::on_visibilityChanged(bool visible)
+{
+    if(m_subscriber)
+    {
+        m_subscriber->setActive(visible);
+    }
+    if(!visible)
+    {
+        m_pending.clear();
+        m_ticking = false;
+        m_baseValid = false;
+    }
+}
+
+qreal FramePresenter::now() const
+{
+    return qreal(m_clock.nsecsElapsed()) / 1000000;
+}
+
+/**
+ * @brief       第一帧、倍速变化、跳转倒放（帧时间回退）或暂停恢复（帧严重落后）后，
+ *              以这一帧的到达时间加上延时重新对齐，之后严格按帧时间间隔显示
+ * @param frame
+ * @return
+ */
+qreal FramePresenter::dueTime(const VideoFrame &frame)
+{
+    qreal t = now();
+    qreal due = m_base + frame.pts / m_speed;
+    if(!m_baseValid || frame.pts < m_lastPts || due < t - 100 || due > t + 1000)
+    {
+        m_base = t + m_delay - frame.pts / m_speed;
+        m_baseValid = true;
+        due = m_base + frame.pts / m_speed;
+    }
+    m_lastPts = frame.pts;
+    return due;
+}
+
+void FramePresenter::present(const VideoFrame &frame, qreal due)
+{
+    finishFrame(frame.pts);
+    m_currentPts = frame.pts;
+    m_presentPending = true;
+    m_presentDue = due;
+    m_view->setTraceInfo(frame.stream, frame.pts);
+    if(frame.image.isNull() && frame.frame)
+    {
+        m_view->updateFrame(frame.frame);         // 高位深帧没有转换为RGBA
+    }
+    else
+    {
+        m_view->updateImage(frame.image);
+    }
+    m_presented++;
+}
+
+/**
+ * @brief         按帧时长需要的刷新次数（向上取整）判断当前帧是否多显示了刷新
+ * @param nextPts 替换它的帧时间
+ */
+void FramePresenter::finishFrame(qint64 nextPts)
+{
+    if(m_currentPts < 0 || m_refreshes <= 0 || nextPts <= m_currentPts) return;
+
+    qreal duration = (nextPts - m_currentPts) / m_speed;
+    int expected = qMax(1, qCeil(duration / m_interval - 0.1));
+    if(m_refreshes > expected)
+    {
+        m_repeated += m_refreshes - expected;
+        Metrics::instance()->add("vedioplay_repeated_refreshes_total", m_session, m_refreshes - expected);
+    }
+    m_refreshes = 0;
+}
+
+void FramePresenter::addError(qreal error)
+{
+    int index = qFloor((error - HISTOGRAM_MIN) / HISTOGRAM_STEP) + 1;
+    index = qBound(0, index, HISTOGRAM_SIZE + 1);
+    m_histogram[index]++;
+    Metrics::instance()->observe("vedioplay_present_error_seconds", m_session, error / 1000);
+}
+
+/**
+ * @brief      显示窗口大小变化时更新订阅者需要的分辨率，读取线程据此切换码流
+ * @param size
+ */
+void FramePresenter::on_displaySizeChanged(const QSize &size)
+{
+    if(m_subscriber)
+    {
+        m_subscriber->setDisplaySize(size);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef FRAMEPRESENTER_H
+#define FRAMEPRESENTER_H
+
+#include <QObject>
+#include <QQueue>
+#include <QVector>
+#include <QElapsedTimer>
+#include "framebus.h"
+
+class PlayImage;
+
+/**
+ * @brief 按显示器刷新节奏呈现视频帧：以PlayImage的frameSwapped（交换缓冲完成）作为刷新时钟，
+ *        每次刷新前按帧时间选择应该在下一次刷新显示的帧，而不是解码线程等待结束后立即刷新。
+ *        25fps在60Hz显示器上每帧稳定交替显示2、3次刷新，不会因为解码线程的等待误差出现不规则的抖动。
+ *        统计呈现时间误差直方图、多显示的刷新次数和没有显示就被替换的帧数
+ */
+class FramePresenter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FramePresenter(PlayImage* view, QObject* parent = nullptr);
+    ~FramePresenter() override;
+
+    void setFrameBus(FrameBus* bus);            // 订阅帧总线（无锁信箱取最新一帧，自己的队列保留还没有到显示时间的帧），为空时取消订阅
+    void setSpeed(qreal speed);                 // 播放倍速，帧时间按倍速换算为显示时间
+    void setDelay(int msec);                    // 帧到达后至少等待的时间，吸收解码线程发送时间的抖动
+    qint64 repeatedRefreshes() const;           // 帧显示的刷新次数超过帧时长需要的次数（卡顿）
+    qint64 skippedFrames() const;               // 没有显示就被更新的帧替换的帧数
+    QString report() const;                     // 统计结果（同时导出为vedioplay_present_*指标）
+    void resetStatistics();
+
+private slots:
+    void on_frameAvailable();
+    void on_frameSwapped();
+    void on_visibilityChanged(bool visible);
+    void on_displaySizeChanged(const QSize& size);
+
+private:
+    qreal now() const;                          // 毫秒
+    qreal dueTime(const VideoFrame& frame);     // 帧应该显示的时间，时间不连续时重新对齐
+    void present(const VideoFrame& frame, qreal due);
+    void finishFrame(qint64 nextPts);           // 当前帧被替换，统计它显示的刷新次数
+    void addError(qreal error);
+
+private:
+    PlayImage* m_view = nullptr;
+    FrameBus* m_frameBus = nullptr;
+    FrameSubscriber* m_subscriber = nullptr;
+    QQueue<VideoFrame> m_pending;               // 等待显示的帧，按帧时间排序
+    QElapsedTimer m_clock;
+    qreal  m_speed = 1;
+    qreal  m_delay = 40;
+    qreal  m_base = 0;                          // 显示时间 = m_base + pts / m_speed
+    bool   m_baseValid = false;
+    qint64 m_lastPts = -1;                      // 最后一个进入调度的帧时间，用于检测跳转、倒放
+    bool   m_ticking = false;                   // 是否在逐次刷新（没有等待的帧时停止）
+    qreal  m_lastSwap = -1;
+    qreal  m_interval = 1000.0 / 60;            // 估计的刷新间隔
+    bool   m_presentPending = false;            // 新的帧已经设置，等待下一次交换完成
+    qreal  m_presentDue = 0;
+    qint64 m_currentPts = -1;                   // 正在显示的帧
+    int    m_refreshes = 0;                     // 当前帧已经显示的刷新次数
+    QVector<qint64> m_histogram;                // 呈现误差（实际-计划）分布
+    qint64 m_presented = 0;
+    qint64 m_repeated = 0;
+    qint64 m_skipped = 0;
+    int    m_session = 0;                       // 帧总线的播放会话，指标记在这个会话下
+};
+
+#endif // FRAMEPRESENTER_H
@@ -0,0 +1,114 @@
+#include "frametap.h"
+
+#include <QDebug>
+#include <cstring>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+void FrameTapList::add(FrameTap *tap, qreal fps, int width)
+{
+    if(!tap || fps <= 0 || width <= 0) return;
+    remove(tap);
+
+    Entry entry;
+    entry.tap = tap;
+    entry.interval = qint64(1000 / fps);
+    entry.width = width;
+    QMutexLocker locker(&m_mutex);
+    m_entries.append(entry);
+}
+
+void FrameTapList::remove(FrameTap *tap)
+{
+    QMutexLocker locker(&m_mutex);            // 正在回调时会等待回调完成
+    for(int i = m_entries.size() - 1; i >= 0; i--)
+    {
+        if(m_entries.at(i).tap == tap)
+        {
+            m_entries.removeAt(i);
+        }
+    }
+}
+
+bool FrameTapList::isEmpty()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.isEmpty();
+}
+
+/**
+ * @brief       到达回调间隔的接口才缩小图像并回调，跳转后（时间倒退）立即回调
+ * @param frame 解码帧（YUV、NV12、灰度等8位格式）
+ * @param pts
+ */
+void FrameTapList::deliver(const AVFrame *frame, qint64 pts)
+{
+    QMutexLocker locker(&m_mutex);
+    if(m_entries.isEmpty()) return;
+
+    m_factor = 0;
+    for(Entry& entry : m_entries)
+    {
+        if(entry.lastPts >= 0 && pts >= entry.lastPts && pts - entry.lastPts < entry.interval) continue;
+
+        int factor = qMax(1, (frame->width + entry.width - 1) / entry.width);
+        if(factor != m_factor && !decimate(frame, factor)) return;
+        entry.lastPts = pts;
+        entry.tap->process(reinterpret_cast<const uchar*>(m_buffer.constData()), m_width, m_height, m_width, pts);
+    }
+}
+
+/**
+ * @brief        Y平面按factor x factor的块求平均缩小，只支持亮度在第0个平面、每个像素1个字节的格式
+ * @param frame
+ * @param factor
+ * @return
+ */
+bool FrameTapList::decimate(const AVFrame *frame, int factor)
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(AVPixelFormat(frame->format));
+    if(!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL))
+       || desc->comp[0].plane != 0 || desc->comp[0].step != 1 || desc->comp[0].depth != 8)
+    {
+        if(m_badFormat != frame->format)          // 同一种格式只提示一次
+        {
+            m_badFormat = frame->format;
+            qWarning() << "分析接口不支持的像素格式：" << (desc ? desc->name : "unknown");
+        }
+        return false;
+    }
+    m_width  = frame->width / factor;
+    m_height = frame->height / factor;
+    if(m_width <= 0 || m_height <= 0) return false;
+    m_buffer.resize(m_width * m_height);
+
+    const int area = factor * factor;
+    for(int y = 0; y < m_height; y++)
+    {
+        const uchar* src = frame->data[0] + qint64(y) * factor * frame->linesize[0];
+        uchar* dst = reinterpret_cast<uchar*>(m_buffer.data()) + y * m_width;
+        if(factor == 1)
+        {
+            memcpy(dst, src, size_t(m_width));
+            continue;
+        }
+        for(int x = 0; x < m_width; x++)
+        {
+            int sum = 0;
+            for(int i = 0; i < factor; i++)
+            {
+                const uchar* row = src + i * frame->linesize[0] + x * factor;
+                for(int j = 0; j < factor; j++)
+                {
+                    sum += row[j];
+                }
+            }
+            dst[x] = uchar(sum / area);
+        }
+    }
+    m_factor = factor;
+    return true;
+}
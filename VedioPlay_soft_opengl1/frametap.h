@@ -0,0 +1,60 @@
+#ifndef FRAMETAP_H
+#define FRAMETAP_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+
+struct AVFrame;
+
+/**
+ * @brief 分析接口：在转换为RGBA之前，直接使用解码帧的Y平面（灰度图），按设置的帧率和缩小后的尺寸回调
+ */
+class FrameTap
+{
+public:
+    virtual ~FrameTap() {}
+
+    /**
+     * @brief        在解码线程中调用，需要尽快返回，耗时的处理应该拷贝数据后放到其它线程
+     * @param gray   缩小后的灰度图，只在调用期间有效
+     * @param width
+     * @param height
+     * @param stride 每行字节数
+     * @param pts    帧时间（毫秒）
+     */
+    virtual void process(const uchar* gray, int width, int height, int stride, qint64 pts) = 0;
+};
+
+/**
+ * @brief 已注册的分析接口列表，由解码器在每次解码出一帧后调用deliver。线程安全
+ */
+class FrameTapList
+{
+public:
+    void add(FrameTap* tap, qreal fps, int width);    // 注册，fps：最大回调帧率  width：灰度图最大宽度（按整数倍缩小）
+    void remove(FrameTap* tap);                       // 取消注册，返回后不会再被调用，可以直接释放
+    void deliver(const AVFrame* frame, qint64 pts);   // 按帧率把灰度图分发给各个接口
+    bool isEmpty();                                   // 没有注册的接口
+
+private:
+    struct Entry
+    {
+        FrameTap* tap = nullptr;
+        qint64 interval = 0;                          // 最小回调间隔（毫秒）
+        int    width = 0;
+        qint64 lastPts = -1;                          // 上次回调的帧时间
+    };
+    bool decimate(const AVFrame* frame, int factor); // 按factor缩小Y平面到m_buffer
+
+private:
+    QMutex m_mutex;
+    QList<Entry> m_entries;
+    QByteArray m_buffer;                              // 缩小后的灰度图，多个接口缩小倍数相同时共用
+    int m_factor = 0;                                 // m_buffer的缩小倍数，0表示无效
+    int m_width  = 0;
+    int m_height = 0;
+    int m_badFormat = -1;                             // 已经提示过的不支持的像素格式
+};
+
+#endif // FRAMETAP_H
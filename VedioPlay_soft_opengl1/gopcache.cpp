@@ -0,0 +1,271 @@
+#include "gopcache.h"
+#include "videodecoder.h"
+#include "memorybudget.h"
+
+#include <QBuffer>
+#include <QDebug>
+
+#define MAX_GOP_FRAMES 600      // 一个GOP最多缓存的帧数，防止没有关键帧的流一直解码
+#define MAX_READ_COUNT 5000     // 解码一个GOP最多调用read()的次数（包括音频包）
+
+GopCache::GopCache()
+{
+}
+
+void GopCache::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_memoryBudget = bytes;
+}
+
+void GopCache::setStoreMode(StoreMode mode)
+{
+    clear();                     // 保存方式不同的数据不能混用
+    QMutexLocker locker(&m_mutex);
+    m_mode = mode;
+}
+
+void GopCache::setMemorySession(int session)
+{
+    QMutexLocker locker(&m_mutex);
+    m_session = session;
+}
+
+void GopCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_gops.clear();
+    MemoryBudget::instance()->release(m_session, MemoryBudget::Cache, m_bytes);
+    m_bytes = 0;
+}
+
+/**
+ * @brief         跳转到msec之前的关键帧，一直解码到下一个关键帧，把整个GOP保存下来。
+ *                跳转后的第一个关键帧在msec之后时，msec之前没有关键帧，这个GOP标记为第一个GOP，已经缓存时不再解码。
+ *                解码器的读取位置会被改变，调用者需要自己恢复
+ * @param decoder 已经打开的解码器（本地文件）
+ * @param msec
+ * @return
+ */
+bool GopCache::load(VideoDecoder *decoder, qint64 msec)
+{
+    if(contains(msec)) return true;
+    if(!decoder->seek(msec)) return false;
+
+    StoreMode mode;
+    m_mutex.lock();
+    mode = m_mode;
+    m_mutex.unlock();
+
+    Gop gop;
+    bool started = false;
+    for(int i = 0; i < MAX_READ_COUNT && gop.pts.size() < MAX_GOP_FRAMES; i++)
+    {
+        QImage image = decoder->read();
+        if(image.isNull())
+        {
+            if(decoder->isEnd()) break;
+            continue;
+        }
+        qint64 pts = decoder->pts();
+        if(decoder->isKeyFrame())
+        {
+            if(started && pts > msec)
+            {
+                gop.next = pts;          // 下一个GOP开始
+                break;
+            }
+            if(!started && pts > msec)
+            {
+                m_mutex.lock();
+                int index = find(pts);
+                if(index >= 0)
+                {
+                    m_gops[index].first = true;
+                }
+                m_mutex.unlock();
+                if(index >= 0) return false;     // msec之前没有图像，第一个GOP已经缓存
+            }
+            if(!started || pts <= msec)
+            {
+                // 跳转不一定精确，msec之前还有关键帧时从那个关键帧重新开始
+                gop = Gop();
+                gop.start = pts;
+                gop.first = pts > msec;
+                started = true;
+            }
+        }
+        if(!started || pts < gop.start) continue;    // 关键帧之前的帧（开放GOP）参考帧不完整，不保存
+
+        gop.pts.append(pts);
+        gop.end = pts;
+        switch (mode)
+        {
+        case Full:
+            gop.images.append(image);                // read()每次返回新的图像，直接共享
+            gop.bytes += gop.images.last().sizeInBytes();
+            break;
+        case HalfSize:
+            gop.images.append(image.scaled(image.size() / 2, Qt::IgnoreAspectRatio, Qt::FastTransformation));
+            gop.bytes += gop.images.last().sizeInBytes();
+            break;
+        case Compressed:
+        {
+            QByteArray data;
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::WriteOnly);
+            image.save(&buffer, "JPG", 90);
+            gop.datas.append(data);
+            gop.bytes += data.size();
+            break;
+        }
+        }
+    }
+    if(gop.pts.isEmpty()) return false;
+
+    insert(gop);
+    return true;
+}
+
+bool GopCache::contains(qint64 msec)
+{
+    QMutexLocker locker(&m_mutex);
+    return find(msec) >= 0;
+}
+
+/**
+ * @brief        查找msec之前的一帧，msec是GOP第一帧时从前一个GOP中查找（前一个GOP也需要已经缓存）
+ * @param msec   当前帧时间
+ * @param pts    返回找到的帧时间
+ * @param image  返回找到的图像
+ * @return
+ */
+bool GopCache::frameBefore(qint64 msec, qint64 *pts, QImage *image)
+{
+    QMutexLocker locker(&m_mutex);
+    int index = find(msec);
+    if(index < 0) return false;
+
+    const Gop& gop = m_gops.at(index);
+    for(int i = gop.pts.size() - 1; i >= 0; i--)
+    {
+        if(gop.pts.at(i) < msec)
+        {
+            *pts = gop.pts.at(i);
+            *image = this->image(gop, i);
+            m_gops.move(index, m_gops.size() - 1);   // 标记为最近使用
+            return true;
+        }
+    }
+    // 在前一个GOP中查找
+    for(int i = 0; i < m_gops.size(); i++)
+    {
+        const Gop& prev = m_gops.at(i);
+        if(prev.next == gop.start)
+        {
+            *pts = prev.pts.last();
+            *image = this->image(prev, prev.pts.size() - 1);
+            m_gops.move(i, m_gops.size() - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GopCache::frameAfter(qint64 msec, qint64 *pts, QImage *image)
+{
+    QMutexLocker locker(&m_mutex);
+    int index = find(msec);
+    if(index < 0) return false;
+
+    const Gop& gop = m_gops.at(index);
+    for(int i = 0; i < gop.pts.size(); i++)
+    {
+        if(gop.pts.at(i) > msec)
+        {
+            *pts = gop.pts.at(i);
+            *image = this->image(gop, i);
+            m_gops.move(index, m_gops.size() - 1);
+            return true;
+        }
+    }
+    // 在后一个GOP中查找
+    if(gop.next < 0) return false;
+    for(int i = 0; i < m_gops.size(); i++)
+    {
+        const Gop& next = m_gops.at(i);
+        if(next.start == gop.next)
+        {
+            *pts = next.pts.first();
+            *image = this->image(next, 0);
+            m_gops.move(i, m_gops.size() - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+qint64 GopCache::gopStart(qint64 msec)
+{
+    QMutexLocker locker(&m_mutex);
+    int index = find(msec);
+    return index < 0 ? -1 : m_gops.at(index).start;
+}
+
+bool GopCache::isFirst(qint64 msec)
+{
+    QMutexLocker locker(&m_mutex);
+    int index = find(msec);
+    return index >= 0 && m_gops.at(index).first;
+}
+
+qint64 GopCache::memoryUsage()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bytes;
+}
+
+int GopCache::find(qint64 msec) const
+{
+    for(int i = 0; i < m_gops.size(); i++)
+    {
+        if(msec >= m_gops.at(i).start && msec <= m_gops.at(i).end)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief     保存GOP，超出缓存预算或进程内存预算时淘汰最久未使用的GOP（至少保留刚加入的一个）
+ * @param gop
+ */
+void GopCache::insert(const Gop &gop)
+{
+    QMutexLocker locker(&m_mutex);
+    if(find(gop.start) >= 0) return;                 // 预读线程可能已经缓存了同一个GOP
+
+    m_gops.append(gop);
+    m_bytes += gop.bytes;
+    MemoryBudget::instance()->add(m_session, MemoryBudget::Cache, gop.bytes);
+    while((m_bytes > m_memoryBudget || MemoryBudget::instance()->isOverBudget()) && m_gops.size() > 1)
+    {
+        qint64 bytes = m_gops.takeFirst().bytes;
+        m_bytes -= bytes;
+        MemoryBudget::instance()->release(m_session, MemoryBudget::Cache, bytes);
+    }
+}
+
+QImage GopCache::image(const Gop &gop, int index) const
+{
+    if(index < gop.images.size())
+    {
+        return gop.images.at(index);
+    }
+    if(index < gop.datas.size())
+    {
+        return QImage::fromData(gop.datas.at(index), "JPG");
+    }
+    return QImage();
+}
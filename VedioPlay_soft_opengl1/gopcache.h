@@ -0,0 +1,67 @@
+#ifndef GOPCACHE_H
+#define GOPCACHE_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QVector>
+
+class VideoDecoder;
+
+/**
+ * @brief 解码后的GOP缓存：逐帧后退、倒放时一次解码整个GOP，之后在GOP内前后移动直接使用缓存。
+ *        可以按内存预算淘汰（最久未使用的GOP），并可选择缩小分辨率或压缩为JPEG保存。线程安全。
+ */
+class GopCache
+{
+public:
+    enum StoreMode      // 缓存图像的保存方式
+    {
+        Full,           // 原始图像
+        HalfSize,       // 宽高缩小一半，占用1/4内存
+        Compressed      // JPEG压缩，取出时解压
+    };
+
+public:
+    GopCache();
+
+    void setMemoryBudget(qint64 bytes);
+    void setStoreMode(StoreMode mode);
+    void setMemorySession(int session);              // 内存记账的播放会话，超出进程内存预算时也会淘汰
+    void clear();
+
+    bool load(VideoDecoder* decoder, qint64 msec);   // 使用decoder解码包含msec的GOP并缓存（在调用线程中执行）
+    bool contains(qint64 msec);                      // msec所在的GOP是否已经缓存
+    bool frameBefore(qint64 msec, qint64* pts, QImage* image);  // 查找msec之前的一帧
+    bool frameAfter(qint64 msec, qint64* pts, QImage* image);   // 查找msec之后的一帧
+    qint64 gopStart(qint64 msec);                    // msec所在GOP的开始时间，没有缓存时返回-1
+    bool isFirst(qint64 msec);                       // msec所在的GOP是否为文件的第一个GOP（前面没有关键帧）
+    qint64 memoryUsage();
+
+private:
+    struct Gop
+    {
+        qint64 start = 0;                            // 第一帧时间（毫秒）
+        qint64 end   = 0;                            // 最后一帧时间（毫秒）
+        qint64 next  = -1;                           // 下一个GOP第一帧时间，用于跨GOP查找，未知时为-1
+        bool   first = false;                        // 文件的第一个GOP
+        QVector<qint64> pts;                         // 按时间排序
+        QVector<QImage> images;                      // Full、HalfSize时使用
+        QVector<QByteArray> datas;                   // Compressed时使用
+        qint64 bytes = 0;
+    };
+    int  find(qint64 msec) const;                    // 查找msec所在GOP的下标，调用前需要加锁
+    void insert(const Gop& gop);
+    QImage image(const Gop& gop, int index) const;
+
+private:
+    QMutex m_mutex;
+    QList<Gop> m_gops;                               // 按使用顺序排列，最后一个是最近使用的
+    qint64 m_bytes = 0;
+    qint64 m_memoryBudget = 512 * 1024 * 1024;
+    StoreMode m_mode = Full;
+    int m_session = 0;                               // 内存记账会话
+};
+
+#endif // GOPCACHE_H
@@ -0,0 +1,350 @@
+#include "kernelbenchmark.h"
+#include "videodecoder.h"
+#include "offscreenrenderer.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QPixmap>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QDebug>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavdevice/avdevice.h>
+}
+
+#define MIN_TIME       300      // 每轮最少运行的时间（毫秒）
+#define MIN_ITERATIONS 5        // 每轮最少运行的次数
+#define ROUNDS         3        // 取最好的一轮，减少其它进程干扰
+#define VIEW_WIDTH     960      // 模拟的显示窗口大小
+#define VIEW_HEIGHT    540
+
+/**
+ * @brief           依次运行480p、1080p、4K的全部内核，打印每项结果和与基准的比值
+ * @param baseline  基准文件，每行"名称 每秒次数"，为空时只打印
+ * @param tolerance 允许的下降比例（如0.2表示比基准慢20%以内都算通过）
+ * @param update    把这次的结果写入基准文件（在参考机器上更新基准时使用）
+ * @return          有内核低于基准超过容差、基准文件不能读取、内核在基准中没有记录（或基准中的内核没有运行）时返回1，
+ *                  当前环境不能运行的内核（如没有OpenGL上下文时的纹理上传）只提示跳过
+ */
+int KernelBenchmark::run(const QString &baseline, qreal tolerance, bool update)
+{
+    avdevice_register_all();
+    QList<Result> results;
+    QStringList skipped;
+    results += runSize("480p",  QSize(854, 480),   100, &skipped);
+    results += runSize("1080p", QSize(1920, 1080), 50,  &skipped);
+    results += runSize("4k",    QSize(3840, 2160), 25,  &skipped);
+    if(results.isEmpty()) return 1;
+
+    if(update)
+    {
+        return saveBaseline(baseline, results) ? 0 : 1;
+    }
+
+    QMap<QString, qreal> base;
+    bool compare = !baseline.isEmpty();
+    if(compare && !loadBaseline(baseline, &base)) return 1;
+    QTextStream out(stdout);
+    int regressions = 0;
+    int missing = 0;
+    for(const Result& result : qAsConst(results))
+    {
+        out << QString("%1 %2").arg(result.name, -24).arg(result.rate, 12, 'f', 1);
+        if(compare)
+        {
+            qreal expected = base.take(result.name);
+            if(expected > 0)
+            {
+                qreal ratio = result.rate / expected;
+                bool regressed = ratio < 1 - tolerance;
+                regressions += regressed;
+                out << QString("  基准 %1  %2%  %3").arg(expected, 12, 'f', 1)
+                           .arg(ratio * 100, 6, 'f', 1).arg(regressed ? "退化" : "通过");
+            }
+            else
+            {
+                missing++;
+                out << "  基准中没有记录";
+            }
+        }
+        out << Qt::endl;
+    }
+    if(!compare) return 0;
+
+    for(auto it = base.cbegin(); it != base.cend(); ++it)
+    {
+        if(skipped.contains(it.key()))
+        {
+            out << QString("%1 %2").arg(it.key(), -24).arg("跳过", 12) << Qt::endl;
+            continue;
+        }
+        missing++;                                // 基准中有但这次没有运行
+        out << QString("%1 %2").arg(it.key(), -24).arg("没有运行", 12) << Qt::endl;
+    }
+    out << QString("%1项低于基准超过%2%，%3项没有对应的基准或结果").arg(regressions).arg(tolerance * 100).arg(missing) << Qt::endl;
+    return (regressions > 0 || missing > 0) ? 1 : 0;
+}
+
+/**
+ * @brief        lavfi的testsrc2（yuv420p）经rawvideo解码后用mpeg4编码为mkv，保存在临时目录中，已经存在时直接使用。
+ *               编码器单线程、固定量化参数、固定GOP，同一版本的FFmpeg生成的码流相同
+ * @param size
+ * @param frames 25帧/秒
+ * @return
+ */
+QString KernelBenchmark::generateClip(const QSize &size, int frames)
+{
+    QString fileName = QDir::temp().filePath(QString("vedioplay-bench-%1x%2-%3.mkv").arg(size.width()).arg(size.height()).arg(frames));
+    if(QFile::exists(fileName)) return fileName;
+
+    avdevice_register_all();
+    QString graph = QString("testsrc2=size=%1x%2:rate=25,format=yuv420p").arg(size.width()).arg(size.height());
+    AVFormatContext* input = nullptr;
+    AVFormatContext* output = nullptr;
+    AVCodecContext* decoder = nullptr;
+    AVCodecContext* encoder = nullptr;
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    AVStream* stream = nullptr;
+    QString temp = fileName + ".part";            // 生成完整后再改名，中断时不会留下不完整的文件
+    bool ok = false;
+    int written = 0;
+
+    auto encode = [&](AVFrame* f) {
+        if(avcodec_send_frame(encoder, f) < 0) return false;
+        while(avcodec_receive_packet(encoder, packet) >= 0)
+        {
+            av_packet_rescale_ts(packet, encoder->time_base, stream->time_base);
+            packet->stream_index = 0;
+            if(av_interleaved_write_frame(output, packet) < 0) return false;
+        }
+        return true;
+    };
+
+    do
+    {
+        if(avformat_open_input(&input, graph.toUtf8().constData(), av_find_input_format("lavfi"), nullptr) < 0) break;
+        if(avformat_find_stream_info(input, nullptr) < 0) break;
+        const AVCodecParameters* par = input->streams[0]->codecpar;
+        const AVCodec* rawCodec = avcodec_find_decoder(par->codec_id);
+        decoder = avcodec_alloc_context3(rawCodec);
+        if(!decoder || avcodec_parameters_to_context(decoder, par) < 0 || avcodec_open2(decoder, rawCodec, nullptr) < 0) break;
+
+        const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+        encoder = avcodec_alloc_context3(codec);
+        if(!encoder) break;
+        encoder->width = size.width();
+        encoder->height = size.height();
+        encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+        encoder->time_base = AVRational{1, 25};
+        encoder->framerate = AVRational{25, 1};
+        encoder->gop_size = 25;
+        encoder->max_b_frames = 2;
+        encoder->thread_count = 1;
+        encoder->flags |= AV_CODEC_FLAG_QSCALE;
+        encoder->global_quality = FF_QP2LAMBDA * 4;
+
+        if(avformat_alloc_output_context2(&output, nullptr, "matroska", temp.toUtf8().constData()) < 0) break;
+        if(output->oformat->flags & AVFMT_GLOBALHEADER)
+        {
+            encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        if(avcodec_open2(encoder, codec, nullptr) < 0) break;
+        stream = avformat_new_stream(output, nullptr);
+        if(!stream || avcodec_parameters_from_context(stream->codecpar, encoder) < 0) break;
+        stream->time_base = encoder->time_base;
+        if(avio_open(&output->pb, temp.toUtf8().constData(), AVIO_FLAG_WRITE) < 0) break;
+        if(avformat_write_header(output, nullptr) < 0) break;
+
+        bool failed = false;
+        while(written < frames && !failed && av_read_frame(input, packet) >= 0)
+        {
+            failed = avcodec_send_packet(decoder, packet) < 0;
+            av_packet_unref(packet);
+            while(!failed && written < frames && avcodec_receive_frame(decoder, frame) >= 0)
+            {
+                frame->pts = written++;
+                frame->pict_type = AV_PICTURE_TYPE_NONE;
+                failed = !encode(frame);
+                av_frame_unref(frame);
+            }
+        }
+        if(failed || !encode(nullptr)) break;     // 取出编码器中剩余的数据包
+        ok = av_write_trailer(output) >= 0;
+    } while(false);
+
+    if(output && output->pb)
+    {
+        avio_closep(&output->pb);
+    }
+    avformat_free_context(output);
+    avcodec_free_context(&encoder);
+    avcodec_free_context(&decoder);
+    avformat_close_input(&input);
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+
+    if(!ok || written < frames || !QFile::rename(temp, fileName))
+    {
+        QFile::remove(temp);
+        qWarning() << "生成测试视频失败：" << graph;
+        return QString();
+    }
+    return fileName;
+}
+
+/**
+ * @brief        一种分辨率的全部内核，名称为"内核_分辨率"
+ * @param label
+ * @param size
+ * @param frames
+ * @param skipped
+ * @return
+ */
+QList<KernelBenchmark::Result> KernelBenchmark::runSize(const QString &label, const QSize &size, int frames, QStringList *skipped)
+{
+    QList<Result> results;
+    QString clip = generateClip(size, frames);
+    if(clip.isEmpty()) return results;
+
+    VideoDecoder decoder;
+    if(!decoder.open(clip))
+    {
+        qWarning() << "打开测试视频失败：" << clip;
+        return results;
+    }
+    // 解码：读取数据包并解码一帧，到结尾后跳回开头，跳转本身不计时
+    QElapsedTimer timer;
+    results.append({"decode_" + label, measureTimed([&decoder, &timer]() {
+        qint64 spent = 0;
+        while(true)
+        {
+            timer.start();
+            const AVFrame* frame = decoder.readFrame();
+            spent += timer.nsecsElapsed();
+            if(frame) return spent;
+            if(decoder.isEnd()) decoder.seek(0);
+        }
+    })});
+
+    // 像素转换：sws_scale转换为RGBA（高位深直通在着色器中转换，CPU中没有转换可以测量）
+    results.append({"convert_sws_" + label, measure([&decoder]() {
+        decoder.convert();
+    })});
+
+    QImage image = decoder.convert();
+    results.append({"image_copy_" + label, measure([&image]() {
+        QImage copy = image.copy();
+        Q_UNUSED(copy)
+    })});
+    results.append({"image_mirror_" + label, measure([&image]() {
+        QImage mirrored = image.mirrored();       // 上传纹理前的上下翻转
+        Q_UNUSED(mirrored)
+    })});
+
+    // QPainter版本的显示：GUI线程中转为QPixmap，每次绘制时按窗口大小平滑缩放
+    QSize view(VIEW_WIDTH, VIEW_HEIGHT);
+    results.append({"pixmap_from_image_" + label, measure([&image]() {
+        QPixmap pixmap = QPixmap::fromImage(image);
+        Q_UNUSED(pixmap)
+    })});
+    QPixmap pixmap = QPixmap::fromImage(image);
+    results.append({"pixmap_scale_" + label, measure([&pixmap, view]() {
+        QPixmap scaled = pixmap.scaled(view, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        Q_UNUSED(scaled)
+    })});
+
+    // 纹理上传：只计入上传（包括glFinish）的耗时，不包括绘制
+    OffscreenRenderer renderer;
+    if(renderer.create(view))
+    {
+        results.append({"texture_upload_" + label, measureTimed([&renderer, &image]() {
+            renderer.render(image);
+            return renderer.lastTiming().upload;
+        })});
+    }
+    else
+    {
+        skipped->append("texture_upload_" + label);
+    }
+    return results;
+}
+
+qreal KernelBenchmark::measure(const std::function<void ()> &kernel)
+{
+    QElapsedTimer timer;
+    return measureTimed([&kernel, &timer]() {
+        timer.start();
+        kernel();
+        return timer.nsecsElapsed();
+    });
+}
+
+/**
+ * @brief        每轮运行到MIN_TIME，返回ROUNDS轮中最快的每秒次数
+ * @param kernel
+ * @return
+ */
+qreal KernelBenchmark::measureTimed(const std::function<qint64 ()> &kernel)
+{
+    qreal best = 0;
+    for(int round = 0; round < ROUNDS; round++)
+    {
+        QElapsedTimer wall;
+        wall.start();
+        qint64 spent = 0;
+        int count = 0;
+        while(wall.elapsed() < MIN_TIME || count < MIN_ITERATIONS)
+        {
+            spent += kernel();
+            count++;
+        }
+        if(spent > 0)
+        {
+            best = qMax(best, count * 1e9 / spent);
+        }
+    }
+    return best;
+}
+
+bool KernelBenchmark::loadBaseline(const QString &fileName, QMap<QString, qreal> *base)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning() << "读取基准文件失败：" << fileName;
+        return false;
+    }
+    while(!file.atEnd())
+    {
+        QString line = QString::fromUtf8(file.readLine()).trimmed();
+        if(line.isEmpty() || line.startsWith('#')) continue;
+        QStringList fields = line.split(' ', Qt::SkipEmptyParts);
+        if(fields.size() >= 2)
+        {
+            base->insert(fields.at(0), fields.at(1).toDouble());
+        }
+    }
+    return true;
+}
+
+bool KernelBenchmark::saveBaseline(const QString &fileName, const QList<Result> &results)
+{
+    QSaveFile file(fileName);
+    if(fileName.isEmpty() || !file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qWarning() << "写入基准文件失败：" << fileName;
+        return false;
+    }
+    QTextStream out(&file);
+    out << "# 内核基准（每秒次数），与运行的机器有关，需要在参考机器上用--bench-update生成\n";
+    for(const Result& result : results)
+    {
+        out << result.name << ' ' << QString::number(result.rate, 'f', 1) << '\n';
+    }
+    out.flush();
+    return file.commit();
+}
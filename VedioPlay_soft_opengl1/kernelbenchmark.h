@@ -0,0 +1,36 @@
+#ifndef KERNELBENCHMARK_H
+#define KERNELBENCHMARK_H
+
+#include <QList>
+#include <QMap>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+/**
+ * @brief 热点内核的微基准：解码、像素转换（sws_scale）、QImage拷贝/镜像、QPixmap缩放（QPainter版本的显示方式）、
+ *        纹理上传。测试视频由lavfi的testsrc2生成后用mpeg4（单线程、固定量化）编码，内容和码流每次都相同。
+ *        结果与基准文件比较，吞吐量低于基准超过容差时返回非0，可以在部署前的检查中使用
+ */
+class KernelBenchmark
+{
+public:
+    struct Result
+    {
+        QString name;
+        qreal   rate = 0;                       // 每秒处理次数（帧）
+    };
+
+    static int run(const QString& baseline, qreal tolerance, bool update);   // 运行全部内核，update为true时把结果写入基准文件
+    static QString generateClip(const QSize& size, int frames);   // 生成（或复用已生成的）测试视频，失败时返回空
+
+private:
+    static QList<Result> runSize(const QString& label, const QSize& size, int frames, QStringList* skipped);   // skipped返回当前环境不能运行的内核（如没有OpenGL上下文）
+    static qreal measure(const std::function<void()>& kernel);          // 按调用耗时计算
+    static qreal measureTimed(const std::function<qint64()>& kernel);   // 内核自己返回需要计入的耗时（纳秒）
+    static bool loadBaseline(const QString& fileName, QMap<QString, qreal>* base);   // 文件不能读取时返回false
+    static bool saveBaseline(const QString& fileName, const QList<Result>& results);
+};
+
+#endif // KERNELBENCHMARK_H
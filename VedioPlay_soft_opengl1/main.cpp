@@ -1,17 +1,169 @@
 #include "mainwindow.h"
 #include <QDebug>
 #include <QApplication>
+#include <QCommandLineParser>
 #include "videodecoder.h"
+#include "offscreenrenderer.h"
+#include "metricsexporter.h"
+#include "tracer.h"
+#include "kernelbenchmark.h"
+#include "mosaicview.h"
+#include <QFile>
+#include <QtMath>
+
+/**
+ * @brief      多路拼接显示：每一路一个读取线程，所有路的帧总线订阅到同一个MosaicView，只有一个窗口和上下文
+ * @param app
+ * @param list    列表文件，每行一个视频地址，#开头的行忽略
+ * @param grid    "列x行"，为空时按路数排成接近正方形
+ * @param filters 每一路解码后的滤镜，为空时不处理
+ * @return
+ */
+static int runMosaic(QApplication& app, const QString& list, const QString& grid, const QString& filters)
+{
+    QFile file(list);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qWarning() << "打开拼接列表失败：" << list;
+        return 1;
+    }
+    QStringList urls;
+    const QList<QByteArray> lines = file.readAll().split('\n');
+    for(const QByteArray& line : lines)
+    {
+        QString url = QString::fromUtf8(line).trimmed();
+        if(!url.isEmpty() && !url.startsWith('#')) urls.append(url);
+    }
+    if(urls.isEmpty())
+    {
+        qWarning() << "拼接列表中没有视频地址：" << list;
+        return 1;
+    }
+
+    int columns = qCeil(qSqrt(urls.size()));
+    int rows = (urls.size() + columns - 1) / columns;
+    QStringList cr = grid.split('x');
+    if(cr.size() == 2 && cr.at(0).toInt() > 0 && cr.at(1).toInt() > 0)
+    {
+        columns = cr.at(0).toInt();
+        rows = cr.at(1).toInt();
+    }
+
+    MosaicView view;
+    view.setWindowTitle(QString("拼接显示：%1路").arg(urls.size()));
+    view.setGrid(columns, rows);
+    QList<ReadThread*> threads;
+    for(int i = 0; i < urls.size() && i < view.tileCount(); i++)
+    {
+        ReadThread* thread = new ReadThread();
+        thread->setFilter(filters);
+        view.setStream(i, thread->frameBus());
+        thread->open(urls.at(i));
+        threads.append(thread);
+    }
+    view.resize(1280, 720);
+    view.show();
+    int ret = app.exec();
+
+    for(int i = 0; i < threads.size(); i++)
+    {
+        view.setStream(i, nullptr);              // 先取消订阅，帧总线随读取线程释放
+        threads.at(i)->close();
+    }
+    for(ReadThread* thread : threads)
+    {
+        thread->wait();
+        delete thread;
+    }
+    return ret;
+}
+
 int main(int argc, char *argv[])
 {
+    // 无窗口模式、基准测试：没有显示器的机器上默认使用offscreen平台插件（可以用QT_QPA_PLATFORM覆盖）
+    for(int i = 1; i < argc; i++)
+    {
+        bool windowless = qstrcmp(argv[i], "--headless") == 0 || qstrcmp(argv[i], "--bench") == 0;
+        if(windowless && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        {
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        }
+    }
+    QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);   // 所有窗口的上下文共享纹理，局部放大窗口使用来源窗口已经上传的纹理
     QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption headless("headless", "不显示窗口，离屏渲染视频文件并输出每帧耗时", "file");
+    QCommandLineOption size("size", "离屏渲染的输出大小", "WxH", "1280x720");
+    QCommandLineOption frames("frames", "最多渲染的帧数，0为全部", "n", "0");
+    QCommandLineOption checksum("checksum", "输出每帧渲染结果的校验值");
+    QCommandLineOption kernel("kernel", "离屏渲染的缩放滤波器（Bilinear、Bicubic、Lanczos2、Lanczos3），all为逐个比较", "name", "Bilinear");
+    QCommandLineOption metricsPort("metrics-port", "在本机端口上提供Prometheus指标（/metrics）", "port");
+    QCommandLineOption metricsFile("metrics-file", "定时写入Prometheus指标文件（node_exporter textfile collector，*.prom）", "file");
+    QCommandLineOption trace("trace", "记录每一帧各阶段的耗时，退出时写入Chrome trace-event文件（chrome://tracing、Perfetto UI打开）", "file");
+    QCommandLineOption bench("bench", "运行解码、转换、缩放、纹理上传等内核的基准测试，低于基准时返回1");
+    QCommandLineOption benchBaseline("bench-baseline", "基准文件（每行\"名称 每秒次数\"）", "file");
+    QCommandLineOption benchTolerance("bench-tolerance", "允许比基准慢的比例", "ratio", "0.2");
+    QCommandLineOption benchUpdate("bench-update", "把这次的结果写入基准文件");
+    QCommandLineOption mosaic("mosaic", "多路拼接显示，列表文件每行一个视频地址", "file");
+    QCommandLineOption grid("grid", "拼接显示的格子布局，默认按路数排成接近正方形", "CxR");
+    QCommandLineOption filter("filter", "解码后的libavfilter滤镜，与ffmpeg -vf相同（如\"yadif\"、\"crop=640:360:0:0,fps=5\"）", "filters");
+    parser.addOptions({headless, size, frames, checksum, kernel, metricsPort, metricsFile, trace,
+                       bench, benchBaseline, benchTolerance, benchUpdate, mosaic, grid, filter});
+    parser.process(a);
+    if(parser.isSet(bench))
+    {
+        return KernelBenchmark::run(parser.value(benchBaseline), parser.value(benchTolerance).toDouble(), parser.isSet(benchUpdate));
+    }
+    if(parser.isSet(trace))
+    {
+        Tracer::instance()->start();
+    }
+    MetricsExporter exporter;
+    if(parser.isSet(metricsPort))
+    {
+        exporter.listen(quint16(parser.value(metricsPort).toUInt()));
+    }
+    if(parser.isSet(metricsFile))
+    {
+        exporter.setTextFile(parser.value(metricsFile));
+    }
+    if(parser.isSet(headless))
+    {
+        QStringList wh = parser.value(size).split('x');
+        QSize outSize = (wh.size() == 2) ? QSize(wh.at(0).toInt(), wh.at(1).toInt()) : QSize();
+        int ret = OffscreenRenderer::benchmark(parser.value(headless), outSize, parser.value(frames).toInt(), parser.isSet(checksum),
+                                                parser.value(kernel));
+        if(parser.isSet(trace))
+        {
+            Tracer::instance()->stop(parser.value(trace));
+        }
+        return ret;
+    }
+    if(parser.isSet(mosaic))
+    {
+        int ret = runMosaic(a, parser.value(mosaic), parser.value(grid), parser.value(filter));
+        if(parser.isSet(trace))
+        {
+            Tracer::instance()->stop(parser.value(trace));
+        }
+        return ret;
+    }
+
     VideoDecoder decoder;
     if(!decoder.open("C:/Users/18526/Desktop/dd.mp4"))
     {
         qDebug()<<"打开文件失败";
     }
     MainWindow w;
+    w.setFilter(parser.value(filter));
 
     w.show();
-    return a.exec();
+    int ret = a.exec();
+    if(parser.isSet(trace))
+    {
+        Tracer::instance()->stop(parser.value(trace));
+    }
+    return ret;
 }
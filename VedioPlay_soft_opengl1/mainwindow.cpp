@@ -1,6 +1,16 @@
 #include "mainwindow.h"
 #include "./ui_mainwindow.h"
 #include <QFileDialog>
+#include <QLabel>
+#include <QTime>
+#include <QTimer>
+#include "packetrecorder.h"
+#include "thumbnailgenerator.h"
+#include "frameexporter.h"
+#include "motiondetector.h"
+#include "memorybudget.h"
+#include "framepresenter.h"
+#include "standbypool.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -16,13 +26,70 @@ MainWindow::MainWindow(QWidget *parent)
 
     m_readThread = new ReadThread();
     //connect(m_readThread, &ReadThread::updateImage, ui->playimage, &PlayImage::updateImage, Qt::DirectConnection);
-    connect(m_readThread, &ReadThread::updateImage, ui->playimage, &PlayImage::updateImage);
+    m_presenter = new FramePresenter(ui->playimage, this);
+    m_presenter->setFrameBus(m_readThread->frameBus());   // 按显示器刷新节奏显示；其它窗口也可以订阅同一个总线，不需要重复解码
+    m_readThread->setHighBitDepthOutput(true);   // 只有PlayImage订阅，10位视频直接上传16位平面显示
     connect(m_readThread, &ReadThread::playState, this, &MainWindow::on_playState);
+    m_standby = new StandbyPool(this);
+    m_standby->setCapacity(2);                   // 保持前后两个频道（播放列表的下一项）待机
+    m_readThread->setStandbyPool(m_standby);
+    connect(ui->comboBox, QOverload<int>::of(&QComboBox::activated), this, [this](int index) {
+        if(m_readThread->isRunning())
+        {
+            QString text = ui->comboBox->itemText(index);
+            QList<Rendition> renditions = RenditionSelector::parse(text);
+            m_readThread->setRenditions(renditions);   // 多码流的条目设置后立即切换
+            if(renditions.isEmpty())
+            {
+                m_readThread->switchUrl(text);        // 播放中选择其它条目时直接切换
+            }
+        }
+    });
+    connect(m_readThread->recorder(), &PacketRecorder::segmentFinished, this, [this](const QString& fileName) {
+        ui->statusbar->showMessage(QString("录制完成：%1").arg(fileName), 5000);
+    });
+    connect(m_readThread, &ReadThread::recordState, this, [this](bool recording) {
+        ui->recordButton->setText(recording ? "停止录制" : "开始录制");
+    });
+    connect(m_readThread, &ReadThread::reverseFinished, this, [this]() {
+        QSignalBlocker blocker(ui->reverseCheckBox);
+        ui->reverseCheckBox->setChecked(false);
+        ui->pauseButton->setText("继续");
+    });
+    connect(m_readThread, &ReadThread::clipExported, this, [this](const QString& fileName, bool ok) {
+        ui->statusbar->showMessage(QString(ok ? "导出完成：%1" : "导出失败：%1").arg(fileName), 5000);
+    });
+    connect(m_readThread->exporter(), &FrameExporter::frameExported, this, [this](const QString& fileName, bool ok) {
+        ui->statusbar->showMessage(QString(ok ? "保存完成：%1" : "保存失败：%1").arg(fileName), 2000);
+    });
+    connect(m_readThread->exporter(), &FrameExporter::rangeExported, this, [this](int count, bool ok) {
+        ui->statusbar->showMessage(QString(ok ? "导出帧完成，共%1张" : "导出帧中断，已导出%1张").arg(count), 5000);
+    });
+
+    m_thumbnail = new ThumbnailGenerator(this);
+    m_thumbnail->setThumbnailSize(ui->filmStrip->iconSize());
+    connect(m_thumbnail, &ThumbnailGenerator::thumbnailReady, this, &MainWindow::on_thumbnailReady);
+
+    m_motion = new MotionDetector(this);
+    connect(m_motion, &MotionDetector::motionDetected, this, [this](qint64 pts, const QList<QRectF>& regions) {
+        ui->statusbar->showMessage(QString("检测到运动：%1个区域 [%2]").arg(regions.size())
+                                   .arg(QTime::fromMSecsSinceStartOfDay(int(pts)).toString("HH:mm:ss")), 1000);
+    });
 
+    // 状态栏右侧每秒显示一次内存占用，提示中是呈现统计
+    QLabel* memoryLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(memoryLabel);
+    QTimer* memoryTimer = new QTimer(this);
+    connect(memoryTimer, &QTimer::timeout, this, [this, memoryLabel]() {
+        memoryLabel->setText(MemoryBudget::instance()->report());
+        memoryLabel->setToolTip(m_presenter->report());   // 鼠标停留时查看呈现统计
+    });
+    memoryTimer->start(1000);
 
 }
 MainWindow::~MainWindow()
 {
+    m_readThread->removeFrameTap(m_motion);
 
     delete ui;
 }
@@ -30,11 +97,20 @@ MainWindow::~MainWindow()
 
 
 
+void MainWindow::setFilter(const QString &filters)
+{
+    m_readThread->setFilter(filters);
+}
+
 void MainWindow::on_videoPlayButton_clicked()
 {
     if (ui->videoPlayButton->text() == "开始播放")
     {
-        m_readThread->open(ui->comboBox->currentText());
+        m_readThread->setTimeShiftEnabled(ui->timeShiftCheckBox->isChecked());
+        // 条目为"主码流地址 宽x高 | 子码流地址 宽x高"时按窗口大小自动选择码流
+        QList<Rendition> renditions = RenditionSelector::parse(ui->comboBox->currentText());
+        m_readThread->setRenditions(renditions);
+        m_readThread->open(renditions.isEmpty() ? ui->comboBox->currentText() : QString());
     }
     else
     {
@@ -51,6 +127,15 @@ void MainWindow::on_selectButton_clicked()
         return;
     }
     ui->comboBox->setCurrentText(strName);
+
+    // 生成时间轴缩略图
+    const int count = 20;
+    ui->filmStrip->clear();
+    for (int i = 0; i < count; i++)
+    {
+        ui->filmStrip->addItem(new QListWidgetItem(QString::number(i + 1)));
+    }
+    m_thumbnail->generate(strName, count);
 }
 
 
@@ -73,12 +158,173 @@ void MainWindow::on_playState(ReadThread::PlayState state)
     {
         this->setWindowTitle(QString("正在播放：%1").arg(m_readThread->url()));
         ui->videoPlayButton->setText("停止播放");
+        prepareStandby();
     }
     else
     {
         ui->videoPlayButton->setText("开始播放");
         ui->pauseButton->setText("暂停");
+        ui->recordButton->setText("开始录制");
         this->setWindowTitle(QString("Qt+ffmpeg视频播放（软解码）Demo V1"));
     }
 }
 
+/**
+ * @brief 列表作为频道列表和播放列表：下一项、上一项保持待机，本地文件结束后接着播放下一项
+ */
+void MainWindow::prepareStandby()
+{
+    int index = ui->comboBox->findText(m_readThread->url());
+    if(index < 0) return;
+    ui->comboBox->setCurrentIndex(index);
+    int count = ui->comboBox->count();
+    QString next     = (index + 1 < count) ? ui->comboBox->itemText(index + 1) : QString();
+    QString previous = (index > 0) ? ui->comboBox->itemText(index - 1) : QString();
+    m_readThread->setNextUrl(next);
+    m_standby->prepare({next, previous});
+}
+
+void MainWindow::on_recordButton_clicked()
+{
+    if (ui->recordButton->text() == "开始录制")
+    {
+        QString strName = QFileDialog::getSaveFileName(this, "选择录制文件~！", "/", "视频 (*.mp4 *.mkv)");
+        if (strName.isEmpty())
+        {
+            return;
+        }
+        m_readThread->recorder()->setSegmentDuration(10 * 60 * 1000);   // 每10分钟一个文件
+        if(!m_readThread->startRecord(strName))   // 按钮文本在录制实际开始后由recordState更新
+        {
+            ui->statusbar->showMessage("没有正在播放的视频，不能录制", 3000);
+        }
+    }
+    else
+    {
+        m_readThread->stopRecord();
+    }
+}
+
+
+void MainWindow::on_rewindButton_clicked()
+{
+    m_readThread->rewind(10 * 1000);
+}
+
+
+void MainWindow::on_liveButton_clicked()
+{
+    m_readThread->goLive();
+}
+
+
+void MainWindow::on_exportButton_clicked()
+{
+    QString strName = QFileDialog::getSaveFileName(this, "选择导出文件~！", "/", "视频 (*.mp4 *.mkv)");
+    if (strName.isEmpty())
+    {
+        return;
+    }
+    m_readThread->exportClip(strName, 30 * 1000);
+}
+
+
+void MainWindow::on_thumbnailReady(int index, qint64 msec, const QImage &image)
+{
+    QListWidgetItem* item = ui->filmStrip->item(index);
+    if (!item)
+    {
+        return;
+    }
+    item->setIcon(QIcon(QPixmap::fromImage(image)));
+    item->setText(QTime::fromMSecsSinceStartOfDay(int(msec)).toString("HH:mm:ss"));
+    item->setData(Qt::UserRole, msec);
+}
+
+
+void MainWindow::on_filmStrip_itemClicked(QListWidgetItem *item)
+{
+    QVariant msec = item->data(Qt::UserRole);
+    if (msec.isValid())
+    {
+        m_readThread->seek(msec.toLongLong());
+    }
+}
+
+
+void MainWindow::on_stepBackwardButton_clicked()
+{
+    m_readThread->stepBackward();
+}
+
+
+void MainWindow::on_stepForwardButton_clicked()
+{
+    m_readThread->stepForward();
+}
+
+
+void MainWindow::on_reverseCheckBox_toggled(bool checked)
+{
+    m_readThread->setReverse(checked);
+}
+
+
+/**
+ * @brief       切换播放倍速，选项文本为“2x”这种格式
+ * @param index
+ */
+void MainWindow::on_speedComboBox_currentIndexChanged(int index)
+{
+    QString text = ui->speedComboBox->itemText(index);
+    text.chop(1);
+    m_readThread->setSpeed(text.toDouble());
+    m_presenter->setSpeed(text.toDouble());
+}
+
+
+void MainWindow::on_snapshotButton_clicked()
+{
+    QString strName = QFileDialog::getSaveFileName(this, "选择截图文件~！", "/", "图片 (*.png *.jpg *.webp)");
+    if (strName.isEmpty())
+    {
+        return;
+    }
+    m_readThread->snapshot(strName);
+}
+
+
+void MainWindow::on_exportFramesButton_clicked()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, "选择导出目录~！", "/");
+    if (dir.isEmpty())
+    {
+        return;
+    }
+    m_readThread->exportFrames(dir, 5 * 1000);   // 导出当前位置之后5秒内的所有帧
+}
+
+
+void MainWindow::on_motionCheckBox_toggled(bool checked)
+{
+    if (checked)
+    {
+        m_readThread->addFrameTap(m_motion, 5, 320);   // 每秒检测5帧，缩小到320宽度以内
+    }
+    else
+    {
+        m_readThread->removeFrameTap(m_motion);
+    }
+}
+
+void MainWindow::on_deinterlaceCheckBox_toggled(bool checked)
+{
+    PostProcess settings = ui->playimage->postProcess();
+    settings.deinterlace = checked ? PostProcess::DeinterlaceLinear : PostProcess::DeinterlaceNone;
+    ui->playimage->setPostProcess(settings);
+}
+
+void MainWindow::on_scaleComboBox_currentIndexChanged(int index)
+{
+    ui->playimage->setScaleKernel(PlayImage::ScaleKernel(index));   // 条目顺序与ScaleKernel相同
+}
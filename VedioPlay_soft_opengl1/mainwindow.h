@@ -8,7 +8,12 @@ namespace Ui {
 class MainWindow;
 }
 QT_END_NAMESPACE
+class QListWidgetItem;
 class ReadThread;
+class ThumbnailGenerator;
+class MotionDetector;
+class FramePresenter;
+class StandbyPool;
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -17,6 +22,8 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    void setFilter(const QString& filters);      // 解码后的libavfilter滤镜（命令行--filter），为空时关闭
+
 private slots:
 
 
@@ -26,9 +33,45 @@ private slots:
 
     void on_pauseButton_clicked();
 
+    void on_recordButton_clicked();
+
+    void on_rewindButton_clicked();
+
+    void on_liveButton_clicked();
+
+    void on_exportButton_clicked();
+
+    void on_thumbnailReady(int index, qint64 msec, const QImage& image);
+
+    void on_filmStrip_itemClicked(QListWidgetItem* item);
+
+    void on_stepBackwardButton_clicked();
+
+    void on_stepForwardButton_clicked();
+
+    void on_reverseCheckBox_toggled(bool checked);
+    void on_speedComboBox_currentIndexChanged(int index);
+
+    void on_snapshotButton_clicked();
+
+    void on_exportFramesButton_clicked();
+
+    void on_motionCheckBox_toggled(bool checked);
+
+    void on_deinterlaceCheckBox_toggled(bool checked);
+
+    void on_scaleComboBox_currentIndexChanged(int index);
+
+private:
+    void prepareStandby();                      // 按当前播放的条目准备待机会话
+
 private:
     Ui::MainWindow *ui;
     VideoDecoder * decoder;
     ReadThread* m_readThread = nullptr;
+    ThumbnailGenerator* m_thumbnail = nullptr;   // 缩略图生成，用于时间轴预览
+    MotionDetector* m_motion = nullptr;          // 运动检测
+    FramePresenter* m_presenter = nullptr;       // 按刷新节奏显示
+    StandbyPool* m_standby = nullptr;            // 相邻频道、播放列表下一项的待机会话
 };
 #endif // MAINWINDOW_H
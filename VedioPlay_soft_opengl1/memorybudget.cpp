@@ -0,0 +1,106 @@
+#include "memorybudget.h"
+
+MemoryBudget::MemoryBudget()
+{
+}
+
+MemoryBudget *MemoryBudget::instance()
+{
+    static MemoryBudget budget;                   // C++11起局部静态变量初始化是线程安全的
+    return &budget;
+}
+
+void MemoryBudget::setLimit(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_limit = bytes;
+}
+
+qint64 MemoryBudget::limit()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_limit;
+}
+
+int MemoryBudget::createSession()
+{
+    QMutexLocker locker(&m_mutex);
+    int session = m_nextSession++;
+    m_sessions.insert(session, 0);
+    return session;
+}
+
+void MemoryBudget::removeSession(int session)
+{
+    QMutexLocker locker(&m_mutex);
+    m_sessions.remove(session);
+}
+
+/**
+ * @brief          队列放入数据前调用，失败时由调用者丢弃数据或等待
+ * @param session
+ * @param category
+ * @param bytes
+ * @return
+ */
+bool MemoryBudget::reserve(int session, Category category, qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    if(m_total + bytes > m_limit) return false;
+    m_total += bytes;
+    m_categories[category] += bytes;
+    if(session > 0) m_sessions[session] += bytes;
+    return true;
+}
+
+void MemoryBudget::add(int session, Category category, qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_total += bytes;
+    m_categories[category] += bytes;
+    if(session > 0) m_sessions[session] += bytes;
+}
+
+void MemoryBudget::release(int session, Category category, qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_total -= bytes;
+    m_categories[category] -= bytes;
+    if(session > 0 && m_sessions.contains(session)) m_sessions[session] -= bytes;
+}
+
+bool MemoryBudget::isOverBudget()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_total > m_limit;
+}
+
+qint64 MemoryBudget::usage()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_total;
+}
+
+qint64 MemoryBudget::usage(Category category)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_categories[category];
+}
+
+qint64 MemoryBudget::sessionUsage(int session)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_sessions.value(session);
+}
+
+QString MemoryBudget::report()
+{
+    QMutexLocker locker(&m_mutex);
+    const qint64 mb = 1024 * 1024;
+    return QString("内存：%1/%2 MB（数据包%3 帧%4 缓存%5 纹理%6）")
+        .arg(m_total / mb).arg(m_limit / mb)
+        .arg(m_categories[PacketQueue] / mb)
+        .arg(m_categories[FrameQueue] / mb)
+        .arg(m_categories[Cache] / mb)
+        .arg(m_categories[Texture] / mb);
+}
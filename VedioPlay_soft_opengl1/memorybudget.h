@@ -0,0 +1,54 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/**
+ * @brief 进程内存预算：数据包队列、帧队列、缓存、纹理等按类别和播放会话记账，
+ *        队列在超出预算时丢弃或等待（reserve失败），缓存在超出预算时主动淘汰（isOverBudget）。线程安全
+ */
+class MemoryBudget
+{
+public:
+    enum Category           // 记账类别
+    {
+        PacketQueue,        // 录制队列、时移缓冲等压缩数据包
+        FrameQueue,         // 帧总线、截图编码队列等等待处理的帧
+        Cache,              // GOP缓存等解码后的图像缓存
+        Texture,            // GL纹理
+        CategoryCount
+    };
+
+public:
+    static MemoryBudget* instance();
+
+    void   setLimit(qint64 bytes);                // 进程总预算（字节）
+    qint64 limit();
+    int    createSession();                       // 分配一个播放会话编号，0表示不属于任何会话
+    void   removeSession(int session);
+
+    bool reserve(int session, Category category, qint64 bytes);   // 申请内存，超出预算时返回false并且不记账
+    void add(int session, Category category, qint64 bytes);       // 直接记账，不检查预算（缓存先加入再淘汰）
+    void release(int session, Category category, qint64 bytes);   // 释放
+    bool isOverBudget();                          // 是否已经超出预算
+
+    qint64 usage();                               // 总占用
+    qint64 usage(Category category);
+    qint64 sessionUsage(int session);
+    QString report();                             // 各类别占用，用于显示
+
+private:
+    MemoryBudget();
+
+private:
+    QMutex m_mutex;
+    qint64 m_limit = 2048LL * 1024 * 1024;
+    qint64 m_total = 0;
+    qint64 m_categories[CategoryCount] = {};
+    QHash<int, qint64> m_sessions;                // 每个会话的占用
+    int m_nextSession = 1;
+};
+
+#endif // MEMORYBUDGET_H
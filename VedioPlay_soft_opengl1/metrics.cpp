@@ -0,0 +1,181 @@
+#include "metrics.h"
+
+/**
+ * @brief 所有指标在这里注册，名称统一使用vedioplay_前缀
+ */
+Metrics::Metrics()
+{
+    const QVector<double> openBounds   = {0.05, 0.1, 0.25, 0.5, 1, 2, 5, 10};
+    const QVector<double> decodeBounds = {0.001, 0.002, 0.005, 0.01, 0.02, 0.04, 0.1};
+    const QVector<double> presentBounds = {-0.008, -0.004, 0, 0.004, 0.008, 0.017, 0.033, 0.05, 0.1};
+    const QVector<double> commandBounds = {0.001, 0.005, 0.01, 0.02, 0.05, 0.1, 0.25, 0.5, 1};
+    describe("vedioplay_opens_total",           Counter,   "打开次数（包括接管待机会话）");
+    describe("vedioplay_open_failures_total",   Counter,   "打开失败次数");
+    describe("vedioplay_reconnects_total",      Counter,   "同一地址重新打开的次数");
+    describe("vedioplay_standby_opens_total",   Counter,   "接管待机会话的打开次数");
+    describe("vedioplay_rendition_switches_total", Counter, "按显示分辨率切换主、子码流的次数");
+    describe("vedioplay_open_seconds",          Histogram, "从开始打开到可以读取的耗时", openBounds);
+    describe("vedioplay_command_seconds",       Histogram, "暂停、继续、停止等控制命令从发出到读取线程执行的延时", commandBounds);
+    describe("vedioplay_received_bytes_total",  Counter,   "读取的数据包字节数，rate()为码率");
+    describe("vedioplay_decoded_frames_total",  Counter,   "解码输出的帧数，rate()为解码帧率");
+    describe("vedioplay_decode_seconds",        Histogram, "送入数据包到取出一帧的耗时（不包括滤镜）", decodeBounds);
+    describe("vedioplay_scale_seconds",         Histogram, "缩放滤波器（水平、垂直两遍）的GPU耗时", decodeBounds);
+    describe("vedioplay_filter_seconds",        Histogram, "libavfilter滤镜处理一帧的耗时（送入、取出的累计）", decodeBounds);
+    describe("vedioplay_corrupt_packets_total", Counter,   "标记为损坏的数据包（网络丢包）");
+    describe("vedioplay_decode_errors_total",   Counter,   "解码失败或带错误标志的帧");
+    describe("vedioplay_displayed_frames_total", Counter,  "发送显示的帧数，rate()为显示帧率");
+    describe("vedioplay_late_frames_total",     Counter,   "晚于显示时间40ms以上的帧");
+    describe("vedioplay_present_error_seconds", Histogram, "按刷新节奏呈现时实际交换时间与计划显示时间的误差", presentBounds);
+    describe("vedioplay_repeated_refreshes_total", Counter, "帧显示的刷新次数超过帧时长需要的次数（卡顿）");
+    describe("vedioplay_present_skipped_frames_total", Counter, "呈现时没有显示就被更新的帧替换的帧数");
+    describe("vedioplay_dropped_frames_total",  Counter,   "帧总线订阅者丢弃的帧（队列满、超出内存预算、被新帧替换）");
+    describe("vedioplay_frame_queue_depth",     Gauge,     "帧总线订阅者队列中等待处理的帧数");
+    describe("vedioplay_record_queue_depth",    Gauge,     "录制队列中等待写入文件的数据包数");
+    describe("vedioplay_timeshift_packets",     Gauge,     "时移缓冲中缓存的数据包数");
+    describe("vedioplay_timeshift_backlog",     Gauge,     "时移播放时读取位置落后缓冲末尾的数据包数，直播时为0");
+    describe("vedioplay_session_memory_bytes",  Gauge,     "会话的队列和缓存占用的内存");
+    describe("vedioplay_stream_fps",            Gauge,     "视频流标称帧率");
+}
+
+Metrics *Metrics::instance()
+{
+    static Metrics metrics;                       // C++11起局部静态变量初始化是线程安全的
+    return &metrics;
+}
+
+void Metrics::setSessionUrl(int session, const QString &url)
+{
+    QMutexLocker locker(&m_mutex);
+    m_urls.insert(session, url);
+}
+
+/**
+ * @brief         会话结束时删除它的所有序列，不再导出
+ * @param session
+ */
+void Metrics::removeSession(int session)
+{
+    QMutexLocker locker(&m_mutex);
+    m_urls.remove(session);
+    for(Family& family : m_families)
+    {
+        family.series.remove(session);
+    }
+}
+
+void Metrics::add(const char *name, int session, double value)
+{
+    if(session <= 0) return;
+    QMutexLocker locker(&m_mutex);
+    auto it = m_families.find(name);
+    if(it == m_families.end()) return;
+    it->series[session].value += value;
+}
+
+void Metrics::set(const char *name, int session, double value)
+{
+    if(session <= 0) return;
+    QMutexLocker locker(&m_mutex);
+    auto it = m_families.find(name);
+    if(it == m_families.end()) return;
+    it->series[session].value = value;
+}
+
+void Metrics::observe(const char *name, int session, double value)
+{
+    if(session <= 0) return;
+    QMutexLocker locker(&m_mutex);
+    auto it = m_families.find(name);
+    if(it == m_families.end() || it->type != Histogram) return;
+    Series& series = it->series[session];
+    if(series.buckets.isEmpty())
+    {
+        series.buckets.fill(0, it->bounds.size() + 1);   // 最后一个为+Inf
+    }
+    int i = 0;
+    while(i < it->bounds.size() && value > it->bounds.at(i))
+    {
+        i++;
+    }
+    series.buckets[i]++;
+    series.sum += value;
+    series.count++;
+}
+
+/**
+ * @brief  Prometheus文本格式（0.0.4），每个会话带session和url标签，直方图区间输出为累计值
+ * @return
+ */
+QByteArray Metrics::exposition()
+{
+    auto escape = [](QString value) {
+        return value.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+    };
+    auto number = [](double value) {
+        return QByteArray::number(value, 'g', 15);
+    };
+
+    QMutexLocker locker(&m_mutex);
+    QByteArray out;
+    for(auto it = m_families.cbegin(); it != m_families.cend(); ++it)
+    {
+        const QByteArray& name = it.key();
+        const Family& family = it.value();
+        static const char* types[] = {"counter", "gauge", "histogram"};
+        out += "# HELP " + name + ' ' + family.help.toUtf8() + '\n';
+        out += "# TYPE " + name + ' ' + types[family.type] + '\n';
+        for(auto s = family.series.cbegin(); s != family.series.cend(); ++s)
+        {
+            QByteArray labels = QString("session=\"%1\",url=\"%2\"").arg(s.key())
+                                    .arg(escape(m_urls.value(s.key()))).toUtf8();
+            const Series& series = s.value();
+            if(family.type != Histogram)
+            {
+                out += name + '{' + labels + "} " + number(series.value) + '\n';
+                continue;
+            }
+            qint64 cumulative = 0;
+            for(int i = 0; i < series.buckets.size(); i++)
+            {
+                cumulative += series.buckets.at(i);
+                QByteArray le = (i < family.bounds.size()) ? number(family.bounds.at(i)) : QByteArray("+Inf");
+                out += name + "_bucket{" + labels + ",le=\"" + le + "\"} " + QByteArray::number(cumulative) + '\n';
+            }
+            out += name + "_sum{" + labels + "} " + number(series.sum) + '\n';
+            out += name + "_count{" + labels + "} " + QByteArray::number(series.count) + '\n';
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief            按区间统计，只计入上限不超过upperBound的区间；upperBound为无穷大时返回总次数
+ * @param name
+ * @param session
+ * @param upperBound
+ * @return
+ */
+qint64 Metrics::histogramCount(const char *name, int session, double upperBound)
+{
+    QMutexLocker locker(&m_mutex);
+    auto it = m_families.constFind(name);
+    if(it == m_families.constEnd() || it->type != Histogram) return 0;
+    auto series = it->series.constFind(session);
+    if(series == it->series.constEnd()) return 0;
+    if(upperBound == std::numeric_limits<double>::infinity()) return series->count;
+
+    qint64 count = 0;
+    for(int i = 0; i < it->bounds.size() && it->bounds.at(i) <= upperBound; i++)
+    {
+        count += series->buckets.value(i);
+    }
+    return count;
+}
+
+void Metrics::describe(const char *name, Type type, const QString &help, const QVector<double> &bounds)
+{
+    Family& family = m_families[name];
+    family.type = type;
+    family.help = help;
+    family.bounds = bounds;
+}
@@ -0,0 +1,62 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <limits>
+
+/**
+ * @brief 运行指标：计数器、当前值和直方图，按播放会话（与MemoryBudget的会话编号相同）分开统计，
+ *        输出为Prometheus文本格式，由MetricsExporter通过HTTP或文本文件导出。线程安全，会话0不统计
+ */
+class Metrics
+{
+public:
+    enum Type
+    {
+        Counter,            // 只增加的计数，速率（码率、帧率）由Prometheus计算
+        Gauge,              // 当前值（队列深度等）
+        Histogram           // 分布（耗时），单位秒
+    };
+
+public:
+    static Metrics* instance();
+
+    void setSessionUrl(int session, const QString& url);   // 会话的url标签
+    void removeSession(int session);
+    void add(const char* name, int session, double value = 1);        // 计数器增加
+    void set(const char* name, int session, double value);            // 设置当前值（或来源本身累计的计数）
+    void observe(const char* name, int session, double value);        // 直方图记录一次
+    QByteArray exposition();                      // Prometheus文本格式
+    qint64 histogramCount(const char* name, int session,
+                          double upperBound = std::numeric_limits<double>::infinity());   // 直方图中落在upperBound以内的区间的次数（测试使用）
+
+private:
+    Metrics();
+    void describe(const char* name, Type type, const QString& help, const QVector<double>& bounds = QVector<double>());
+
+private:
+    struct Series
+    {
+        double value = 0;                         // 计数器、当前值
+        QVector<qint64> buckets;                  // 直方图每个区间的次数（不累计）
+        double sum = 0;
+        qint64 count = 0;
+    };
+    struct Family
+    {
+        Type type = Counter;
+        QString help;
+        QVector<double> bounds;                   // 直方图区间上限
+        QMap<int, Series> series;                 // 每个会话一条
+    };
+
+    QMutex m_mutex;
+    QMap<QByteArray, Family> m_families;
+    QHash<int, QString> m_urls;
+};
+
+#endif // METRICS_H
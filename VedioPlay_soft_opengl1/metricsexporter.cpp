@@ -0,0 +1,110 @@
+#include "metricsexporter.h"
+#include "metrics.h"
+#include <QDebug>
+#include <QSaveFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#define MAX_REQUEST 8192    // 请求头的最大长度，超过后断开
+
+MetricsExporter::MetricsExporter(QObject *parent) : QObject(parent)
+{
+    connect(&m_timer, &QTimer::timeout, this, &MetricsExporter::writeTextFile);
+}
+
+bool MetricsExporter::listen(quint16 port, const QHostAddress &address)
+{
+    if(!m_server)
+    {
+        m_server = new QTcpServer(this);
+        connect(m_server, &QTcpServer::newConnection, this, &MetricsExporter::onNewConnection);
+    }
+    if(!m_server->listen(address, port))
+    {
+        qWarning() << "指标端口监听失败：" << port << m_server->errorString();
+        return false;
+    }
+    qDebug() << QString("指标地址：http://%1:%2/metrics").arg(address.toString()).arg(port);
+    return true;
+}
+
+/**
+ * @brief          textfile collector要求文件名以.prom结尾，写入临时文件后替换，采集时不会读到一半的文件
+ * @param fileName
+ * @param interval
+ */
+void MetricsExporter::setTextFile(const QString &fileName, int interval)
+{
+    m_fileName = fileName;
+    if(fileName.isEmpty())
+    {
+        m_timer.stop();
+        return;
+    }
+    m_timer.start(qMax(1000, interval));
+    writeTextFile();
+}
+
+bool MetricsExporter::writeTextFile()
+{
+    if(m_fileName.isEmpty()) return false;
+
+    QSaveFile file(m_fileName);
+    if(!file.open(QIODevice::WriteOnly) || file.write(Metrics::instance()->exposition()) < 0 || !file.commit())
+    {
+        qWarning() << "写入指标文件失败：" << m_fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::onNewConnection()
+{
+    while(QTcpSocket* socket = m_server->nextPendingConnection())
+    {
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+/**
+ * @brief        只处理一个请求（Connection: close），收到完整请求头后回复并关闭连接
+ * @param socket
+ */
+void MetricsExporter::onReadyRead(QTcpSocket *socket)
+{
+    QByteArray request = socket->peek(MAX_REQUEST);
+    if(!request.contains("\r\n\r\n") && !request.contains("\n\n"))
+    {
+        if(request.size() >= MAX_REQUEST) socket->abort();
+        return;                                 // 请求头还没有收完
+    }
+    socket->readAll();
+    disconnect(socket, &QTcpSocket::readyRead, this, nullptr);
+
+    QList<QByteArray> line = request.left(request.indexOf('\n')).trimmed().split(' ');
+    QByteArray method = line.value(0);
+    QByteArray path = line.value(1);
+    QByteArray status = "200 OK";
+    QByteArray body;
+    if(method != "GET" && method != "HEAD")
+    {
+        status = "405 Method Not Allowed";
+    }
+    else if(path == "/metrics" || path.startsWith("/metrics?"))
+    {
+        body = Metrics::instance()->exposition();
+    }
+    else
+    {
+        status = "404 Not Found";
+    }
+
+    QByteArray response = "HTTP/1.1 " + status + "\r\n"
+                          "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n";
+    if(method != "HEAD") response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,35 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QTimer>
+
+class QTcpServer;
+class QTcpSocket;
+
+/**
+ * @brief 导出Metrics：本地HTTP端口（GET /metrics，供Prometheus抓取）和/或node_exporter的textfile collector文件（定时原子替换）。
+ *        在主线程中运行
+ */
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsExporter(QObject* parent = nullptr);
+
+    bool listen(quint16 port, const QHostAddress& address = QHostAddress::LocalHost);   // 开启HTTP端口
+    void setTextFile(const QString& fileName, int interval = 15000);    // 定时写入文件（毫秒），文件名为空时停止
+    bool writeTextFile();                       // 立即写入一次
+
+private:
+    void onNewConnection();
+    void onReadyRead(QTcpSocket* socket);
+
+private:
+    QTcpServer* m_server = nullptr;
+    QTimer  m_timer;                            // 定时写入文本文件
+    QString m_fileName;
+};
+
+#endif // METRICSEXPORTER_H
@@ -0,0 +1,389 @@
+#include "mosaicview.h"
+#include "framebus.h"
+#include "memorybudget.h"
+#include "visibilitywatcher.h"
+#include <QDebug>
+#include <QVector2D>
+#include <QtMath>
+
+// 单位四边形，三角形带顺序，y向下（与图像行顺序相同）
+static GLfloat quad[] = {
+    0.0f, 0.0f,     // 左上
+    1.0f, 0.0f,     // 右上
+    0.0f, 1.0f,     // 左下
+    1.0f, 1.0f      // 右下
+};
+
+MosaicView::MosaicView(QWidget *parent, Qt::WindowFlags f)
+    : QOpenGLWidget(parent, f)
+{
+    m_tiles.resize(1);
+    setMinimumSize(400, 300);
+    m_visibility = new VisibilityWatcher(this);
+    connect(m_visibility, &VisibilityWatcher::visibilityChanged, this, [this](bool visible) {
+        for(Tile& tile : m_tiles)
+        {
+            if(tile.subscriber) tile.subscriber->setActive(visible);   // 整个拼接窗口不可见时所有格子停止接收
+        }
+    });
+}
+
+MosaicView::~MosaicView()
+{
+    for(Tile& tile : m_tiles)
+    {
+        unsubscribe(tile);
+        chargeLayer(tile, 0, 0);
+    }
+    MemoryBudget::instance()->release(m_stagingSession, MemoryBudget::Texture, qint64(m_stagingSize.width()) * m_stagingSize.height() * 4);
+    if(!isValid()) return;
+    this->makeCurrent();
+    if(m_texture)
+    {
+        glDeleteTextures(1, &m_texture);
+    }
+    if(m_staging)
+    {
+        glDeleteTextures(1, &m_staging);
+    }
+    glDeleteFramebuffers(1, &m_readFbo);
+    glDeleteFramebuffers(1, &m_drawFbo);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &m_instanceVBO);
+    glDeleteVertexArrays(1, &VAO);
+    this->doneCurrent();
+}
+
+/**
+ * @brief         设置格子布局，按行排列，第tile个格子位于第tile / columns行
+ * @param columns
+ * @param rows
+ */
+void MosaicView::setGrid(int columns, int rows)
+{
+    columns = qMax(1, columns);
+    rows    = qMax(1, rows);
+    if(columns == m_columns && rows == m_rows) return;
+
+    for(int i = columns * rows; i < m_tiles.size(); i++)
+    {
+        unsubscribe(m_tiles[i]);
+        chargeLayer(m_tiles[i], 0, 0);
+    }
+    m_columns = columns;
+    m_rows = rows;
+    m_tiles.resize(columns * rows);
+    m_allocate = true;
+    m_instanceDirty = true;
+    updateDisplaySize();
+    this->update();
+}
+
+void MosaicView::setTileSize(const QSize &size)
+{
+    if(size.isEmpty() || size == m_tileSize) return;
+    m_tileSize = size;
+    m_allocate = true;
+    updateDisplaySize();
+    this->update();
+}
+
+/**
+ * @brief       订阅一路视频的帧总线，多路帧到达时合并为一次重绘。格子的纹理层记在视频源的内存会话下，
+ *              订阅者需要RGBA图像，读取线程对这一路的高位深视频也会转换
+ * @param tile  格子序号
+ * @param bus
+ * @return      格子序号超出范围时返回false
+ */
+bool MosaicView::setStream(int tile, FrameBus *bus)
+{
+    if(tile < 0 || tile >= m_tiles.size()) return false;
+
+    unsubscribe(m_tiles[tile]);
+    chargeLayer(m_tiles[tile], bus ? bus->memorySession() : 0, m_tiles.at(tile).bytes);
+    if(!bus)
+    {
+        updateTile(tile, QImage());
+        return true;
+    }
+    FrameSubscriber* subscriber = bus->subscribe(FrameSubscriber::LatestOnly);
+    subscriber->setImageRequired(true);          // 拼接窗口只能显示RGBA图像
+    subscriber->setActive(m_visibility->isVisible());
+    m_tiles[tile].bus = bus;
+    m_tiles[tile].subscriber = subscriber;
+    updateDisplaySize();
+    connect(subscriber, &FrameSubscriber::frameAvailable, this, [this, tile, subscriber]() {
+        if(tile >= m_tiles.size() || m_tiles.at(tile).subscriber != subscriber) return;   // 已经取消订阅
+        VideoFrame frame;
+        if(subscriber->take(&frame) && !frame.image.isNull())   // 订阅之前已经发布的高位深帧只有解码帧，保留上一帧
+        {
+            updateTile(tile, frame.image);
+        }
+    }, Qt::QueuedConnection);
+    return true;
+}
+
+/**
+ * @brief       更新格子的图像，在下一次重绘时上传，空图像清空格子
+ * @param tile
+ * @param image
+ */
+void MosaicView::updateTile(int tile, const QImage &image)
+{
+    if(tile < 0 || tile >= m_tiles.size()) return;
+
+    Tile& t = m_tiles[tile];
+    t.image = image;
+    t.dirty = !image.isNull();
+    if(image.isNull())
+    {
+        t.uv[0] = t.uv[1] = t.uv[2] = 0;
+        m_instanceDirty = true;
+    }
+    this->update();
+}
+
+int MosaicView::tileCount() const
+{
+    return m_tiles.size();
+}
+
+void MosaicView::initializeGL()
+{
+    initializeOpenGLFunctions();
+
+    m_program = new QOpenGLShaderProgram(this);
+    m_program->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/mosaic.vsh");
+    m_program->addShaderFromSourceFile(QOpenGLShader::Fragment, ":/mosaic.fsh");
+    m_program->link();
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), nullptr);
+    glEnableVertexAttribArray(0);
+
+    // 实例属性，每绘制一个格子前进一次
+    glGenBuffers(1, &m_instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glGenFramebuffers(1, &m_readFbo);
+    glGenFramebuffers(1, &m_drawFbo);
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    m_allocate = true;
+    m_instanceDirty = true;
+}
+
+void MosaicView::resizeGL(int w, int h)
+{
+    Q_UNUSED(w)
+    Q_UNUSED(h)
+    updateDisplaySize();
+}
+
+/**
+ * @brief 上传有变化的格子后，一次实例化绘制所有格子
+ */
+void MosaicView::paintGL()
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    if(m_allocate)
+    {
+        allocateTexture();
+    }
+    if(!m_texture) return;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    for(int i = 0; i < m_tiles.size(); i++)
+    {
+        if(m_tiles.at(i).dirty)
+        {
+            upload(i);
+        }
+    }
+    if(m_instanceDirty)
+    {
+        QVector<GLfloat> data;
+        data.reserve(m_tiles.size() * 3);
+        for(const Tile& tile : qAsConst(m_tiles))
+        {
+            data << tile.uv[0] << tile.uv[1] << tile.uv[2];
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(data.size() * sizeof(GLfloat)), data.constData(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_instanceDirty = false;
+    }
+
+    m_program->bind();
+    glUniform2i(m_program->uniformLocation("grid"), m_columns, m_rows);
+    m_program->setUniformValue("viewSize", QVector2D(float(width()), float(height())));
+    m_program->setUniformValue("tiles", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+
+    glBindVertexArray(VAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(m_tiles.size()));   // 所有格子只需要一次绘制
+    glBindVertexArray(0);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    m_program->release();
+}
+
+/**
+ * @brief 格子的图像缩小到纹理层大小后上传，比纹理层更大的码流不会显示得更清楚
+ */
+void MosaicView::updateDisplaySize()
+{
+    qreal ratio = devicePixelRatioF();
+    QSize cell(qCeil(width() * ratio / m_columns), qCeil(height() * ratio / m_rows));
+    QSize size = cell.boundedTo(m_tileSize);
+    for(Tile& tile : m_tiles)
+    {
+        if(tile.subscriber) tile.subscriber->setDisplaySize(size);
+    }
+}
+
+void MosaicView::chargeLayer(Tile &tile, int session, qint64 bytes)
+{
+    MemoryBudget::instance()->release(tile.session, MemoryBudget::Texture, tile.bytes);
+    MemoryBudget::instance()->add(session, MemoryBudget::Texture, bytes);
+    tile.session = session;
+    tile.bytes = bytes;
+}
+
+void MosaicView::unsubscribe(Tile &tile)
+{
+    if(tile.subscriber)
+    {
+        tile.bus->unsubscribe(tile.subscriber);
+    }
+    tile.bus = nullptr;
+    tile.subscriber = nullptr;
+}
+
+/**
+ * @brief 纹理数组只在布局或层大小变化时重新创建，之后每帧只更新对应的层
+ */
+void MosaicView::allocateTexture()
+{
+    if(m_texture)
+    {
+        glDeleteTextures(1, &m_texture);
+        m_texture = 0;
+    }
+    GLint maxLayers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if(m_tiles.size() > maxLayers)
+    {
+        qWarning() << "格子数超过纹理数组的最大层数：" << m_tiles.size() << maxLayers;
+        m_allocate = false;                      // 布局变化前不再重试
+        return;
+    }
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, m_tileSize.width(), m_tileSize.height(), GLsizei(m_tiles.size()),
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    qint64 bytes = qint64(m_tileSize.width()) * m_tileSize.height() * 4;   // 每一层记在对应格子的视频源下
+    for(Tile& tile : m_tiles)
+    {
+        chargeLayer(tile, tile.session, bytes);
+        tile.dirty = !tile.image.isNull();       // 重新创建后内容丢失，保留的图像重新上传
+    }
+    m_allocate = false;
+    m_instanceDirty = true;
+}
+
+/**
+ * @brief       把图像上传到格子对应的层，超过层大小的图像等比缩小（在GPU中），调用时纹理数组已经绑定
+ * @param index
+ */
+void MosaicView::upload(int index)
+{
+    Tile& tile = m_tiles[index];
+    tile.dirty = false;
+    QImage image = tile.image;
+    if(image.format() != QImage::Format_RGBA8888)
+    {
+        image = image.convertToFormat(QImage::Format_RGBA8888);
+    }
+
+    QSize size = image.size();
+    if(size.width() > m_tileSize.width() || size.height() > m_tileSize.height())
+    {
+        size = size.scaled(m_tileSize, Qt::KeepAspectRatio);
+        uploadScaled(index, image, size);
+    }
+    else
+    {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, image.bytesPerLine() / 4);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, index, image.width(), image.height(), 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+
+    tile.uv[0] = GLfloat(size.width()) / m_tileSize.width();
+    tile.uv[1] = GLfloat(size.height()) / m_tileSize.height();
+    tile.uv[2] = GLfloat(tile.image.width()) / tile.image.height();
+    m_instanceDirty = true;
+}
+
+/**
+ * @brief       原图上传到中转纹理，再用glBlitFramebuffer线性缩小到格子的层，不占用界面线程的CPU缩放时间；
+ *              中转纹理所有格子共用，只在图像大小变化时重新创建
+ * @param index
+ * @param image RGBA8888
+ * @param size  缩小后的大小
+ */
+void MosaicView::uploadScaled(int index, const QImage &image, const QSize &size)
+{
+    if(!m_staging)
+    {
+        glGenTextures(1, &m_staging);
+    }
+    glBindTexture(GL_TEXTURE_2D, m_staging);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image.bytesPerLine() / 4);
+    if(image.size() != m_stagingSize)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width(), image.height(), 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+        MemoryBudget::instance()->release(m_stagingSession, MemoryBudget::Texture, qint64(m_stagingSize.width()) * m_stagingSize.height() * 4);
+        m_stagingSession = m_tiles.at(index).session;
+        MemoryBudget::instance()->add(m_stagingSession, MemoryBudget::Texture, qint64(image.width()) * image.height() * 4);
+        m_stagingSize = image.size();
+    }
+    else
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width(), image.height(),
+                        GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFbo);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_staging, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_drawFbo);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_texture, 0, index);
+    glBlitFramebuffer(0, 0, image.width(), image.height(), 0, 0, size.width(), size.height(),
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);   // 行顺序相同，不需要翻转
+    glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+}
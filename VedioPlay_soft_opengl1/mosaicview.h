@@ -0,0 +1,75 @@
+#ifndef MOSAICVIEW_H
+#define MOSAICVIEW_H
+
+#include <QOpenGLWidget>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QImage>
+#include <QVector>
+
+class FrameBus;
+class FrameSubscriber;
+class VisibilityWatcher;
+
+/**
+ * @brief 多路视频拼接显示：一个窗口、一个上下文显示rows x columns路视频（如6x6监控墙）。
+ *        每一路图像更新到纹理数组的一层，所有格子用一次实例化绘制完成，格子位置和等比缩放在顶点着色器中计算，
+ *        避免每路一个QOpenGLWidget带来的上下文切换和合成开销
+ */
+class MosaicView : public QOpenGLWidget, public QOpenGLFunctions_3_3_Core
+{
+    Q_OBJECT
+public:
+    explicit MosaicView(QWidget* parent = nullptr, Qt::WindowFlags f = Qt::WindowFlags());
+    ~MosaicView() override;
+
+    void setGrid(int columns, int rows);        // 格子布局，超出范围的视频源自动取消订阅
+    void setTileSize(const QSize& size);        // 纹理数组每层的大小，更大的图像上传后在GPU中缩小到层里
+    bool setStream(int tile, FrameBus* bus);    // 指定格子显示的视频源（只显示最新一帧），为空时清空格子
+    void updateTile(int tile, const QImage& image);   // 直接更新一个格子的图像
+    int  tileCount() const;
+
+protected:
+    void initializeGL() override;
+    void resizeGL(int w, int h) override;
+    void paintGL() override;
+
+private:
+    struct Tile
+    {
+        FrameBus* bus = nullptr;
+        FrameSubscriber* subscriber = nullptr;
+        QImage image;                           // 等待上传的图像
+        bool   dirty = false;                   // 图像需要上传到纹理
+        GLfloat uv[3] = {0, 0, 0};              // 实例属性：图像在纹理层中的宽、高比例，图像宽高比
+        int    session = 0;                     // 纹理层记账的会话（视频源的内存会话），没有视频源时为0
+        qint64 bytes = 0;                       // 纹理层记账的显存大小
+    };
+    void unsubscribe(Tile& tile);
+    void chargeLayer(Tile& tile, int session, qint64 bytes);   // 纹理层的记账移到session下
+    void updateDisplaySize();                   // 按格子的物理像素（不超过纹理层大小）通知订阅者需要的分辨率
+    void allocateTexture();                     // 按格子数、层大小重新创建纹理数组
+    void upload(int index);                     // 上传一个格子的图像
+    void uploadScaled(int index, const QImage& image, const QSize& size);   // 上传到中转纹理后缩小复制到格子的层
+
+private:
+    QOpenGLShaderProgram* m_program = nullptr;
+    GLuint m_texture = 0;                       // GL_TEXTURE_2D_ARRAY，每个格子一层
+    GLuint VAO = 0;
+    GLuint VBO = 0;                             // 单位四边形
+    GLuint m_instanceVBO = 0;                   // 每个格子的实例属性
+    QVector<Tile> m_tiles;
+    VisibilityWatcher* m_visibility = nullptr;  // 不可见时订阅者停止接收帧
+    int    m_columns = 1;
+    int    m_rows = 1;
+    QSize  m_tileSize = QSize(640, 360);
+    bool   m_allocate = true;                   // 纹理数组需要重新创建
+    bool   m_instanceDirty = true;              // 实例属性需要重新上传
+    GLuint m_staging = 0;                       // 超过层大小的图像先上传到这个纹理
+    QSize  m_stagingSize;
+    int    m_stagingSession = 0;                // 中转纹理记在最后重新创建它的格子的视频源下
+    GLuint m_readFbo = 0;                       // 缩小复制时读、写的帧缓冲
+    GLuint m_drawFbo = 0;
+};
+
+#endif // MOSAICVIEW_H
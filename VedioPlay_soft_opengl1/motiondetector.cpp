@@ -0,0 +1,166 @@
+#include "motiondetector.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define USE_SSE2 0
+#endif
+
+#define BLOCK_SIZE 16       // 块大小，与SSE2寄存器宽度（16字节）相同
+#define MAX_GAP    2000     // 两次检测间隔超过这个时间（毫秒）或时间倒退时认为发生了跳转，只更新参考帧
+
+MotionDetector::MotionDetector(QObject *parent) : QObject(parent)
+{
+}
+
+void MotionDetector::setThreshold(int threshold)
+{
+    m_threshold.storeRelease(qBound(0, threshold, 255));
+}
+
+void MotionDetector::setMinBlocks(int count)
+{
+    m_minBlocks.storeRelease(qMax(1, count));
+}
+
+/**
+ * @brief        与上一帧比较，尺寸变化或跳转后只保存为参考帧
+ * @param gray
+ * @param width
+ * @param height
+ * @param stride
+ * @param pts
+ */
+void MotionDetector::process(const uchar *gray, int width, int height, int stride, qint64 pts)
+{
+    int columns = width / BLOCK_SIZE;
+    int rows    = height / BLOCK_SIZE;
+    bool compare = width == m_width && height == m_height && m_lastPts >= 0
+                   && pts > m_lastPts && pts - m_lastPts < MAX_GAP;
+    if(compare && columns > 0 && rows > 0)
+    {
+        const int limit = m_threshold.loadAcquire() * BLOCK_SIZE * BLOCK_SIZE;
+        const uchar* previous = reinterpret_cast<const uchar*>(m_previous.constData());
+        m_blocks.fill(0, columns * rows);
+        bool motion = false;
+        for(int y = 0; y < rows; y++)
+        {
+            for(int x = 0; x < columns; x++)
+            {
+                int offset = y * BLOCK_SIZE;
+                int sad = blockSad(gray + offset * stride + x * BLOCK_SIZE, stride,
+                                   previous + offset * width + x * BLOCK_SIZE, width);
+                if(sad > limit)
+                {
+                    m_blocks[y * columns + x] = 1;
+                    motion = true;
+                }
+            }
+        }
+        if(motion)
+        {
+            QList<QRectF> list = regions(columns, rows);
+            if(!list.isEmpty())
+            {
+                emit motionDetected(pts, list);
+            }
+        }
+    }
+
+    // 保存为下一次比较的参考帧
+    m_width   = width;
+    m_height  = height;
+    m_lastPts = pts;
+    m_previous.resize(width * height);
+    uchar* dst = reinterpret_cast<uchar*>(m_previous.data());
+    for(int y = 0; y < height; y++)
+    {
+        memcpy(dst + y * width, gray + y * stride, size_t(width));
+    }
+}
+
+/**
+ * @brief         计算16x16块的绝对差之和，SSE2每行一条psadbw指令
+ * @param a
+ * @param strideA
+ * @param b
+ * @param strideB
+ * @return
+ */
+int MotionDetector::blockSad(const uchar *a, int strideA, const uchar *b, int strideB)
+{
+#if USE_SSE2
+    __m128i sum = _mm_setzero_si128();
+    for(int i = 0; i < BLOCK_SIZE; i++)
+    {
+        __m128i rowA = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i * strideA));
+        __m128i rowB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i * strideB));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(rowA, rowB));   // 得到高、低8字节各自的差值和
+    }
+    return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+#else
+    int sum = 0;
+    for(int i = 0; i < BLOCK_SIZE; i++)
+    {
+        for(int j = 0; j < BLOCK_SIZE; j++)
+        {
+            sum += abs(int(a[i * strideA + j]) - int(b[i * strideB + j]));
+        }
+    }
+    return sum;
+#endif
+}
+
+/**
+ * @brief         四连通合并运动块，返回每个区域的外接矩形，块数少于m_minBlocks的区域忽略，
+ *                调用时m_width、m_height与当前帧相同
+ * @param columns 每行块数
+ * @param rows    每列块数
+ * @return        相对图像的比例坐标
+ */
+QList<QRectF> MotionDetector::regions(int columns, int rows)
+{
+    QList<QRectF> list;
+    const int minBlocks = m_minBlocks.loadAcquire();
+    QVector<int> stack;
+    for(int start = 0; start < m_blocks.size(); start++)
+    {
+        if(m_blocks.at(start) != 1) continue;
+
+        int left = columns, top = rows, right = -1, bottom = -1, count = 0;
+        stack.append(start);
+        m_blocks[start] = 2;                       // 已经访问
+        while(!stack.isEmpty())
+        {
+            int index = stack.takeLast();
+            int x = index % columns;
+            int y = index / columns;
+            left   = qMin(left, x);
+            right  = qMax(right, x);
+            top    = qMin(top, y);
+            bottom = qMax(bottom, y);
+            count++;
+
+            const int neighbors[4][2] = {{x - 1, y}, {x + 1, y}, {x, y - 1}, {x, y + 1}};
+            for(const auto& n : neighbors)
+            {
+                if(n[0] < 0 || n[0] >= columns || n[1] < 0 || n[1] >= rows) continue;
+                int next = n[1] * columns + n[0];
+                if(m_blocks.at(next) == 1)
+                {
+                    m_blocks[next] = 2;
+                    stack.append(next);
+                }
+            }
+        }
+        if(count < minBlocks) continue;
+        list.append(QRectF(qreal(left * BLOCK_SIZE) / m_width, qreal(top * BLOCK_SIZE) / m_height,
+                           qreal((right - left + 1) * BLOCK_SIZE) / m_width,
+                           qreal((bottom - top + 1) * BLOCK_SIZE) / m_height));
+    }
+    return list;
+}
@@ -0,0 +1,42 @@
+#ifndef MOTIONDETECTOR_H
+#define MOTIONDETECTOR_H
+
+#include "frametap.h"
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QRectF>
+#include <QVector>
+
+/**
+ * @brief 运动检测：把灰度图分成16x16的块，与上一帧逐块计算绝对差之和（SSE2 _mm_sad_epu8），
+ *        平均差超过阈值的块标记为运动，相邻的运动块合并为一个区域
+ */
+class MotionDetector : public QObject, public FrameTap
+{
+    Q_OBJECT
+public:
+    explicit MotionDetector(QObject *parent = nullptr);
+
+    void setThreshold(int threshold);             // 块内每个像素平均亮度差阈值（0~255）
+    void setMinBlocks(int count);                 // 区域最少包含的块数，过滤噪点
+    void process(const uchar* gray, int width, int height, int stride, qint64 pts) override;
+
+signals:
+    void motionDetected(qint64 pts, const QList<QRectF>& regions);   // 检测到运动（在解码线程中触发），区域为相对图像的比例（0~1）
+
+private:
+    static int blockSad(const uchar* a, int strideA, const uchar* b, int strideB);   // 16x16块的绝对差之和
+    QList<QRectF> regions(int columns, int rows); // 合并相邻的运动块
+
+private:
+    QByteArray m_previous;                        // 上一帧灰度图（紧密排列）
+    int m_width  = 0;
+    int m_height = 0;
+    qint64 m_lastPts = -1;
+    QVector<uchar> m_blocks;                      // 每个块是否运动
+    QAtomicInt m_threshold = 12;
+    QAtomicInt m_minBlocks = 2;
+};
+
+#endif // MOTIONDETECTOR_H
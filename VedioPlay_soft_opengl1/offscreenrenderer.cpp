@@ -0,0 +1,267 @@
+#include "offscreenrenderer.h"
+#include "videodecoder.h"
+#include <QOpenGLFunctions>
+#include <QCryptographicHash>
+#include <QTextStream>
+#include <QDebug>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavutil/frame.h>
+}
+
+OffscreenRenderer::OffscreenRenderer()
+{
+}
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+    if(!m_context.isValid()) return;
+    m_context.makeCurrent(&m_surface);
+    m_renderer.destroy();
+    delete m_target;
+    m_context.doneCurrent();
+}
+
+/**
+ * @brief      创建3.3核心模式的上下文（与QOpenGLWidget中使用的着色器版本相同）和输出帧缓冲
+ * @param size 输出大小，相当于窗口大小
+ * @return
+ */
+bool OffscreenRenderer::create(const QSize &size)
+{
+    if(size.isEmpty()) return false;
+
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    m_context.setFormat(format);
+    if(!m_context.create())
+    {
+        qWarning() << "创建OpenGL上下文失败";
+        return false;
+    }
+    m_surface.setFormat(m_context.format());
+    m_surface.create();
+    if(!m_context.makeCurrent(&m_surface))
+    {
+        qWarning() << "离屏surface不可用";
+        return false;
+    }
+    qDebug() << "离屏渲染：" << reinterpret_cast<const char*>(m_context.functions()->glGetString(GL_RENDERER));
+
+    m_target = new QOpenGLFramebufferObject(size);
+    bool ok = m_renderer.initialize();
+    m_renderer.setViewport(size);
+    m_context.doneCurrent();
+    if(!ok)
+    {
+        qWarning() << "着色器初始化失败";
+    }
+    return ok;
+}
+
+VideoRenderer *OffscreenRenderer::renderer()
+{
+    return &m_renderer;
+}
+
+void OffscreenRenderer::setChecksumEnabled(bool enabled)
+{
+    m_checksumEnabled = enabled;
+    if(!enabled)
+    {
+        m_checksum.clear();
+    }
+}
+
+bool OffscreenRenderer::render(const QImage &image)
+{
+    if(image.isNull()) return false;
+    m_renderer.setImage(image);
+    return draw();
+}
+
+bool OffscreenRenderer::render(const QSharedPointer<AVFrame> &frame)
+{
+    if(!frame) return false;
+    m_renderer.setFrame(frame);
+    return draw();
+}
+
+OffscreenRenderer::Timing OffscreenRenderer::lastTiming() const
+{
+    return m_last;
+}
+
+QByteArray OffscreenRenderer::checksum() const
+{
+    return m_checksum;
+}
+
+QImage OffscreenRenderer::grab()
+{
+    if(!m_target || !m_context.makeCurrent(&m_surface)) return QImage();
+    QImage image = m_target->toImage();
+    m_context.doneCurrent();
+    return image;
+}
+
+/**
+ * @brief  平均值和最大值，单位毫秒
+ * @return
+ */
+QString OffscreenRenderer::report() const
+{
+    if(m_frames <= 0) return QString("没有渲染任何帧");
+    auto ms = [](qint64 ns) { return QString::number(qreal(ns) / 1000000, 'f', 3); };
+    return QString("%1帧 上传 平均%2 ms 最大%3 ms，绘制 平均%4 ms 最大%5 ms，读回 平均%6 ms 最大%7 ms")
+        .arg(m_frames)
+        .arg(ms(m_total.upload / m_frames)).arg(ms(m_max.upload))
+        .arg(ms(m_total.draw / m_frames)).arg(ms(m_max.draw))
+        .arg(ms(m_total.readBack / m_frames)).arg(ms(m_max.readBack));
+}
+
+/**
+ * @brief  上传、绘制（包括后处理和缩放）、读回分开计时，每一步之后glFinish，
+ *         耗时包括驱动排队和GPU执行（llvmpipe上就是CPU时间）
+ * @return
+ */
+bool OffscreenRenderer::draw()
+{
+    if(!m_target || !m_context.makeCurrent(&m_surface)) return false;
+    QOpenGLFunctions* f = m_context.functions();
+
+    m_timer.start();
+    m_renderer.upload();
+    f->glFinish();
+    m_last.upload = m_timer.nsecsElapsed();
+
+    m_timer.start();
+    m_renderer.render(m_target->handle());
+    f->glFinish();
+    m_last.draw = m_timer.nsecsElapsed();
+
+    m_last.readBack = 0;
+    if(m_checksumEnabled)
+    {
+        m_timer.start();
+        QByteArray pixels(m_target->width() * m_target->height() * 4, Qt::Uninitialized);
+        m_target->bind();
+        f->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        f->glReadPixels(0, 0, m_target->width(), m_target->height(), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        m_target->release();
+        m_checksum = QCryptographicHash::hash(pixels, QCryptographicHash::Md5).toHex();
+        m_last.readBack = m_timer.nsecsElapsed();
+    }
+    m_context.doneCurrent();
+
+    m_frames++;
+    m_total.upload   += m_last.upload;
+    m_total.draw     += m_last.draw;
+    m_total.readBack += m_last.readBack;
+    m_max.upload   = qMax(m_max.upload, m_last.upload);
+    m_max.draw     = qMax(m_max.draw, m_last.draw);
+    m_max.readBack = qMax(m_max.readBack, m_last.readBack);
+    return true;
+}
+
+/**
+ * @brief          解码文件，每一帧按播放时相同的方式（高位深帧直接上传平面，其它转换为RGBA）离屏渲染，
+ *                 每帧输出一行"序号 时间戳 上传 绘制 [校验值]"到标准输出，校验值可以与基准文件比较做回归测试
+ * @param url
+ * @param size     输出大小
+ * @param frames   最多渲染的帧数，<=0时渲染到文件结束
+ * @param checksum 是否计算每帧输出的校验值
+ * @param kernel   缩放滤波器名称（Bilinear、Bicubic、Lanczos2、Lanczos3），"all"时每种滤波器各渲染一遍，为空时使用双线性
+ * @return         进程退出码
+ */
+int OffscreenRenderer::benchmark(const QString &url, const QSize &size, int frames, bool checksum, const QString &kernel)
+{
+    QList<VideoRenderer::ScaleKernel> kernels;
+    if(kernel.compare("all", Qt::CaseInsensitive) == 0)
+    {
+        for(int i = 0; i <= VideoRenderer::ScaleLanczos3; i++)
+        {
+            kernels.append(VideoRenderer::ScaleKernel(i));
+        }
+    }
+    else
+    {
+        int index = kernel.isEmpty() ? VideoRenderer::ScaleBilinear : VideoRenderer::scaleKernelFromName(kernel);
+        if(index < 0)
+        {
+            qWarning() << "不支持的缩放滤波器：" << kernel;
+            return 1;
+        }
+        kernels.append(VideoRenderer::ScaleKernel(index));
+    }
+
+    for(VideoRenderer::ScaleKernel k : qAsConst(kernels))
+    {
+        if(!benchmarkKernel(url, size, frames, checksum, k)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief          每种滤波器重新打开文件，各自从第一帧开始渲染相同的帧，统计行带滤波器名称和缩放的GPU耗时
+ * @param url
+ * @param size
+ * @param frames
+ * @param checksum
+ * @param kernel
+ * @return         至少渲染了一帧时返回true
+ */
+bool OffscreenRenderer::benchmarkKernel(const QString &url, const QSize &size, int frames, bool checksum,
+                                        VideoRenderer::ScaleKernel kernel)
+{
+    VideoDecoder decoder;
+    if(!decoder.open(url))
+    {
+        qWarning() << "打开文件失败：" << url;
+        return false;
+    }
+    OffscreenRenderer renderer;
+    if(!renderer.create(size)) return false;
+    renderer.setChecksumEnabled(checksum);
+    renderer.renderer()->setScaleKernel(kernel);
+
+    QTextStream out(stdout);
+    int count = 0;
+    while(frames <= 0 || count < frames)
+    {
+        const AVFrame* decoded = decoder.readFrame();
+        if(!decoded)
+        {
+            if(decoder.isEnd()) break;
+            continue;
+        }
+        bool ok = false;
+        if(VideoDecoder::isHighBitDepth(decoded))
+        {
+            AVFrame* ref = av_frame_clone(decoded);
+            ok = ref && renderer.render(QSharedPointer<AVFrame>(ref, [](AVFrame* f) { av_frame_free(&f); }));
+        }
+        else
+        {
+            ok = renderer.render(decoder.convert());
+        }
+        if(!ok) continue;
+
+        Timing t = renderer.lastTiming();
+        out << count << ' ' << decoder.pts()
+            << ' ' << QString::number(qreal(t.upload) / 1000000, 'f', 3)
+            << ' ' << QString::number(qreal(t.draw) / 1000000, 'f', 3);
+        if(checksum)
+        {
+            out << ' ' << renderer.checksum();
+        }
+        out << Qt::endl;
+        count++;
+    }
+    qreal scale = renderer.renderer()->scaleTime();
+    out << '[' << VideoRenderer::scaleKernelName(kernel) << "] " << renderer.report()
+        << QString("，缩放GPU 平均%1").arg(scale < 0 ? QString("不支持计时") : QString::number(scale, 'f', 3) + " ms")
+        << Qt::endl;
+    return count > 0;
+}
@@ -0,0 +1,63 @@
+#ifndef OFFSCREENRENDERER_H
+#define OFFSCREENRENDERER_H
+
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
+#include <QElapsedTimer>
+#include <QSharedPointer>
+#include "videorenderer.h"
+
+struct AVFrame;
+
+/**
+ * @brief 无窗口渲染：QOffscreenSurface + 帧缓冲，使用与PlayImage相同的VideoRenderer上传、绘制，
+ *        用于在没有显示器的机器（如Mesa llvmpipe）上测试渲染耗时和结果。
+ *        QOffscreenSurface必须在GUI线程中创建，之后的渲染也在同一个线程中执行
+ */
+class OffscreenRenderer
+{
+public:
+    struct Timing           // 单帧耗时（纳秒），每一步之后glFinish等待GPU完成
+    {
+        qint64 upload   = 0;
+        qint64 draw     = 0;
+        qint64 readBack = 0;    // 没有计算校验值时为0
+    };
+
+    OffscreenRenderer();
+    ~OffscreenRenderer();
+
+    bool create(const QSize& size);             // 创建上下文和输出帧缓冲
+    VideoRenderer* renderer();                  // 设置后处理、缩放滤波器
+    void setChecksumEnabled(bool enabled);      // 每帧绘制后读回输出计算校验值
+    bool render(const QImage& image);
+    bool render(const QSharedPointer<AVFrame>& frame);
+    Timing lastTiming() const;
+    QByteArray checksum() const;                // 最后一帧输出的MD5（十六进制），未启用时为空
+    QImage grab();                              // 读回最后一帧输出
+    QString report() const;                     // 各步骤的平均、最大耗时
+
+    static int benchmark(const QString& url, const QSize& size, int frames, bool checksum,
+                         const QString& kernel = QString());   // 解码文件逐帧渲染，打印每帧结果和统计
+
+private:
+    bool draw();
+    static bool benchmarkKernel(const QString& url, const QSize& size, int frames, bool checksum,
+                                VideoRenderer::ScaleKernel kernel);   // 用一种缩放滤波器渲染一遍
+
+private:
+    QOpenGLContext    m_context;
+    QOffscreenSurface m_surface;
+    QOpenGLFramebufferObject* m_target = nullptr;
+    VideoRenderer m_renderer;
+    bool m_checksumEnabled = false;
+    QByteArray m_checksum;
+    QElapsedTimer m_timer;
+    Timing m_last;
+    Timing m_total;
+    Timing m_max;
+    int    m_frames = 0;
+};
+
+#endif // OFFSCREENRENDERER_H
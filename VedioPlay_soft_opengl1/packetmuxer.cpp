@@ -0,0 +1,274 @@
+#include "packetmuxer.h"
+#include <QDebug>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+}
+
+#define ERROR_LEN 1024  // 异常信息数组长度
+#define PRINT_LOG 1
+
+PacketMuxer::PacketMuxer()
+{
+}
+
+PacketMuxer::~PacketMuxer()
+{
+    close();
+    clearInput();
+}
+
+/**
+ * @brief             拷贝需要封装的输入流参数，拷贝后和输入的解封装上下文再无关系，可以在其它线程使用
+ * @param input       输入解封装上下文
+ * @param videoIndex  视频流索引，小于0表示不录制视频
+ * @param audioIndex  音频流索引，小于0表示不录制音频
+ * @return
+ */
+bool PacketMuxer::setInput(const AVFormatContext* input, int videoIndex, int audioIndex)
+{
+    clearInput();
+    if(!input) return false;
+
+    const int indexs[] = {videoIndex, audioIndex};
+    for(int index : indexs)
+    {
+        if(index < 0 || index >= int(input->nb_streams)) continue;
+
+        const AVStream* stream = input->streams[index];
+        StreamInfo info;
+        info.inputIndex  = index;
+        info.timeBaseNum = stream->time_base.num;
+        info.timeBaseDen = stream->time_base.den;
+        info.parameters  = avcodec_parameters_alloc();
+        if(!info.parameters || avcodec_parameters_copy(info.parameters, stream->codecpar) < 0)
+        {
+            avcodec_parameters_free(&info.parameters);
+            continue;
+        }
+        m_streams.append(info);
+    }
+    m_videoIndex = (videoIndex >= 0 && hasInput(videoIndex)) ? videoIndex : -1;
+    return !m_streams.isEmpty();
+}
+
+bool PacketMuxer::copyInput(const PacketMuxer& other)
+{
+    clearInput();
+    for(const StreamInfo& src : other.m_streams)
+    {
+        StreamInfo info = src;
+        info.outputIndex = -1;
+        info.parameters = avcodec_parameters_alloc();
+        if(!info.parameters || avcodec_parameters_copy(info.parameters, src.parameters) < 0)
+        {
+            avcodec_parameters_free(&info.parameters);
+            continue;
+        }
+        m_streams.append(info);
+    }
+    m_videoIndex = other.m_videoIndex;
+    return !m_streams.isEmpty();
+}
+
+bool PacketMuxer::hasInput(int streamIndex) const
+{
+    for(const StreamInfo& info : m_streams)
+    {
+        if(info.inputIndex == streamIndex) return true;
+    }
+    return false;
+}
+
+int PacketMuxer::videoIndex() const
+{
+    return m_videoIndex;
+}
+
+/**
+ * @brief          创建输出文件并写入文件头，封装格式由文件后缀决定（.mp4、.mkv等）
+ * @param fileName
+ * @return
+ */
+bool PacketMuxer::open(const QString& fileName)
+{
+    close();
+    if(m_streams.isEmpty()) return false;
+
+    QByteArray name = fileName.toUtf8();
+    int ret = avformat_alloc_output_context2(&m_formatContext, nullptr, nullptr, name.constData());
+    if(ret < 0 || !m_formatContext)
+    {
+        showError(ret);
+        m_formatContext = nullptr;
+        return false;
+    }
+
+    for(StreamInfo& info : m_streams)
+    {
+        AVStream* stream = avformat_new_stream(m_formatContext, nullptr);
+        if(!stream)
+        {
+            close();
+            return false;
+        }
+        avcodec_parameters_copy(stream->codecpar, info.parameters);
+        stream->codecpar->codec_tag = 0;             // 不同封装格式的codec_tag不通用，交给封装器自己选择
+        stream->time_base = AVRational{info.timeBaseNum, info.timeBaseDen};   // 只是建议值，写文件头时封装器可能修改
+        info.outputIndex = stream->index;
+    }
+
+    if(!(m_formatContext->oformat->flags & AVFMT_NOFILE))
+    {
+        ret = avio_open(&m_formatContext->pb, name.constData(), AVIO_FLAG_WRITE);
+        if(ret < 0)
+        {
+            showError(ret);
+            close();
+            return false;
+        }
+    }
+    ret = avformat_write_header(m_formatContext, nullptr);
+    if(ret < 0)
+    {
+        showError(ret);
+        close();
+        return false;
+    }
+    m_header = true;
+    if(!m_packet)
+    {
+        m_packet = av_packet_alloc();
+    }
+    m_fileName  = fileName;
+    m_started   = false;
+    m_startTime = 0;
+    m_lastTime  = 0;
+    m_bytes     = 0;
+    return true;
+}
+
+/**
+ * @brief         写入一个数据包，packet本身不会被修改
+ * @param packet  stream_index为输入流索引，时间戳为输入流时间基
+ * @return
+ */
+bool PacketMuxer::write(const AVPacket* packet)
+{
+    if(!m_formatContext || !m_packet || !packet) return false;
+
+    const StreamInfo* info = nullptr;
+    for(const StreamInfo& i : m_streams)
+    {
+        if(i.inputIndex == packet->stream_index)
+        {
+            info = &i;
+            break;
+        }
+    }
+    if(!info) return false;
+
+    // 没有时间戳的数据包封装器无法处理（网络流刚开始时可能出现），直接丢弃
+    qint64 ts = (packet->dts != AV_NOPTS_VALUE) ? packet->dts : packet->pts;
+    if(ts == AV_NOPTS_VALUE) return false;
+
+    AVRational timeBase   = {info->timeBaseNum, info->timeBaseDen};
+    AVRational timeBaseUs = {1, AV_TIME_BASE};     // AV_TIME_BASE_Q是C语言复合字面量，MSVC下无法编译
+    qint64 time = av_rescale_q(ts, timeBase, timeBaseUs);
+    if(!m_started)
+    {
+        m_startTime = time;
+        m_started = true;
+    }
+    if(time < m_startTime) return false;       // 第一帧之前的数据（比如开始录制前的音频）丢弃，否则会出现负时间戳
+
+    int ret = av_packet_ref(m_packet, packet);  // 只增加引用计数，不拷贝数据
+    if(ret < 0)
+    {
+        showError(ret);
+        return false;
+    }
+    qint64 offset = av_rescale_q(m_startTime, timeBaseUs, timeBase);
+    if(m_packet->pts != AV_NOPTS_VALUE) m_packet->pts -= offset;
+    if(m_packet->dts != AV_NOPTS_VALUE) m_packet->dts -= offset;
+    m_packet->stream_index = info->outputIndex;
+    m_packet->pos = -1;
+    av_packet_rescale_ts(m_packet, timeBase, m_formatContext->streams[info->outputIndex]->time_base);
+
+    m_lastTime = time;
+    m_bytes += m_packet->size;
+    ret = av_interleaved_write_frame(m_formatContext, m_packet);   // 会接管m_packet的引用并重置m_packet
+    if(ret < 0)
+    {
+        av_packet_unref(m_packet);
+        showError(ret);
+        return false;
+    }
+    return true;
+}
+
+void PacketMuxer::close()
+{
+    if(m_formatContext)
+    {
+        if(m_header)
+        {
+            av_write_trailer(m_formatContext);    // 只有成功写入文件头后才能写文件尾
+            m_header = false;
+        }
+        if(m_formatContext->pb && !(m_formatContext->oformat->flags & AVFMT_NOFILE))
+        {
+            avio_closep(&m_formatContext->pb);
+        }
+        avformat_free_context(m_formatContext);
+        m_formatContext = nullptr;
+    }
+    if(m_packet)
+    {
+        av_packet_free(&m_packet);
+    }
+    m_started = false;
+}
+
+bool PacketMuxer::isOpen() const
+{
+    return m_formatContext != nullptr;
+}
+
+const QString& PacketMuxer::fileName() const
+{
+    return m_fileName;
+}
+
+qint64 PacketMuxer::bytesWritten() const
+{
+    return m_bytes;
+}
+
+qint64 PacketMuxer::duration() const
+{
+    return m_started ? (m_lastTime - m_startTime) / 1000 : 0;
+}
+
+void PacketMuxer::clearInput()
+{
+    for(StreamInfo& info : m_streams)
+    {
+        avcodec_parameters_free(&info.parameters);
+    }
+    m_streams.clear();
+    m_videoIndex = -1;
+}
+
+void PacketMuxer::showError(int err)
+{
+#if PRINT_LOG
+    char error[ERROR_LEN] = {0};
+    av_strerror(err, error, ERROR_LEN);
+    qWarning() << "PacketMuxer Error：" << error;
+#else
+    Q_UNUSED(err)
+#endif
+}
@@ -0,0 +1,61 @@
+#ifndef PACKETMUXER_H
+#define PACKETMUXER_H
+
+#include <QString>
+#include <QVector>
+
+struct AVFormatContext;
+struct AVCodecParameters;
+struct AVPacket;
+
+/**
+ * @brief 直接把解封装得到的AVPacket重新封装到文件（mp4/mkv），不解码也不重新编码
+ *        本身不是线程安全的，由调用者保证在同一个线程中使用
+ */
+class PacketMuxer
+{
+public:
+    PacketMuxer();
+    ~PacketMuxer();
+
+    bool setInput(const AVFormatContext* input, int videoIndex, int audioIndex);  // 拷贝输入流参数（视频、音频，索引小于0表示没有）
+    bool copyInput(const PacketMuxer& other);      // 从另一个封装器拷贝输入流参数
+    bool hasInput(int streamIndex) const;          // 输入流是否需要封装
+    int  videoIndex() const;                       // 输入视频流索引，没有时返回-1
+
+    bool open(const QString& fileName);            // 创建输出文件，根据后缀选择封装格式
+    bool write(const AVPacket* packet);            // 写入数据包，时间戳为输入流时间基
+    void close();                                  // 写入文件尾并关闭文件
+    bool isOpen() const;
+
+    const QString& fileName() const;               // 当前输出文件
+    qint64 bytesWritten() const;                   // 当前文件已写入的字节数
+    qint64 duration() const;                       // 当前文件已写入的时长（毫秒）
+
+private:
+    struct StreamInfo
+    {
+        int inputIndex  = -1;                      // 输入流索引
+        int outputIndex = -1;                      // 输出流索引
+        int timeBaseNum = 0;                       // 输入流时间基（AVRational不能前置声明，拆开保存）
+        int timeBaseDen = 1;
+        AVCodecParameters* parameters = nullptr;   // 输入流参数拷贝
+    };
+
+    void clearInput();
+    void showError(int err);
+
+private:
+    QVector<StreamInfo> m_streams;
+    AVFormatContext* m_formatContext = nullptr;   // 输出封装上下文
+    AVPacket* m_packet = nullptr;
+    QString m_fileName;
+    qint64  m_startTime = 0;                       // 文件中第一个数据包的时间（微秒），之后的时间戳都减去它从0开始
+    qint64  m_lastTime  = 0;                       // 最后写入的数据包时间（微秒）
+    qint64  m_bytes     = 0;
+    bool    m_started   = false;                   // 是否已经写入过数据包
+    bool    m_header    = false;                   // 是否已经写入文件头
+    int     m_videoIndex = -1;
+};
+
+#endif // PACKETMUXER_H
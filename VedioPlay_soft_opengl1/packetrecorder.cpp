@@ -0,0 +1,247 @@
+#include "packetrecorder.h"
+#include "packetmuxer.h"
+#include "memorybudget.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#define MAX_QUEUE 2000  // 队列中最多缓存的数据包数，写文件跟不上时丢包，防止内存无限增长
+
+PacketRecorder::PacketRecorder(QObject *parent) : QThread(parent)
+{
+    m_muxer = new PacketMuxer();
+}
+
+PacketRecorder::~PacketRecorder()
+{
+    close();
+    delete m_muxer;
+}
+
+/**
+ * @brief             开始录制，拷贝输入流参数后开启录制线程
+ * @param fileName    录制文件名，后缀决定封装格式（.mp4/.mkv）
+ * @param input       解封装上下文，只在这里读取流参数
+ * @param videoIndex  视频流索引
+ * @param audioIndex  音频流索引，小于0表示没有音频
+ * @return
+ */
+bool PacketRecorder::open(const QString &fileName, const AVFormatContext *input, int videoIndex, int audioIndex)
+{
+    return start(fileName, input, videoIndex, audioIndex, 0);
+}
+
+/**
+ * @brief             换台、切换码流、接管待机会话后继续录制：写完并关闭当前文件，新输入的流参数不同，
+ *                    从关键帧开始写入下一个序号的文件，不会覆盖已经录制的文件
+ * @param input
+ * @param videoIndex
+ * @param audioIndex
+ * @return            没有在录制或新输入没有可以录制的流时返回false
+ */
+bool PacketRecorder::reopen(const AVFormatContext *input, int videoIndex, int audioIndex)
+{
+    if(!this->isRunning()) return false;
+    close();
+    return start(m_fileName, input, videoIndex, audioIndex, m_segmentIndex);
+}
+
+bool PacketRecorder::start(const QString &fileName, const AVFormatContext *input, int videoIndex, int audioIndex, int segmentIndex)
+{
+    if(this->isRunning()) return false;
+    if(!m_muxer->setInput(input, videoIndex, audioIndex))
+    {
+        qWarning() << "录制失败，没有可以录制的流！";
+        return false;
+    }
+    QMutexLocker locker(&m_mutex);               // 录制线程没有运行，这里可以访问m_muxer
+    m_inputStreams.clear();
+    for(int index : {videoIndex, audioIndex})
+    {
+        if(index >= 0 && m_muxer->hasInput(index)) m_inputStreams.append(index);
+    }
+    m_inputVideo   = m_muxer->videoIndex();
+    m_fileName     = fileName;
+    m_segmentIndex = segmentIndex;
+    m_dropPackets  = 0;
+    m_waitKeyFrame = true;
+    m_stop         = false;
+    this->start();
+    return true;
+}
+
+/**
+ * @brief 停止录制，等待录制线程写完剩余数据包并关闭文件
+ */
+void PacketRecorder::close()
+{
+    m_mutex.lock();
+    m_stop = true;
+    m_cond.wakeAll();
+    m_mutex.unlock();
+    this->wait();
+
+    // 线程已经退出，清理没来得及写入的数据包
+    while(!m_queue.isEmpty())
+    {
+        AVPacket* packet = m_queue.dequeue();
+        MemoryBudget::instance()->release(m_session, MemoryBudget::PacketQueue, packet->size);
+        av_packet_free(&packet);
+    }
+}
+
+/**
+ * @brief         送入一个数据包，必须在时间戳转换之前调用（需要输入流原始时间基）
+ * @param packet
+ */
+void PacketRecorder::pushPacket(const AVPacket *packet)
+{
+    if(!packet) return;
+
+    QMutexLocker locker(&m_mutex);
+    if(m_stop || !this->isRunning() || !m_inputStreams.contains(packet->stream_index)) return;
+
+    bool isVideo = packet->stream_index == m_inputVideo;
+    if(m_waitKeyFrame)
+    {
+        // 丢包后必须从关键帧重新开始，否则录制的视频会花屏
+        if(m_inputVideo >= 0 && !(isVideo && (packet->flags & AV_PKT_FLAG_KEY)))
+        {
+            return;
+        }
+        m_waitKeyFrame = false;
+    }
+    if(m_queue.size() >= MAX_QUEUE ||
+       !MemoryBudget::instance()->reserve(m_session, MemoryBudget::PacketQueue, packet->size))
+    {
+        m_dropPackets++;
+        m_waitKeyFrame = true;
+        qWarning() << "录制写入太慢（或超出内存预算），丢弃数据包：" << m_dropPackets;
+        return;
+    }
+    AVPacket* clone = av_packet_clone(packet);      // 新建AVPacket并引用同一块数据
+    if(!clone)
+    {
+        MemoryBudget::instance()->release(m_session, MemoryBudget::PacketQueue, packet->size);
+        return;
+    }
+    m_queue.enqueue(clone);
+    m_cond.wakeOne();
+}
+
+bool PacketRecorder::isRecording()
+{
+    return this->isRunning();
+}
+
+int PacketRecorder::queueSize()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_queue.size();
+}
+
+void PacketRecorder::setSegmentDuration(qint64 msec)
+{
+    m_segmentDuration = msec;
+}
+
+void PacketRecorder::setSegmentSize(qint64 bytes)
+{
+    m_segmentSize = bytes;
+}
+
+void PacketRecorder::setMemorySession(int session)
+{
+    m_session = session;
+}
+
+void PacketRecorder::run()
+{
+    forever
+    {
+        m_mutex.lock();
+        while(m_queue.isEmpty() && !m_stop)
+        {
+            m_cond.wait(&m_mutex);
+        }
+        if(m_queue.isEmpty())               // 停止录制并且数据已经写完
+        {
+            m_mutex.unlock();
+            break;
+        }
+        AVPacket* packet = m_queue.dequeue();
+        m_mutex.unlock();
+
+        writePacket(packet);
+        MemoryBudget::instance()->release(m_session, MemoryBudget::PacketQueue, packet->size);
+        av_packet_free(&packet);
+    }
+    closeSegment();
+    qDebug() << "录制结束！";
+}
+
+void PacketRecorder::writePacket(AVPacket *packet)
+{
+    bool isKeyFrame = (packet->stream_index == m_muxer->videoIndex()) && (packet->flags & AV_PKT_FLAG_KEY);
+    bool noVideo    = m_muxer->videoIndex() < 0;
+
+    if(m_muxer->isOpen() && (isKeyFrame || noVideo))
+    {
+        // 分段只在关键帧处切换，保证每个文件都可以单独播放
+        if((m_segmentDuration > 0 && m_muxer->duration() >= m_segmentDuration) ||
+           (m_segmentSize > 0 && m_muxer->bytesWritten() >= m_segmentSize))
+        {
+            closeSegment();
+        }
+    }
+    if(!m_muxer->isOpen())
+    {
+        if(!isKeyFrame && !noVideo) return;  // 文件需要从关键帧开始
+        if(!openSegment()) return;
+    }
+    m_muxer->write(packet);
+}
+
+bool PacketRecorder::openSegment()
+{
+    QString fileName = segmentName(m_segmentIndex);
+    if(!m_muxer->open(fileName))
+    {
+        qWarning() << "创建录制文件失败：" << fileName;
+        return false;
+    }
+    m_segmentIndex++;
+    qDebug() << "开始录制：" << fileName;
+    return true;
+}
+
+void PacketRecorder::closeSegment()
+{
+    if(!m_muxer->isOpen()) return;
+    m_muxer->close();
+    emit segmentFinished(m_muxer->fileName());
+}
+
+/**
+ * @brief       不分段时直接使用录制文件名（输入切换后的文件加上序号），分段时为【文件名_序号.后缀】
+ * @param index
+ * @return
+ */
+QString PacketRecorder::segmentName(int index) const
+{
+    if(m_segmentDuration <= 0 && m_segmentSize <= 0 && index == 0)
+    {
+        return m_fileName;
+    }
+    QFileInfo info(m_fileName);
+    return info.dir().filePath(QString("%1_%2.%3")
+                               .arg(info.completeBaseName())
+                               .arg(index, 3, 10, QChar('0'))
+                               .arg(info.suffix()));
+}
@@ -0,0 +1,66 @@
+#ifndef PACKETRECORDER_H
+#define PACKETRECORDER_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+#include <QVector>
+
+class PacketMuxer;
+struct AVFormatContext;
+struct AVPacket;
+
+/**
+ * @brief 录制线程：把解封装得到的AVPacket直接封装为mp4/mkv文件（不解码、不重新编码），
+ *        支持按时长或文件大小分段，分段总是从视频关键帧开始
+ */
+class PacketRecorder : public QThread
+{
+    Q_OBJECT
+public:
+    explicit PacketRecorder(QObject *parent = nullptr);
+    ~PacketRecorder() override;
+
+    bool open(const QString& fileName, const AVFormatContext* input, int videoIndex, int audioIndex);  // 开始录制
+    void close();                                   // 停止录制（写完队列中的数据包后退出）
+    bool reopen(const AVFormatContext* input, int videoIndex, int audioIndex);   // 输入切换后继续录制到下一个文件
+    void pushPacket(const AVPacket* packet);        // 送入数据包，只增加引用计数，可以在解码线程中调用
+    bool isRecording();
+    int  queueSize();                               // 等待写入文件的数据包数
+
+    void setSegmentDuration(qint64 msec);           // 按时长分段（毫秒），0表示不按时长分段
+    void setSegmentSize(qint64 bytes);              // 按大小分段（字节），0表示不按大小分段
+    void setMemorySession(int session);             // 队列内存记账的播放会话
+
+protected:
+    void run() override;
+
+signals:
+    void segmentFinished(const QString& fileName);  // 一个分段文件录制完成
+
+private:
+    bool start(const QString& fileName, const AVFormatContext* input, int videoIndex, int audioIndex, int segmentIndex);
+    void writePacket(AVPacket* packet);
+    bool openSegment();
+    void closeSegment();
+    QString segmentName(int index) const;           // 分段文件名
+
+private:
+    PacketMuxer* m_muxer = nullptr;
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    QQueue<AVPacket*> m_queue;                      // 等待写入的数据包
+    QString m_fileName;                             // 录制文件名，分段时会在后面加上序号
+    qint64 m_segmentDuration = 0;
+    qint64 m_segmentSize     = 0;
+    int  m_segmentIndex = 0;
+    int  m_dropPackets  = 0;                        // 写入太慢时丢弃的数据包数
+    bool m_waitKeyFrame = true;                     // 丢包后需要等待下一个关键帧
+    bool m_stop = false;
+    int  m_session = 0;                             // 内存记账会话
+    QVector<int> m_inputStreams;                    // 录制的输入流索引（m_mutex保护），送包时不访问录制线程使用的m_muxer
+    int  m_inputVideo = -1;                         // 录制的视频流索引，没有视频时为-1
+};
+
+#endif // PACKETRECORDER_H
@@ -1,146 +1,306 @@
 #include "playimage.h"
-#include <QPainter>
+#include "framebus.h"
+#include "tracer.h"
+#include "visibilitywatcher.h"
+#include <QDebug>
+#include <QMenu>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QtMath>
+
+#define ZOOM_STEP 1.25      // 滚轮每一格的放大倍数
 
 PlayImage::PlayImage(QWidget *parent,Qt::WindowFlags f)
     : QOpenGLWidget(parent,f)
 {
     setMinimumSize(400, 300);
+    m_visibility = new VisibilityWatcher(this);
+    connect(m_visibility, &VisibilityWatcher::visibilityChanged, this, [this](bool visible) {
+        if(m_subscriber)
+        {
+            m_subscriber->setActive(visible);
+        }
+        emit visibilityChanged(visible);
+    });
+    connect(this, &QOpenGLWidget::frameSwapped, this, [this]() {
+        if(m_paintEnd < 0) return;
+        Tracer::instance()->complete("swap", m_paintEnd, m_traceStream, m_tracePts);
+        m_paintEnd = -1;
+    });
 }
 PlayImage::~PlayImage()
 {
+    setFrameBus(nullptr);
     if(!isValid()) return;        // 如果控件和OpenGL资源（如上下文）已成功初始化，则返回true。
     this->makeCurrent(); // 通过将相应的上下文设置为当前上下文并在该上下文中绑定帧缓冲区对象，为呈现此小部件的OpenGL内容做准备。
-    // 释放纹理
-    if(m_texture)
-    {
-        m_texture->destroy();
-        delete m_texture;
-    }
+    m_renderer.destroy();
     this->doneCurrent();    // 释放上下文
 }
 
+/**
+ * @brief       图像在下一次paintGL时上传，不在调用线程中访问GL上下文
+ * @param image
+ */
 void PlayImage::updateImage(const QImage& image)
 {
     if(image.isNull()) return;
 
-    m_size = image.size();
-   // this->makeCurrent(); // 确保 OpenGL 上下文是当前的
-    if(!m_texture)
-    {
-        m_texture = new QOpenGLTexture(image.mirrored());
-        resizeGL(this->width(), this->height());
-    }
-    else
-    {
-        m_texture->destroy();
-        m_texture->setData(image.mirrored());
-    }
-  //  this->doneCurrent(); // 释放当前 OpenGL 上下文
+    m_renderer.setImage(image);
     this->update();
 }
-// 三个顶点坐标XYZ，VAO、VBO数据播放，范围时[-1 ~ 1]直接
-static GLfloat vertices[] = {  // 前三列点坐标，后两列为纹理坐标
-    1.0f,  1.0f, 0.0f, 1.0f, 1.0f,      // 右上角
-    1.0f, -1.0f, 0.0f, 1.0f, 0.0f,      // 右下
-    -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,      // 左下
-    -1.0f,  1.0f, 0.0f, 0.0f, 1.0f      // 左上
-};
-static GLuint indices[] = {
-    0, 1, 3,
-    1, 2, 3
-};
-void PlayImage::initializeGL()
+
+/**
+ * @brief       显示高位深YUV帧（yuv420p10/yuv420p12/P010），只保存引用，在paintGL中把16位平面上传为GL_R16/GL_RG16纹理，
+ *              颜色转换和HDR（PQ/HLG）色调映射在着色器中完成，不经过8位RGBA
+ * @param frame
+ */
+void PlayImage::updateFrame(const QSharedPointer<AVFrame> &frame)
 {
-    initializeOpenGLFunctions();
+    if(!frame) return;
 
+    m_renderer.setFrame(frame);
+    this->update();
+}
+/**
+ * @brief     订阅帧总线，多个窗口可以订阅同一路解码；队列只保留最新一帧，显示跟不上时自动丢帧
+ * @param bus
+ */
+void PlayImage::setFrameBus(FrameBus *bus)
+{
+    if(m_subscriber)
+    {
+        m_frameBus->unsubscribe(m_subscriber);
+        m_subscriber = nullptr;
+    }
+    m_frameBus = bus;
+    setMemorySession(bus ? bus->memorySession() : 0);
+    if(!bus) return;
 
-    m_program = new QOpenGLShaderProgram(this);
-    m_program->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/vertex.vsh");
-    m_program->addShaderFromSourceFile(QOpenGLShader::Fragment, ":/fragment.fsh");
-    m_program->link();
+    m_subscriber = bus->subscribe(FrameSubscriber::LatestOnly);
+    m_subscriber->setActive(isShown());
+    m_subscriber->setDisplaySize(displaySize());
+    FrameSubscriber* subscriber = m_subscriber;
+    connect(subscriber, &FrameSubscriber::frameAvailable, this, [this, subscriber]() {
+        VideoFrame frame;
+        if(!subscriber->take(&frame)) return;
+        if(frame.published >= 0)
+        {
+            Tracer::instance()->complete("signal hop", frame.published, frame.stream, frame.pts);
+        }
+        setTraceInfo(frame.stream, frame.pts);
+        if(frame.image.isNull() && frame.frame)
+        {
+            updateFrame(frame.frame);               // 高位深帧没有转换为RGBA
+        }
+        else
+        {
+            updateImage(frame.image);
+        }
+    }, Qt::QueuedConnection);
+}
+/**
+ * @brief          设置后处理，下一次重绘时对当前图像重新处理；同一帧多次重绘（如窗口缩放）只处理一次
+ * @param settings
+ */
+void PlayImage::setPostProcess(const PostProcess &settings)
+{
+    m_renderer.setPostProcess(settings);
+    this->update();
+}
 
+PostProcess PlayImage::postProcess() const
+{
+    return m_renderer.postProcess();
+}
 
-    // 返回属性名称在此着色器程序的参数列表中的位置。如果名称不是此着色器程序的有效属性，则返回-1。
-    GLuint posAttr = GLuint(m_program->attributeLocation("aPos"));
-    GLuint texCord = GLuint(m_program->attributeLocation("aTexCord"));
+void PlayImage::setScaleKernel(ScaleKernel kernel)
+{
+    m_renderer.setScaleKernel(kernel);
+    this->update();
+}
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+void PlayImage::setMemorySession(int session)
+{
+    m_renderer.setMemorySession(session);
+}
 
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glGenBuffers(1, &EBO);    // 创建一个EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+PlayImage::ScaleKernel PlayImage::scaleKernel() const
+{
+    return m_renderer.scaleKernel();
+}
 
-    // 为当前绑定到的缓冲区对象创建一个新的数据存储target。任何预先存在的数据存储都将被删除。
-    glBufferData(GL_ARRAY_BUFFER,        // 为VBO缓冲绑定顶点数据
-                 sizeof (vertices),      // 数组字节大小
-                 vertices,               // 需要绑定的数组
-                 GL_STATIC_DRAW);        // 指定数据存储的预期使用模式,GL_STATIC_DRAW： 数据几乎不会改变
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);  // 将顶点索引数组传入EBO缓存
+bool PlayImage::isShown() const
+{
+    return m_visibility->isVisible();
+}
 
-    // 设置顶点坐标数据
-    glVertexAttribPointer(posAttr,                     // 指定要修改的通用顶点属性的索引
-                          3,                     // 指定每个通用顶点属性的组件数（如vec3：3，vec4：4）
-                          GL_FLOAT,              // 指定数组中每个组件的数据类型(数组中一行有几个数)
-                          GL_FALSE,              // 指定在访问定点数据值时是否应规范化 ( GL_TRUE) 或直接转换为定点值 ( GL_FALSE)，如果vertices里面单个数超过-1或者1可以选择GL_TRUE
-                          5 * sizeof(GLfloat),   // 指定连续通用顶点属性之间的字节偏移量。
-                          nullptr);              // 指定当前绑定到目标的缓冲区的数据存储中数组中第一个通用顶点属性的第一个组件的偏移量。初始值为0 (一个数组从第几个字节开始读)
-    // 启用通用顶点属性数组
-    glEnableVertexAttribArray(posAttr);                // 属性索引是从调用glGetAttribLocation接收的，或者传递给glBindAttribLocation。
+void PlayImage::setZoom(const QRectF &region)
+{
+    m_renderer.setZoom(region);
+    this->update();
+    emit zoomChanged(m_renderer.zoom());
+    updateDisplaySize();
+}
 
-    // 设置纹理坐标数据
-    glVertexAttribPointer(texCord, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), reinterpret_cast<const GLvoid *>(3 * sizeof (GLfloat)));              // 指定当前绑定到目标的缓冲区的数据存储中数组中第一个通用顶点属性的第一个组件的偏移量。初始值为0 (一个数组从第几个字节开始读)
-    // 启用通用顶点属性数组
-    glEnableVertexAttribArray(texCord);                // 属性索引是从调用glGetAttribLocation接收的，或者传递给glBindAttribLocation。
-    // 释放
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);                        // 设置为零以破坏现有的顶点数组对象绑定
+QRectF PlayImage::zoom() const
+{
+    return m_renderer.zoom();
+}
 
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);        // 指定颜色缓冲区的清除值(背景色)
+/**
+ * @brief        需要在创建QApplication之前设置Qt::AA_ShareOpenGLContexts，来源窗口需要可见（不可见时不绘制、不上传）
+ * @param source
+ */
+void PlayImage::setSource(PlayImage *source)
+{
+    disconnect(m_sourceConnection);
+    m_source = (source == this) ? nullptr : source;
+    if(m_source)
+    {
+        m_sourceConnection = connect(m_source, &QOpenGLWidget::frameSwapped, this, [this]() { this->update(); });
+    }
+    this->update();
 }
 
-void PlayImage::resizeGL(int w, int h)
+/**
+ * @brief  窗口的物理像素按放大倍数换算为视频分辨率：放大4倍时窗口只显示视频的1/4，需要4倍的分辨率才能看清
+ * @return
+ */
+QSize PlayImage::displaySize() const
 {
-    if(m_size.width()  < 0 || m_size.height() < 0) return;
+    QRectF zoom = m_renderer.zoom();
+    qreal ratio = devicePixelRatioF();
+    return QSize(qCeil(width() * ratio / zoom.width()), qCeil(height() * ratio / zoom.height()));
+}
 
-    // 计算需要显示图片的窗口大小，用于实现长宽等比自适应显示
-    if((double(w) / h) < (double(m_size.width()) / m_size.height()))
+void PlayImage::updateDisplaySize()
+{
+    QSize size = displaySize();
+    if(m_subscriber)
     {
-        m_zoomSize.setWidth(w);
-        m_zoomSize.setHeight(((double(w) / m_size.width()) * m_size.height()));   // 这里不使用QRect，使用QRect第一次设置时有误差bug
+        m_subscriber->setDisplaySize(size);
     }
-    else
+    emit displaySizeChanged(size);
+}
+
+void PlayImage::setTraceInfo(int stream, qint64 pts)
+{
+    m_traceStream = stream;
+    m_tracePts = pts;
+}
+
+void PlayImage::initializeGL()
+{
+    if(!m_renderer.initialize())
     {
-        m_zoomSize.setHeight(h);
-        m_zoomSize.setWidth((double(h) / m_size.height()) * m_size.width());
+        qWarning() << "着色器初始化失败";
     }
-    m_pos.setX(double(w - m_zoomSize.width()) / 2);
-    m_pos.setY(double(h - m_zoomSize.height()) / 2);
+}
+
+void PlayImage::resizeGL(int w, int h)
+{
+    m_renderer.setViewport(QSize(w, h));
     this->update(QRect(0, 0, w, h));
+    updateDisplaySize();
 }
 
+/**
+ * @brief 先单独上传，跟踪时可以区分上传和绘制的耗时（render中没有新图像时不会再上传）
+ */
 void PlayImage::paintGL()
 {
-    glClear(GL_COLOR_BUFFER_BIT);     // 将窗口的位平面区域（背景）设置为先前由glClearColor、glClearDepth和选择的值
-    glViewport(m_pos.x(), m_pos.y(), m_zoomSize.width(), m_zoomSize.height());  // 设置视图大小实现图片自适应
+    m_renderer.setSource(m_source ? &m_source->m_renderer : nullptr);   // 来源窗口释放后QPointer自动为空
+    {
+        TraceSpan span("upload", m_traceStream, m_tracePts);
+        m_renderer.upload();
+    }
+    {
+        TraceSpan span("paint", m_traceStream, m_tracePts);
+        m_renderer.render(defaultFramebufferObject());
+    }
+    m_paintEnd = Tracer::isEnabled() ? Tracer::now() : -1;
+}
 
-    m_program->bind();               // 绑定着色器
-    if(m_texture)
+/**
+ * @brief       以光标下的图像位置为中心缩放
+ * @param event
+ */
+void PlayImage::wheelEvent(QWheelEvent *event)
+{
+    qreal steps = event->angleDelta().y() / 120.0;
+    if(steps == 0 || m_renderer.displaySize().isEmpty())
     {
-        m_texture->bind();
+        QOpenGLWidget::wheelEvent(event);
+        return;
     }
+    QRectF zoom = m_renderer.zoom();
+    QPointF anchor = m_renderer.mapToImage(event->position());
+    qreal factor = qPow(ZOOM_STEP, -steps);
+    setZoom(QRectF(anchor - (anchor - zoom.topLeft()) * factor, zoom.size() * factor));
+    event->accept();
+}
 
-    glBindVertexArray(VAO);           // 绑定VAO
+void PlayImage::mousePressEvent(QMouseEvent *event)
+{
+    if(event->button() != Qt::LeftButton)
+    {
+        QOpenGLWidget::mousePressEvent(event);
+        return;
+    }
+    m_dragging = true;
+    m_dragPos = event->position();
+    m_dragZoom = m_renderer.zoom();
+}
 
-    glDrawElements(GL_TRIANGLES,      // 绘制的图元类型
-                   6,                 // 指定要渲染的元素数(点数)
-                   GL_UNSIGNED_INT,   // 指定索引中值的类型(indices)
-                   nullptr);          // 指定当前绑定到GL_ELEMENT_array_buffer目标的缓冲区的数据存储中数组中第一个索引的偏移量。
-    glBindVertexArray(0);             //解绑,防止绘制出现失误,而修改vao内容
-    if(m_texture)
+/**
+ * @brief       拖动平移，移动距离按显示大小换算为图像坐标
+ * @param event
+ */
+void PlayImage::mouseMoveEvent(QMouseEvent *event)
+{
+    QSizeF size = m_renderer.displaySize();
+    if(!m_dragging || size.isEmpty())
     {
-        m_texture->release();
+        QOpenGLWidget::mouseMoveEvent(event);
+        return;
     }
-    m_program->release();
+    QPointF delta = event->position() - m_dragPos;
+    setZoom(m_dragZoom.translated(-delta.x() / size.width() * m_dragZoom.width(),
+                                  -delta.y() / size.height() * m_dragZoom.height()));
+}
+
+void PlayImage::mouseReleaseEvent(QMouseEvent *event)
+{
+    m_dragging = false;
+    QOpenGLWidget::mouseReleaseEvent(event);
+}
+
+void PlayImage::mouseDoubleClickEvent(QMouseEvent *event)
+{
+    setZoom(QRectF(0, 0, 1, 1));
+    event->accept();
+}
+
+void PlayImage::contextMenuEvent(QContextMenuEvent *event)
+{
+    QMenu menu(this);
+    menu.addAction("打开局部放大窗口", this, &PlayImage::openZoomWindow);
+    menu.exec(event->globalPos());
+}
+
+/**
+ * @brief 新窗口从当前放大区域开始，共享来源窗口的纹理，不再订阅、上传和解码；
+ *        放大窗口中再打开时仍然指向最初的来源窗口，来源窗口释放时一起关闭
+ */
+void PlayImage::openZoomWindow()
+{
+    PlayImage* root = m_source ? m_source.data() : this;
+    PlayImage* view = new PlayImage(nullptr, Qt::Window);
+    view->setAttribute(Qt::WA_DeleteOnClose);
+    view->setWindowTitle(QString("局部放大：%1").arg(root->window()->windowTitle()));
+    view->setSource(root);
+    view->setZoom(zoom());
+    connect(root, &QObject::destroyed, view, &QWidget::close);
+    view->resize(this->size());
+    view->show();
 }
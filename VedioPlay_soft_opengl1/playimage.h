@@ -2,45 +2,73 @@
 #define PLAYIMAGE_H
 
 #include <QOpenGLWidget>
-#include <QOpenGLTexture>
-#include <QOpenGLShaderProgram>
-#include <QOpenGLBuffer>
-#include <QOpenGLVertexArrayObject>
-#include <QOpenGLFunctions_3_3_Core>
 #include <QImage>
-#include <QMutex>
+#include <QPointer>
+#include <QSharedPointer>
+#include "videorenderer.h"
 
+class FrameBus;
+class FrameSubscriber;
+class VisibilityWatcher;
+struct AVFrame;
 
-class PlayImage : public QOpenGLWidget, public  QOpenGLFunctions_3_3_Core
-
+class PlayImage : public QOpenGLWidget
 {
     Q_OBJECT
 public:
+    typedef VideoRenderer::ScaleKernel ScaleKernel;   // 缩放到窗口大小时使用的滤波器
      explicit PlayImage(QWidget* parent = nullptr, Qt::WindowFlags f = Qt::WindowFlags());
 
     void updateImage(const QImage& image);
+    void updateFrame(const QSharedPointer<AVFrame>& frame);   // 显示10/12位YUV帧，16位平面直接上传，在着色器中转换
+    void setFrameBus(FrameBus* bus);            // 订阅帧总线（只显示最新一帧），为空时取消订阅
+    void setPostProcess(const PostProcess& settings);   // 设置后处理，在GPU中执行
+    PostProcess postProcess() const;
+    void setScaleKernel(ScaleKernel kernel);    // 设置缩放滤波器，非双线性时在着色器中分水平、垂直两遍缩放
+    void setMemorySession(int session);         // 纹理显存记账的播放会话（订阅帧总线时自动设置）
+    ScaleKernel scaleKernel() const;
+    void setTraceInfo(int stream, qint64 pts);  // 当前显示帧的会话和时间，用于上传、绘制、交换的跟踪区间
+    bool isShown() const;                       // 是否能被看到（隐藏、最小化、被遮挡、滚动出视图时为false）
+    void setZoom(const QRectF& region);         // 局部放大显示的图像区域（归一化坐标，y向下），鼠标滚轮缩放、拖动平移、双击还原
+    QRectF zoom() const;
+    void setSource(PlayImage* source);          // 显示另一个窗口已经上传的纹理（同一路视频的多个局部放大窗口），本窗口不订阅、不上传
+    QSize displaySize() const;                  // 清晰显示需要的视频分辨率（物理像素除以放大倍数），读取线程据此选择主、子码流
     //void updatePixmap(const QPixmap& pixmap);
     ~PlayImage() override;
 
+signals:
+    void visibilityChanged(bool visible);       // 不可见时订阅者停止接收帧，读取线程据此降低解码开销
+    void zoomChanged(const QRectF& region);
+    void displaySizeChanged(const QSize& size); // 窗口大小、放大区域变化时触发
+
 
 
 protected:
     void initializeGL() override;               // 初始化gl
     void resizeGL(int w, int h) override;       // 窗口尺寸变化
     void paintGL() override;                    // 刷新显示
-
-
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+    void contextMenuEvent(QContextMenuEvent* event) override;
 
 private:
-    QOpenGLShaderProgram* m_program = nullptr;
-    QOpenGLTexture* m_texture = nullptr;
-
-    GLuint VBO = 0;       // 顶点缓冲对象,负责将数据从内存放到缓存，一个VBO可以用于多个VAO
-    GLuint VAO = 0;       // 顶点数组对象,任何随后的顶点属性调用都会储存在这个VAO中，一个VAO可以有多个VBO
-    GLuint EBO = 0;       // 元素缓冲对象,它存储 OpenGL 用来决定要绘制哪些顶点的索引
-    QSize  m_size;
-    QSizeF  m_zoomSize;
-    QPointF m_pos;
+    void updateDisplaySize();                   // 通知订阅者新的显示分辨率
+    void openZoomWindow();                      // 打开共享本窗口纹理的局部放大窗口
+    VideoRenderer m_renderer;                   // 上传和绘制，与离屏渲染使用同一套代码
+    FrameBus* m_frameBus = nullptr;
+    FrameSubscriber* m_subscriber = nullptr;
+    VisibilityWatcher* m_visibility = nullptr;
+    int    m_traceStream = 0;
+    qint64 m_tracePts = -1;
+    qint64 m_paintEnd = -1;                     // 绘制结束的跟踪时钟，交换完成时记录交换区间
+    QPointer<PlayImage> m_source;               // 共享纹理的来源窗口
+    QMetaObject::Connection m_sourceConnection; // 来源绘制完成后重绘
+    bool    m_dragging = false;
+    QPointF m_dragPos;                          // 开始拖动时的鼠标位置和放大区域
+    QRectF  m_dragZoom;
 };
 
 #endif // PLAYIMAGE_H
@@ -1,14 +1,50 @@
 #include "readthread.h"
 #include "videodecoder.h"
+#include "packetrecorder.h"
+#include "timeshiftbuffer.h"
+#include "gopcache.h"
+#include "frameexporter.h"
+#include "framebus.h"
+#include "memorybudget.h"
+#include "standbypool.h"
+#include "metrics.h"
+#include "tracer.h"
 
-#include <QEventLoop>
-#include <QTimer>
+#include <QThreadPool>
+#include <QMetaMethod>
 #include <QDebug>
 #include <qimage.h>
 
+extern "C" {        // 用C规则编译指定的代码
+#include <libavcodec/avcodec.h>
+}
+
+#define LATE_FRAME       40     // 晚于显示时间多少毫秒计为迟到帧
+#define MAX_DISPLAY_FPS  25     // 倍速播放时每秒最多显示的帧数
+#define METRICS_INTERVAL 1000   // 更新队列深度等指标的间隔（毫秒）
+#define RENDITION_TIMEOUT 10000 // 准备码流的超时时间（毫秒），超时或打开失败后同样时间内不再尝试
+
 ReadThread::ReadThread(QObject *parent) : QThread(parent)
 {
     m_videoDecode = new VideoDecoder();
+    m_recorder = new PacketRecorder(this);
+    m_timeShift = new TimeShiftBuffer();
+    m_gopCache = new GopCache();
+    m_prefetchDecoder = new VideoDecoder();
+    m_prefetchPool.setMaxThreadCount(1);
+    m_exportPool.setMaxThreadCount(1);            // 导出按请求顺序依次执行
+    m_commandClock.start();
+    m_exporter = new FrameExporter(this);
+    m_frameBus = new FrameBus(this);
+    m_renditionStandby = new StandbyPool(this);
+    m_renditionStandby->setCapacity(1);           // 同时只准备一个目标码流
+
+    m_session = MemoryBudget::instance()->createSession();   // 本路播放的队列、缓存都记在这个会话下
+    m_recorder->setMemorySession(m_session);
+    m_timeShift->setMemorySession(m_session);
+    m_gopCache->setMemorySession(m_session);
+    m_frameBus->setMemorySession(m_session);
+    m_videoDecode->setMetricsSession(m_session);  // 指标使用同一个会话编号
 
     qRegisterMetaType<PlayState>("PlayState");    // 注册自定义枚举类型，否则信号槽无法发送
 }
@@ -20,6 +56,13 @@ ReadThread::~ReadThread()
     {
         delete m_videoDecode;
     }
+    m_exportPool.waitForDone();                   // 等待正在导出的时移片段
+    m_prefetchPool.waitForDone();
+    delete m_timeShift;
+    delete m_gopCache;
+    delete m_prefetchDecoder;
+    MemoryBudget::instance()->removeSession(m_session);
+    Metrics::instance()->removeSession(m_session);
 }
 /**
  * @brief      传入播放的视频地址并开启线程
@@ -30,6 +73,7 @@ void ReadThread::open(const QString &url)
     if(!this->isRunning())
     {
         m_url = url;
+        m_videoDecode->setInterrupted(false);
         emit this->start();
     }
 }
@@ -39,16 +83,16 @@ void ReadThread::open(const QString &url)
  */
 void ReadThread::pause(bool flag)
 {
-    m_pause = flag;
+    postCommand(flag ? PauseCommand : ResumeCommand);
 }
 
 /**
- * @brief 关闭播放
+ * @brief 关闭播放，同时中断正在阻塞的打开、读取，不需要等待网络超时
  */
 void ReadThread::close()
 {
-    m_play = false;
-    m_pause = false;
+    m_videoDecode->setInterrupted(true);
+    postCommand(StopCommand);
 }
 
 
@@ -57,64 +101,1175 @@ const QString &ReadThread::url()
     return m_url;
 }
 
+int ReadThread::session() const
+{
+    return m_session;
+}
 
+/**
+ * @brief          开始录制，可以在播放过程中随时调用，录制会从下一个关键帧开始；在读取线程中开始后触发recordState
+ * @param fileName 录制文件名，后缀决定封装格式（.mp4/.mkv）
+ * @return         没有在播放时返回false
+ */
+bool ReadThread::startRecord(const QString &fileName)
+{
+    if(!this->isRunning()) return false;
+    QMutexLocker locker(&m_requestMutex);
+    m_recordFile = fileName;
+    m_recordChanged = true;
+    wakeRequest();
+    return true;
+}
 
+/**
+ * @brief 停止录制
+ */
+void ReadThread::stopRecord()
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_recordFile.clear();
+    m_recordChanged = true;
+    wakeRequest();
+}
 
-void  sleepMsec(int msec)
+/**
+ * @brief          设置是否解码显示，关闭后只解封装，配合startRecord实现不解码的录制
+ * @param enabled
+ */
+void ReadThread::setDecodeEnabled(bool enabled)
 {
-    if(msec <= 0) return;
-    QEventLoop loop;		//定义一个新的事件循环
-    QTimer::singleShot(msec, &loop, SLOT(quit()));//创建单次定时器，槽函数为事件循环的退出函数
-    loop.exec();			//事件循环开始执行，程序会卡在这里，直到定时时间到，本循环被退出
+    m_decode = enabled;
 }
 
+PacketRecorder *ReadThread::recorder()
+{
+    return m_recorder;
+}
 
-void ReadThread::run()
+/**
+ * @brief          开启时移后，读取到的数据包先缓存到内存中，再从缓存中取出解码，
+ *                 这样暂停、回看时可以继续接收直播数据
+ * @param enabled
+ */
+void ReadThread::setTimeShiftEnabled(bool enabled)
+{
+    m_timeShiftEnabled = enabled;
+}
+
+/**
+ * @brief      时移回看，会对齐到之前最近的关键帧
+ * @param msec 从当前播放位置后退的时间（毫秒）
+ */
+void ReadThread::rewind(qint64 msec)
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_rewindRequest += msec;
+    wakeRequest();
+}
+
+/**
+ * @brief 时移回到直播
+ */
+void ReadThread::goLive()
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_rewindRequest = 0;
+    m_liveRequest = true;
+    wakeRequest();
+}
+
+/**
+ * @brief          不重新编码导出最近一段视频，在线程池中执行，完成后触发clipExported
+ * @param fileName 导出文件名（.mp4/.mkv）
+ * @param msec     导出时长（毫秒），开始位置会向前对齐到关键帧
+ */
+void ReadThread::exportClip(const QString &fileName, qint64 msec)
+{
+    m_exportPool.start([this, fileName, msec]() {
+        bool ok = m_timeShift->exportClip(fileName, msec);
+        emit clipExported(fileName, ok);
+    });
+}
+
+TimeShiftBuffer *ReadThread::timeShift()
+{
+    return m_timeShift;
+}
+
+/**
+ * @brief      跳转到指定时间，播放时从msec开始继续播放，暂停时显示msec处的一帧
+ * @param msec
+ */
+void ReadThread::seek(qint64 msec)
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_seekRequest = qMax(qint64(0), msec);
+    wakeRequest();
+}
+
+/**
+ * @brief 暂停时前进一帧
+ */
+void ReadThread::stepForward()
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_stepRequest++;
+    wakeRequest();
+}
+
+/**
+ * @brief 暂停时后退一帧，需要解码整个GOP，之后在GOP内后退直接使用缓存
+ */
+void ReadThread::stepBackward()
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_stepRequest--;
+    wakeRequest();
+}
+
+/**
+ * @brief         倒放，按照帧间隔逐帧后退显示
+ * @param reverse
+ */
+void ReadThread::setReverse(bool reverse)
+{
+    postCommand(reverse ? ReverseCommand : ForwardCommand);
+}
+
+GopCache *ReadThread::gopCache()
+{
+    return m_gopCache;
+}
+
+/**
+ * @brief       设置播放倍速，解码速度跟不上时会自动切换为跳过非参考帧、只解码关键帧（并跳转）
+ * @param speed 0.25 ~ 32
+ */
+void ReadThread::setSpeed(qreal speed)
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_speedRequest = qBound(0.25, speed, 32.0);
+    wakeRequest();
+}
+
+/**
+ * @brief          截图，在读取线程中增加当前帧的引用后交给编码线程，不会阻塞界面和解码
+ * @param fileName
+ */
+void ReadThread::snapshot(const QString &fileName)
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_snapshotFile = fileName;
+    wakeRequest();
+}
+
+/**
+ * @brief      使用单独的解码器批量导出当前位置之后msec毫秒内的所有帧（JPEG），完成后exporter()触发rangeExported
+ * @param dir  保存目录
+ * @param msec
+ */
+void ReadThread::exportFrames(const QString &dir, qint64 msec)
+{
+    qint64 start = qMax(qint64(0), m_displayPts);
+    m_exporter->exportRange(m_url, start, start + msec, dir, "jpg");
+}
+
+FrameExporter *ReadThread::exporter()
+{
+    return m_exporter;
+}
+
+/**
+ * @brief       注册分析接口，在读取线程中按帧率回调缩小后的灰度图，重新打开视频后继续有效
+ * @param tap
+ * @param fps
+ * @param width
+ */
+void ReadThread::addFrameTap(FrameTap *tap, qreal fps, int width)
+{
+    m_videoDecode->addFrameTap(tap, fps, width);
+}
+
+void ReadThread::removeFrameTap(FrameTap *tap)
+{
+    m_videoDecode->removeFrameTap(tap);
+}
+
+/**
+ * @brief         设置解码后的滤镜，预读GOP的解码器使用相同的滤镜，逐帧后退、倒放显示的图像与正常播放一致
+ * @param filters
+ * @param threads
+ */
+void ReadThread::setFilter(const QString &filters, int threads)
+{
+    m_videoDecode->setFilter(filters, threads);
+    m_prefetchDecoder->setFilter(filters, threads);
+}
+
+/**
+ * @brief         启用后正常播放时10/12位视频跳过RGBA转换，发布的VideoFrame中image为空，由OpenGL显示直接上传16位平面；
+ *                逐帧、倒放（GOP缓存）和时移播放仍然使用RGBA图像
+ * @param enabled
+ */
+void ReadThread::setHighBitDepthOutput(bool enabled)
+{
+    m_highBitDepth.storeRelease(enabled ? 1 : 0);
+}
+
+FrameBus *ReadThread::frameBus()
+{
+    return m_frameBus;
+}
+
+/**
+ * @brief 显示的图像来自GOP缓存时解码器中的帧不是当前帧，直接保存显示的图像；否则导出解码器中最后一帧
+ */
+void ReadThread::updateSnapshot()
+{
+    m_requestMutex.lock();
+    QString fileName = m_snapshotFile;
+    m_snapshotFile.clear();
+    m_requestMutex.unlock();
+    if(fileName.isEmpty()) return;
+
+    bool ok = m_resync ? m_exporter->exportImage(m_displayImage, fileName)
+                       : m_exporter->exportFrame(m_videoDecode->frame(), fileName);
+    if(!ok)
+    {
+        qWarning() << "截图失败（没有图像或者编码队列已满）：" << fileName;
+    }
+}
+
+/**
+ * @brief 解码器只能在读取线程中使用，所以录制请求先保存下来，在这里统一处理
+ */
+void ReadThread::updateRecord()
+{
+    QMutexLocker locker(&m_requestMutex);
+    if(!m_recordChanged) return;
+    m_recordChanged = false;
+
+    if(m_recordFile.isEmpty())
+    {
+        m_videoDecode->stopRecord();
+        emit recordState(false);
+    }
+    else if(!m_videoDecode->startRecord(m_recorder, m_recordFile))
+    {
+        qWarning() << "开始录制失败：" << m_recordFile;
+        m_recordFile.clear();
+        emit recordState(false);
+    }
+    else
+    {
+        emit recordState(true);
+    }
+}
+
+
+
+
+/**
+ * @brief         添加控制命令并唤醒读取线程
+ * @param command
+ */
+void ReadThread::postCommand(CommandType command)
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_commands.enqueue(Command{command, m_commandClock.elapsed()});
+    m_requestCondition.wakeAll();
+}
+
+/**
+ * @brief 其它请求（跳转、逐帧等）保存后调用，唤醒暂停中等待的读取线程，调用前需要加锁
+ */
+void ReadThread::wakeRequest()
+{
+    m_requestWake = true;
+    m_requestCondition.wakeAll();
+}
+
+/**
+ * @brief            代替定时器延时：最多等待msec毫秒，收到控制命令时立即返回（anyRequest为true时收到任何请求都返回），
+ *                   返回前在读取线程中执行收到的命令，这样停止、暂停不需要等到延时结束
+ * @param msec       小于等于0时不等待，只执行已经收到的命令
+ * @param anyRequest
+ */
+void ReadThread::waitCommand(int msec, bool anyRequest)
 {
-    bool ret = m_videoDecode->open(m_url);         // 打开网络流时会比较慢，如果放到Ui线程会卡
+    QElapsedTimer timer;
+    timer.start();
+    m_requestMutex.lock();
+    while(m_commands.isEmpty() && !(anyRequest && m_requestWake))
+    {
+        qint64 remaining = msec - timer.elapsed();
+        if(remaining <= 0) break;
+        m_requestCondition.wait(&m_requestMutex, ulong(remaining));
+    }
+    if(anyRequest)
+    {
+        m_requestWake = false;
+    }
+    QQueue<Command> commands;
+    commands.swap(m_commands);
+    m_requestMutex.unlock();
+
+    while(!commands.isEmpty())
+    {
+        Command command = commands.dequeue();
+        switch (command.type)
+        {
+        case PauseCommand:   m_pause = true;    break;
+        case ResumeCommand:  m_pause = false;   break;
+        case StopCommand:    m_play = false;  m_pause = false; break;
+        case ReverseCommand: m_reverse = true;  break;
+        case ForwardCommand: m_reverse = false; break;
+        }
+        Metrics::instance()->observe("vedioplay_command_seconds", m_session, (m_commandClock.elapsed() - command.time) / 1000.0);
+    }
+}
+
+/**
+ * @brief 处理回看、回到直播请求，跳转后清空解码器并重新对齐播放时钟
+ */
+void ReadThread::updateTimeShift()
+{
+    QMutexLocker locker(&m_requestMutex);
+    if(m_rewindRequest > 0)
+    {
+        // 回看时间从当前播放位置算起，换算为距离直播的时间
+        qint64 behind = m_timeShift->liveTime() - m_videoDecode->pts() + m_rewindRequest;
+        m_position = m_timeShift->seekPosition(behind);
+        m_rewindRequest = 0;
+        m_skipUntil = -1;
+    }
+    else if(m_liveRequest)
+    {
+        // 只能从关键帧开始解码，关键帧到最新帧之间的图像只解码不显示
+        m_position = m_timeShift->livePosition();
+        m_skipUntil = m_timeShift->liveTime();
+        m_liveRequest = false;
+    }
+    else
+    {
+        return;
+    }
+    m_videoDecode->flush();
+    m_clockReset = true;
+}
+
+/**
+ * @brief  时移模式：每次先读取一个直播数据包存入时移缓冲（暂停时也一直读取），
+ *         再从时移缓冲的播放位置取出一个数据包解码显示
+ * @return 直播已经结束并且缓冲中的数据已经播放完时返回false
+ */
+bool ReadThread::readTimeShift()
+{
+    updateTimeShift();
+    if(!m_readEnd && !m_videoDecode->readPacket())
+    {
+        m_readEnd = true;
+    }
+    if(m_pause)
+    {
+        m_clockReset = true;                          // 继续播放时从当前帧重新计时
+        if(m_readEnd) waitCommand(200, true);
+        return true;
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    TimeShiftBuffer::ReadResult ret = m_timeShift->read(&m_position, packet);
+    if(ret == TimeShiftBuffer::Discontinuity)
+    {
+        m_videoDecode->flush();                       // 播放位置已经被淘汰，从最早的关键帧继续
+        m_clockReset = true;
+    }
+    else if(ret == TimeShiftBuffer::ReadOk)
+    {
+        QImage image = m_videoDecode->decode(packet);
+        // 回到直播时，追上直播之前的图像不显示
+        if(!image.isNull() && (m_skipUntil < 0 || m_videoDecode->pts() >= m_skipUntil))
+        {
+            m_skipUntil = -1;
+            showImage(image);
+        }
+    }
+    av_packet_free(&packet);
+    return !(ret == TimeShiftBuffer::NoData && m_readEnd);
+}
+
+/**
+ * @brief       按照视频时间控制1倍速播放并发送图像
+ * @param image
+ */
+void ReadThread::showImage(const QImage &image)
+{
+    qint64 pts = m_videoDecode->pts();
+    if(m_clockReset)
+    {
+        m_clockBase = pts;
+        m_etime1.restart();
+        m_clockReset = false;
+    }
+    qint64 wait = qint64((pts - m_clockBase) / m_speed) - m_etime1.elapsed();   // 按倍速计算显示时间
+    if(!m_hidden)
+    {
+        updateFrameSkip(-wait, pts);
+    }
+    if(-wait > LATE_FRAME)
+    {
+        Metrics::instance()->add("vedioplay_late_frames_total", m_session);
+    }
+    waitCommand(int(wait));
+    if(!m_play) return;                           // 等待时收到了停止命令
+    m_displayPts = pts;
+    if(m_hidden) return;                          // 没有可见的显示，只保持播放进度
+    publish(image, pts);
+    emit updateImage(image);                      // read()每次返回新的图像，不需要再拷贝
+    Metrics::instance()->add("vedioplay_displayed_frames_total", m_session);
+}
+
+/**
+ * @brief 没有可见的显示（所有订阅者都不活动，也没有连接updateImage信号）时不转换、不发布；没有分析接口时只解码关键帧，
+ *        保持连接和播放进度。恢复可见时本地文件跳转回当前位置重新解码，直播流立即显示最后解码的关键帧，之后从下一个关键帧继续
+ */
+void ReadThread::updateVisibility()
+{
+    bool hidden = m_decode && m_frameBus->activeSubscriberCount() == 0
+                  && !isSignalConnected(QMetaMethod::fromSignal(&ReadThread::updateImage));
+    if(hidden)
+    {
+        if(!m_videoDecode->hasFrameTaps() && m_videoDecode->frameSkip() != VideoDecoder::SkipNonKey)
+        {
+            m_videoDecode->setFrameSkip(VideoDecoder::SkipNonKey);   // 暂停、倍速变化后会被重置，这里重新设置
+        }
+        if(!m_hidden)
+        {
+            qDebug() << "没有可见的显示，降低解码开销：" << m_url;
+        }
+        m_hidden = true;
+        return;
+    }
+    if(!m_hidden) return;
+
+    m_hidden = false;
+    bool keyOnly = m_videoDecode->frameSkip() == VideoDecoder::SkipNonKey;
+    m_videoDecode->setFrameSkip(VideoDecoder::SkipNone);
+    m_lateAverage = 0;
+    m_lastKeyPts = -1;
+    qDebug() << "恢复显示：" << m_url;
+    if(!keyOnly) return;                          // 有分析接口时一直解码全部帧，可以直接继续
+    if(m_videoDecode->totalTime() > 0)
+    {
+        m_resync = m_displayPts >= 0;             // 从前一个关键帧解码到当前位置
+        return;
+    }
+    if(m_videoDecode->frame())
+    {
+        displayImage(m_videoDecode->convert(), m_videoDecode->pts());
+    }
+    m_waitKey = true;
+}
+
+/**
+ * @brief          定期更新队列深度、丢帧数和会话内存占用（这些值需要遍历订阅者、加锁，不每帧统计）
+ * @param timeShift 是否正在从时移缓冲播放，这时统计读取位置落后缓冲末尾的数据包数
+ */
+void ReadThread::updateMetrics(bool timeShift)
+{
+    if(m_metricsTimer.isValid() && m_metricsTimer.elapsed() < METRICS_INTERVAL) return;
+    m_metricsTimer.start();
+
+    int pending = 0;
+    qint64 dropped = 0;
+    m_frameBus->statistics(&pending, &dropped);
+    Metrics* metrics = Metrics::instance();
+    metrics->set("vedioplay_frame_queue_depth", m_session, pending);
+    metrics->set("vedioplay_dropped_frames_total", m_session, dropped);
+    metrics->set("vedioplay_record_queue_depth", m_session, m_recorder->queueSize());
+    metrics->set("vedioplay_timeshift_packets", m_session, m_timeShift->packetCount());
+    metrics->set("vedioplay_timeshift_backlog", m_session, timeShift ? qMax<qint64>(0, m_timeShift->endPosition() - m_position) : 0);
+    metrics->set("vedioplay_session_memory_bytes", m_session, MemoryBudget::instance()->sessionUsage(m_session));
+}
+
+/**
+ * @brief       图像和解码帧只增加引用后发布，所有订阅者共享同一份数据；显示的图像来自GOP缓存时没有解码帧
+ * @param image
+ * @param pts
+ */
+void ReadThread::publish(const QImage &image, qint64 pts)
+{
+    if(m_frameBus->activeSubscriberCount() == 0) return;
+
+    VideoFrame frame;
+    frame.image = image;
+    frame.pts = pts;
+    frame.stream = m_session;
+    frame.published = Tracer::isEnabled() ? Tracer::now() : -1;   // 订阅者取出时记录信号跨线程的耗时
+    const AVFrame* decoded = m_resync ? nullptr : m_videoDecode->frame();
+    AVFrame* ref = decoded ? av_frame_clone(decoded) : nullptr;
+    if(ref)
+    {
+        frame.frame = QSharedPointer<AVFrame>(ref, [](AVFrame* f) { av_frame_free(&f); });
+    }
+    m_frameBus->publish(frame);
+}
+
+/**
+ * @brief 处理倍速请求，重新对齐播放时钟，并从解码全部帧开始重新判断跳帧模式
+ */
+void ReadThread::updateSpeed()
+{
+    m_requestMutex.lock();
+    qreal speed = m_speedRequest;
+    m_speedRequest = 0;
+    m_requestMutex.unlock();
+    if(speed <= 0) return;
+
+    m_speed = speed;
+    m_clockReset = true;
+    m_lateAverage = 0;
+    m_lastKeyPts = -1;
+    m_videoDecode->setFrameSkip(VideoDecoder::SkipNone);
+}
+
+/**
+ * @brief      高倍速时如果显示持续落后，依次切换为跳过非参考帧、只解码关键帧；
+ *             只解码关键帧时如果关键帧比显示需要的密很多，直接跳转到下一个需要显示的位置，保证每显示一帧的开销有上限
+ * @param late 当前帧显示落后的时间（毫秒），提前时为负数
+ * @param pts  当前帧时间
+ */
+void ReadThread::updateFrameSkip(qint64 late, qint64 pts)
+{
+    VideoDecoder::FrameSkip skip = m_videoDecode->frameSkip();
+    if(m_speed <= 1.0)
+    {
+        return;                                       // 1倍速及以下不跳帧
+    }
+    m_lateAverage = (m_lateAverage * 7 + late) / 8;
+    if(m_lateAverage > 100 && skip != VideoDecoder::SkipNonKey)
+    {
+        skip = VideoDecoder::FrameSkip(skip + 1);
+        m_videoDecode->setFrameSkip(skip);
+        m_lateAverage = 0;
+        m_lastKeyPts = -1;
+        m_clockReset = true;                          // 不追赶已经落后的时间
+        qDebug() << QString("解码跟不上%1倍速，跳帧模式：%2").arg(m_speed).arg(int(skip));
+    }
+    if(skip != VideoDecoder::SkipNonKey || m_videoDecode->totalTime() <= 0)
+    {
+        return;                                       // 网络流不能跳转
+    }
+    if(m_lastKeyPts >= 0 && pts > m_lastKeyPts)
+    {
+        m_keyInterval = pts - m_lastKeyPts;
+    }
+    m_lastKeyPts = pts;
+    qint64 step = qint64(m_speed * 1000 / MAX_DISPLAY_FPS);   // 两次显示之间视频前进的时间
+    if(m_keyInterval > 0 && step > 2 * m_keyInterval && m_videoDecode->seek(pts + step, false))
+    {
+        m_lastKeyPts = -1;                            // 跳转后的间隔不是关键帧间隔
+    }
+}
+
+/**
+ * @brief       逐帧、倒放时直接发送图像，不控制速度
+ * @param image 已经拷贝过的图像
+ * @param pts
+ */
+void ReadThread::displayImage(const QImage &image, qint64 pts)
+{
+    m_displayPts = pts;
+    m_displayImage = image;
+    publish(image, pts);
+    emit updateImage(image);
+}
+
+/**
+ * @brief 处理跳转请求。播放时解码器直接跳转，目标时间之前的图像不显示；
+ *        暂停时只记录位置，由nextFrame显示目标位置的一帧
+ */
+void ReadThread::updateSeek()
+{
+    m_requestMutex.lock();
+    qint64 msec = m_seekRequest;
+    m_seekRequest = -1;
+    m_requestMutex.unlock();
+    if(msec < 0) return;
+
+    if(m_pause)
+    {
+        m_displayPts = msec - 1;
+        m_resync = true;
+        qint64 pts;
+        QImage image;
+        if(nextFrame(&pts, &image))
+        {
+            displayImage(image, pts);
+        }
+    }
+    else if(m_videoDecode->seek(msec))
+    {
+        m_skipUntil = msec;
+        m_resync = false;
+        m_clockReset = true;
+    }
+}
+
+/**
+ * @brief  每次处理一个逐帧请求
+ * @return 没有请求时返回false
+ */
+bool ReadThread::updateStep()
+{
+    m_requestMutex.lock();
+    int step = m_stepRequest;
+    if(step > 0) m_stepRequest--;
+    if(step < 0) m_stepRequest++;
+    m_requestMutex.unlock();
+    if(step == 0) return false;
+
+    qint64 pts;
+    QImage image;
+    bool ok = (step > 0) ? nextFrame(&pts, &image) : previousFrame(&pts, &image);
+    if(ok)
+    {
+        displayImage(image, pts);
+    }
+    return true;
+}
+
+/**
+ * @brief       获取当前显示帧的下一帧。解码器位置正确时直接解码下一帧；
+ *              显示的图像来自缓存时先查找缓存，没有再让解码器跳转到当前位置
+ * @param pts
+ * @param image
+ * @return
+ */
+bool ReadThread::nextFrame(qint64 *pts, QImage *image)
+{
+    if(m_resync)
+    {
+        if(m_gopCache->frameAfter(m_displayPts, pts, image))
+        {
+            return true;
+        }
+        m_videoDecode->seek(m_displayPts);
+        m_resync = false;
+    }
+    for(int i = 0; i < 5000; i++)          // 防止跳转后一直读取不到图像
+    {
+        QImage frame = m_videoDecode->read();
+        if(frame.isNull())
+        {
+            if(m_videoDecode->isEnd()) return false;
+            continue;
+        }
+        if(m_videoDecode->pts() <= m_displayPts) continue;   // 跳转到关键帧后，当前位置之前的帧不显示
+        *pts = m_videoDecode->pts();
+        *image = frame;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief       获取当前显示帧的上一帧，缓存中没有时解码当前GOP（当前帧是GOP第一帧时解码前一个GOP），
+ *              并在后台预读再前一个GOP。当前帧是第一个GOP的第一帧时直接返回false，不再重复解码
+ * @param pts
+ * @param image
+ * @return
+ */
+bool ReadThread::previousFrame(qint64 *pts, QImage *image)
+{
+    if(m_videoDecode->totalTime() <= 0 || m_displayPts < 0) return false;   // 网络流不能跳转
+
+    for(int i = 0; i < 3; i++)
+    {
+        if(m_gopCache->frameBefore(m_displayPts, pts, image))
+        {
+            m_resync = true;               // 显示的图像来自缓存，与解码器读取位置无关
+            prefetch(m_gopCache->gopStart(*pts));
+            return true;
+        }
+        if(m_gopCache->isFirst(m_displayPts)) return false;   // 已经到达开头
+        qint64 start = m_gopCache->gopStart(m_displayPts);
+        m_resync = true;                   // 解码GOP会改变解码器读取位置
+        if(!m_gopCache->load(m_videoDecode, start >= 0 ? start - 1 : m_displayPts))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief          使用单独的解码器在后台解码前一个GOP，连续后退时不需要等待解码
+ * @param gopStart 当前GOP的开始时间
+ */
+void ReadThread::prefetch(qint64 gopStart)
+{
+    if(gopStart <= 0 || m_gopCache->contains(gopStart - 1)) return;
+    if(!m_prefetching.testAndSetOrdered(0, 1)) return;    // 正在预读
+
+    QString url = m_url;
+    m_prefetchPool.start([this, url, gopStart]() {
+        if(m_prefetchDecoder->totalTime() > 0 || m_prefetchDecoder->open(url))
+        {
+            m_gopCache->load(m_prefetchDecoder, gopStart - 1);
+        }
+        m_prefetching.storeRelease(0);
+    });
+}
+
+
+void ReadThread::setStandbyPool(StandbyPool *pool)
+{
+    m_standby = pool;
+}
+
+/**
+ * @brief     设置后只使用一次，为空时取消
+ * @param url
+ */
+void ReadThread::setNextUrl(const QString &url)
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_nextUrl = url;
+}
+
+/**
+ * @brief     播放中切换到另一个地址（频道切换），在读取线程中关闭当前输入后打开，待机时可以立即显示；
+ *            正在录制时继续录制，切换后的数据包写入下一个序号的文件
+ * @param url
+ */
+void ReadThread::switchUrl(const QString &url)
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_nextUrl = url;
+    m_switchRequest = true;
+    wakeRequest();
+}
+
+/**
+ * @brief            设置后立即生效：当前地址不在列表中时立即切换到匹配显示分辨率的码流，否则从当前码流开始自动切换。
+ *                   分辨率可以不准确，打开后会用实际分辨率更新
+ * @param renditions
+ */
+void ReadThread::setRenditions(const QList<Rendition> &renditions)
+{
+    QMutexLocker locker(&m_requestMutex);
+    m_renditionRequest = renditions;
+    m_renditionChanged = true;
+    wakeRequest();
+}
+
+/**
+ * @brief 打开之前应用码流列表：地址为空或在列表中时按当前显示分辨率选择，显示分辨率未知时使用指定的地址（为空时使用第一个）
+ */
+void ReadThread::selectRendition()
+{
+    m_requestMutex.lock();
+    if(m_renditionChanged)
+    {
+        m_renditions.setRenditions(m_renditionRequest);
+        m_renditionChanged = false;
+    }
+    m_requestMutex.unlock();
+    m_renditionTarget = -1;
+    m_renditionRetry = 0;
+    if(m_renditions.isEmpty()) return;
+
+    int index = m_renditions.indexOf(m_url);
+    if(index < 0 && !m_url.isEmpty()) return;     // 播放的不是这一路视频
+    int best = m_renditions.best(m_frameBus->displaySize());
+    m_url = m_renditions.url(best >= 0 ? best : qMax(0, index));
+}
+
+/**
+ * @brief           目标码流需要在后台打开并缓存到关键帧后才切换，准备期间继续播放当前码流；
+ *                  时移时缓冲中的数据包属于当前码流，录制时保持录制的清晰度，暂停、倒放时也不切换；
+ *                  频道切换（当前地址不在列表中）时录制写入下一个文件继续
+ * @param timeShift
+ * @return
+ */
+bool ReadThread::updateRendition(bool *timeShift)
+{
+    m_requestMutex.lock();
+    bool changed = m_renditionChanged;
+    m_renditionChanged = false;
+    if(changed)
+    {
+        m_renditions.setRenditions(m_renditionRequest);
+    }
+    bool recording = !m_recordFile.isEmpty();
+    m_requestMutex.unlock();
+    if(changed)
+    {
+        cancelRendition();
+        m_renditionRetry = 0;
+        int index = m_renditions.indexOf(m_url);
+        m_renditions.setCurrent(index);
+        if(index < 0 && !m_renditions.isEmpty())
+        {
+            int best = m_renditions.best(m_frameBus->displaySize());
+            return switchRendition(qMax(0, best), false, timeShift);   // 另一路视频，相当于切换频道
+        }
+    }
+    if(m_renditions.current() < 0) return false;
+    if(*timeShift || recording || m_pause || m_reverse)
+    {
+        cancelRendition();
+        return false;
+    }
+
+    int target = m_renditions.update(m_frameBus->displaySize());
+    if(target == m_renditions.current())
+    {
+        cancelRendition();                         // 显示大小又变回来了
+        return false;
+    }
+    qint64 now = m_commandClock.elapsed();
+    const QString& url = m_renditions.url(target);
+    if(target != m_renditionTarget)
+    {
+        if(now < m_renditionRetry) return false;
+        m_renditionTarget = target;
+        m_renditionDeadline = now + RENDITION_TIMEOUT;
+        m_renditionStandby->prepare({url});
+        qDebug() << QString("准备切换码流：%1 -> %2").arg(m_url, url);
+    }
+    if(!m_renditionStandby->hasKeyFrame(url))
+    {
+        if(now > m_renditionDeadline)
+        {
+            qWarning() << "准备码流超时：" << url;
+            cancelRendition();
+            m_renditionRetry = now + RENDITION_TIMEOUT;
+        }
+        return false;
+    }
+    return switchRendition(target, true, timeShift);
+}
+
+/**
+ * @brief              接管已经缓存了关键帧的目标码流：直播流不显示缓存的关键帧（比当前画面早），继续显示原来码流的最后一帧，
+ *                     缓存帧只解码，追到缓存结束的位置（时间戳与原来的码流一致时还要超过已经显示的位置）后再显示，画面不后退；
+ *                     本地文件跳转回当前播放位置。打开失败时恢复原来的码流（不计为切换），都失败时结束播放
+ * @param index
+ * @param keepPosition 同一路视频的码流之间切换
+ * @param timeShift
+ * @return
+ */
+bool ReadThread::switchRendition(int index, bool keepPosition, bool *timeShift)
+{
+    QString previous = m_url;
+    qint64 shown = m_displayPts;                   // 切换前显示的位置
+    qint64 position = (keepPosition && m_videoDecode->totalTime() > 0) ? m_displayPts : -1;
+    m_renditionTarget = -1;                        // 接管后待机池中不再有这个码流
+    m_videoDecode->closeInput();                   // 正在录制时切换后写入下一个文件
+    m_prefetchPool.waitForDone();
+    m_prefetchDecoder->close();                    // 预读解码器打开的是原来的码流
+    m_url = m_renditions.url(index);
+    bool ok = openVideo(timeShift);
+    if(!ok && keepPosition)
+    {
+        m_renditionRetry = m_commandClock.elapsed() + RENDITION_TIMEOUT;
+        m_url = previous;
+        ok = openVideo(timeShift);
+    }
+    if(!ok)
+    {
+        m_play = false;
+        return true;
+    }
+    if(position >= 0 && m_videoDecode->seek(position))
+    {
+        m_skipUntil = position + 1;                // 当前位置的一帧已经显示过
+        m_clockReset = true;
+    }
+    if(m_url == previous)
+    {
+        qWarning() << "打开码流失败，继续播放原来的码流：" << m_renditions.url(index);
+        return true;
+    }
+    if(keepPosition && m_standbyCatchUp)
+    {
+        m_standbyFirst = false;
+        if(shown >= 0 && qAbs(m_skipUntil - shown) < RENDITION_TIMEOUT)   // 不同码流的时间戳可能不是同一个时钟，相差太大时只追到缓存结束
+        {
+            m_skipUntil = qMax(m_skipUntil, shown + 1);
+        }
+    }
+    Metrics::instance()->add("vedioplay_rendition_switches_total", m_session);
+    qDebug() << "切换码流：" << m_url << m_videoDecode->videoSize();
+    return true;
+}
+
+void ReadThread::cancelRendition()
+{
+    if(m_renditionTarget < 0) return;
+    m_renditionTarget = -1;
+    m_renditionStandby->prepare(QStringList());
+}
+
+/**
+ * @brief           在读取线程中处理切换请求
+ * @param timeShift
+ * @return          处理了切换请求时返回true
+ */
+bool ReadThread::updateSwitch(bool *timeShift)
+{
+    m_requestMutex.lock();
+    bool request = m_switchRequest;
+    m_switchRequest = false;
+    m_requestMutex.unlock();
+    if(!request) return false;
+
+    if(!openNext(timeShift))
+    {
+        m_play = false;                            // 打开失败时结束播放
+    }
+    return true;
+}
+
+/**
+ * @brief           打开m_url：待机会话中已经打开时直接接管（不需要连接、探测、等待关键帧），否则重新打开
+ * @param timeShift 返回本次播放是否使用时移
+ * @return
+ */
+bool ReadThread::openVideo(bool *timeShift)
+{
+    *timeShift = false;
+    bool ret = false;
+    bool warm = false;                             // 是否接管了待机会话
+    QElapsedTimer openTimer;
+    openTimer.start();
+    Metrics* metrics = Metrics::instance();
+    metrics->setSessionUrl(m_session, m_url);
+    if(m_url == m_openedUrl)
+    {
+        metrics->add("vedioplay_reconnects_total", m_session);   // 同一地址再次打开（断线重连）
+    }
+    m_openedUrl = m_url;
+    VideoDecoder* standby = m_standby ? m_standby->take(m_url) : nullptr;
+    if(!standby)
+    {
+        standby = m_renditionStandby->take(m_url);   // 准备切换的码流
+    }
+    if(standby)
+    {
+        ret = warm = m_videoDecode->takeOver(standby);
+        delete standby;
+    }
+    if(!ret)
+    {
+        ret = m_videoDecode->open(m_url);         // 打开网络流时会比较慢，如果放到Ui线程会卡
+    }
     if(ret)
     {
+        m_videoDecode->setDecodeEnabled(m_decode);
+        *timeShift = m_timeShiftEnabled && m_decode && m_videoDecode->startTimeShift(m_timeShift);
+        if(*timeShift)
+        {
+            m_position = m_timeShift->endPosition();
+            m_readEnd = false;
+            m_skipUntil = -1;
+            m_clockReset = true;
+        }
+        m_gopCache->clear();
+        m_displayPts = -1;
+        m_resync = false;
+        m_skipUntil = -1;
+        m_clockReset = true;
+        m_standbyFirst = false;
+        m_standbyCatchUp = false;
+        m_waitKey = false;
+        if(warm && !*timeShift && m_videoDecode->totalTime() <= 0 && m_videoDecode->prerollEnd() >= 0)
+        {
+            // 直播流的缓存从最近的关键帧开始：关键帧立即显示，其余缓存帧只解码，追到缓存结束的位置
+            m_skipUntil = m_videoDecode->prerollEnd();
+            m_standbyFirst = true;
+            m_standbyCatchUp = true;
+        }
         m_play = true;
         m_etime1.start();
         //m_etime2.start();
+        metrics->observe("vedioplay_open_seconds", m_session, openTimer.nsecsElapsed() / 1e9);
+        metrics->add("vedioplay_opens_total", m_session);
+        if(warm)
+        {
+            metrics->add("vedioplay_standby_opens_total", m_session);
+        }
+        metrics->set("vedioplay_stream_fps", m_session, m_videoDecode->frameRate());
+        int rendition = m_renditions.indexOf(m_url);
+        m_renditions.setCurrent(rendition);       // 不在码流列表中时不自动切换
+        m_renditions.setSize(rendition, m_videoDecode->videoSize());
+        m_requestMutex.lock();
+        if(!m_recordFile.isEmpty() && !m_recordChanged && !m_videoDecode->isRecording())
+        {
+            m_recordFile.clear();                 // 新的输入不能继续录制（如没有可以录制的流）
+            emit recordState(false);
+        }
+        m_requestMutex.unlock();
+        m_metricsTimer.invalidate();
         emit playState(play);
     }
     else
     {
+        metrics->add("vedioplay_open_failures_total", m_session);
         qWarning() << "打开失败！";
     }
+    return ret;
+}
+
+/**
+ * @brief           本地文件播放结束后，切换到setNextUrl设置的下一项，播放线程不退出
+ * @param timeShift
+ * @return          没有下一项或打开失败时返回false
+ */
+bool ReadThread::openNext(bool *timeShift)
+{
+    m_requestMutex.lock();
+    QString url = m_nextUrl;
+    m_nextUrl.clear();
+    m_requestMutex.unlock();
+    if(url.isEmpty()) return false;
+
+    cancelRendition();
+    m_videoDecode->closeInput();                   // 正在录制时切换后写入下一个文件
+    m_prefetchPool.waitForDone();
+    m_prefetchDecoder->close();                    // 预读解码器打开的是上一个文件
+    m_url = url;
+    return openVideo(timeShift);
+}
+
+void ReadThread::run()
+{
+    bool timeShift = false;                        // 本次播放是否使用时移
+    selectRendition();
+    openVideo(&timeShift);
     // 循环读取视频图像
     while (m_play)
     {
-        // 暂停
-        while (m_pause)
+        waitCommand(0);
+        if(!m_play) break;
+        updateRecord();
+        updateSpeed();
+        updateSnapshot();
+        updateMetrics(timeShift);                  // 按间隔更新，不可见时也统计
+        if(updateSwitch(&timeShift)) continue;
+        if(updateRendition(&timeShift)) continue;
+        if(timeShift)
+        {
+            if(!readTimeShift()) break;
+            continue;
+        }
+        // 暂停，暂停时可以逐帧前进、后退和跳转
+        while (m_pause && m_play)
+        {
+            m_videoDecode->setFrameSkip(VideoDecoder::SkipNone);   // 逐帧时需要解码全部帧
+            updateSeek();
+            updateSnapshot();
+            if(!updateStep())
+            {
+                waitCommand(200, true);        // 暂停时等待命令或请求，收到后立即处理
+            }
+            m_clockReset = true;               // 继续播放时从当前帧重新计时
+        }
+        updateSeek();
+        updateVisibility();
+        // 倒放
+        if(m_reverse)
         {
-            sleepMsec(200);
+            qint64 pts;
+            QImage image;
+            qint64 last = m_displayPts;
+            m_videoDecode->setFrameSkip(VideoDecoder::SkipNone);
+            if(!previousFrame(&pts, &image))
+            {
+                m_reverse = false;             // 已经到达开头，停止倒放并暂停，继续时正向播放
+                m_pause = true;
+                emit reverseFinished();
+                continue;
+            }
+            waitCommand(int(qMin(last - pts, qint64(200)) / m_speed - m_etime1.restart()));   // 按帧间隔和倍速后退
+            if(!m_play || m_pause) continue;
+            displayImage(image, pts);
+            m_clockReset = true;
+            continue;
         }
-        QImage image = m_videoDecode->read();  // 读取视频图像
-        if(!image.isNull())
+        // 逐帧或倒放后，解码器需要跳转回当前显示的位置
+        if(m_resync)
         {
-            // 1倍速播放
-#if 1
-            sleepMsec(int(m_videoDecode->pts() - m_etime1.elapsed()));         // 不支持后退
-#else
-            sleepMsec(int(m_videoDecode->pts() - m_etime2.elapsed()));         // 支持后退（如果能读取到视频，但一直不显示可以把这一行代码注释试试）
-#endif
-            // emit updateImage(image);
-            emit updateImage(image.copy());
+            m_videoDecode->seek(m_displayPts);
+            m_skipUntil = m_displayPts + 1;
+            m_resync = false;
+            m_clockReset = true;
+        }
+        const AVFrame* decoded = m_videoDecode->readFrame();   // 读取视频帧，需要显示时才转换为图像
+        if(decoded)
+        {
+            if(m_skipUntil >= 0 && m_videoDecode->pts() < m_skipUntil)
+            {
+                if(!m_standbyFirst) continue;  // 跳转到关键帧后，目标位置之前的图像只解码不显示
+                m_standbyFirst = false;        // 切换频道时先显示待机缓存的关键帧，之后的缓存帧只解码，追到直播位置
+            }
+            else
+            {
+                if(m_skipUntil >= 0 && m_standbyCatchUp)
+                {
+                    m_standbyCatchUp = false;
+                    m_clockReset = true;       // 从关键帧追到最新的一帧，不按缓存帧的时间等待
+                }
+                m_skipUntil = -1;
+            }
+            if(m_waitKey)
+            {
+                if(!m_videoDecode->isKeyFrame()) continue;   // 恢复显示后，下一个关键帧之前的帧参考了跳过的帧，不显示
+                m_waitKey = false;
+            }
+            // 倍速播放时所有跳帧模式都限制显示帧率，两次显示之间的帧只解码，不转换、不发送
+            qint64 interval = qint64(m_speed * 1000 / MAX_DISPLAY_FPS);
+            qint64 pts = m_videoDecode->pts();
+            if(m_speed > 1.0 && m_displayPts >= 0 && pts > m_displayPts && pts - m_displayPts < interval) continue;
+            bool native = m_highBitDepth.loadAcquire() && VideoDecoder::isHighBitDepth(decoded)
+                          && !m_frameBus->imageRequired();   // 拼接窗口等只能显示RGBA图像的订阅者需要转换
+            // 1倍速播放（不可见时不转换，只按时间等待）
+            showImage((native || m_hidden) ? QImage() : m_videoDecode->convert());
         }
         else
         {
             // 当前读取到无效图像时判断是否读取完成
             if(m_videoDecode->isEnd())
             {
+                if(openNext(&timeShift)) continue;   // 播放列表的下一项（已经待机时没有间隔）
                 break;
             }
-            sleepMsec(1);   // 这里不能使用QThread::msleep()延时，否则会很不稳定
+            if(!m_decode) continue;   // 只录制时av_read_frame本身就会等待数据，不需要延时
+            waitCommand(1);   // 这里不能使用QThread::msleep()延时，否则停止、暂停时不能及时响应
         }
     }
     qDebug() << "播放结束！";
-    m_videoDecode->close();
+    cancelRendition();
+    m_videoDecode->close();                        // 关闭时会同时停止录制
+    m_prefetchPool.waitForDone();
+    m_prefetchDecoder->close();
+    m_requestMutex.lock();
+    m_recordFile.clear();
+    m_recordChanged = false;
+    m_rewindRequest = 0;
+    m_liveRequest = false;
+    m_seekRequest = -1;
+    m_stepRequest = 0;
+    m_snapshotFile.clear();
+    m_commands.clear();
+    m_requestWake = false;
+    m_switchRequest = false;
+    m_requestMutex.unlock();
+    m_play = false;
+    m_pause = false;
+    m_displayImage = QImage();
     emit playState(end);
 }
 
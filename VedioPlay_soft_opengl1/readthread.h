@@ -1,11 +1,25 @@
 #ifndef READTHREAD_H
 #define READTHREAD_H
 
+#include <QAtomicInt>
 #include <QElapsedTimer>
+#include <QImage>
+#include <QMutex>
+#include <QQueue>
 #include <QThread>
+#include <QThreadPool>
 #include <QTime>
+#include <QWaitCondition>
+#include "renditionselector.h"
 
 class VideoDecoder;
+class PacketRecorder;
+class TimeShiftBuffer;
+class GopCache;
+class FrameExporter;
+class FrameTap;
+class FrameBus;
+class StandbyPool;
 
 class ReadThread : public QThread
 {
@@ -23,21 +37,150 @@ public:
     void pause(bool flag);                      // 暂停视频
     void close();                               // 关闭视频
     const QString& url();                       // 获取打开的视频地址
+    int  session() const;                       // 内存预算、运行指标中的播放会话编号
+    bool startRecord(const QString& fileName);  // 开始录制（直接封装数据包，不重新编码），没有在播放时返回false
+    void stopRecord();                          // 停止录制
+    void setDecodeEnabled(bool enabled);        // 是否解码显示，关闭后只录制（需要在open之前设置）
+    PacketRecorder* recorder();                 // 录制器，用于设置分段参数
+    void setTimeShiftEnabled(bool enabled);     // 是否开启时移（需要在open之前设置）
+    void rewind(qint64 msec);                   // 时移回看：从当前位置后退msec毫秒
+    void goLive();                              // 时移回到直播
+    void exportClip(const QString& fileName, qint64 msec);  // 导出最近msec毫秒的视频（后台线程执行）
+    TimeShiftBuffer* timeShift();               // 时移缓冲，用于设置内存预算和时长
+    void seek(qint64 msec);                     // 跳转到指定时间（本地文件）
+    void stepForward();                         // 暂停时前进一帧
+    void stepBackward();                        // 暂停时后退一帧（本地文件）
+    void setReverse(bool reverse);              // 倒放（本地文件）
+    GopCache* gopCache();                       // 逐帧后退使用的GOP缓存，用于设置内存预算和保存方式
+    void setSpeed(qreal speed);                 // 设置播放倍速（0.25~32）
+    void snapshot(const QString& fileName);     // 保存当前显示的一帧（后台编码，.png/.jpg/.webp）
+    void exportFrames(const QString& dir, qint64 msec);   // 导出从当前位置开始msec毫秒内的所有帧（本地文件）
+    FrameExporter* exporter();                  // 截图、导出帧使用的编码线程池
+    void addFrameTap(FrameTap* tap, qreal fps = 5, int width = 320);   // 注册分析接口（运动检测等）
+    void removeFrameTap(FrameTap* tap);
+    void setFilter(const QString& filters, int threads = 2);   // 解码后的libavfilter滤镜（如"yadif"），为空时关闭
+    void setHighBitDepthOutput(bool enabled);   // 高位深视频不转换为RGBA，只发布解码帧（PlayImage支持；有需要RGBA图像的订阅者时仍然转换）
+    FrameBus* frameBus();                       // 帧总线，多个显示窗口、分析等订阅同一路解码
+    void setStandbyPool(StandbyPool* pool);     // 打开时优先接管待机会话中已经打开的解码器
+    void setNextUrl(const QString& url);        // 播放列表的下一项，本地文件结束时直接切换，不结束播放
+    void switchUrl(const QString& url);         // 播放中立即切换到另一个地址（频道切换）
+    void setRenditions(const QList<Rendition>& renditions);   // 同一路视频的多个码流（主码流、子码流），按显示分辨率自动切换，为空时关闭
 
 protected:
     void run() override;
 
+private:
+    enum CommandType    // 控制命令，由读取线程按顺序执行
+    {
+        PauseCommand,
+        ResumeCommand,
+        StopCommand,
+        ReverseCommand,
+        ForwardCommand
+    };
+    struct Command
+    {
+        CommandType type;
+        qint64 time;                            // 发送时间（m_commandClock），用于统计响应延时
+    };
+    void postCommand(CommandType command);      // 添加控制命令并唤醒读取线程
+    void wakeRequest();                         // 保存其它请求后唤醒读取线程（需要加锁）
+    void waitCommand(int msec, bool anyRequest = false);   // 等待并执行控制命令，代替定时器延时
+
+private:
+    void updateRecord();                        // 在读取线程中处理开始/停止录制请求
+    void updateTimeShift();                     // 在读取线程中处理回看/回到直播请求
+    bool readTimeShift();                       // 时移模式下读取一次，返回false表示播放结束
+    void showImage(const QImage& image);        // 控制播放速度并发送图像
+    void displayImage(const QImage& image, qint64 pts);   // 直接发送图像（逐帧、倒放）
+    void updateSeek();                          // 在读取线程中处理跳转请求
+    bool updateStep();                          // 在读取线程中处理逐帧请求，没有请求时返回false
+    bool nextFrame(qint64* pts, QImage* image);      // 获取当前显示帧的下一帧
+    bool previousFrame(qint64* pts, QImage* image);  // 获取当前显示帧的上一帧（使用GOP缓存）
+    void prefetch(qint64 gopStart);             // 在后台解码gopStart之前的一个GOP
+    void updateSpeed();                         // 在读取线程中处理倍速请求
+    void updateFrameSkip(qint64 late, qint64 pts);  // 根据显示延时自动切换跳帧模式
+    void updateSnapshot();                      // 在读取线程中处理截图请求
+    void publish(const QImage& image, qint64 pts);   // 把显示的一帧发布到帧总线
+    bool openVideo(bool* timeShift);            // 打开m_url（优先使用待机会话）并初始化播放状态
+    bool openNext(bool* timeShift);             // 文件结束后切换到播放列表的下一项
+    bool updateSwitch(bool* timeShift);         // 在读取线程中处理频道切换请求
+    void updateMetrics(bool timeShift);         // 定期更新队列深度（帧、录制、时移）、丢帧等运行指标
+    void updateVisibility();                    // 根据显示是否可见调整解码（不可见时不转换、只解码关键帧）
+    void selectRendition();                     // 打开之前按显示分辨率选择码流
+    bool updateRendition(bool* timeShift);      // 在读取线程中按显示分辨率准备、切换码流，切换了码流时返回true
+    bool switchRendition(int index, bool keepPosition, bool* timeShift);   // 关闭当前码流，打开（接管）另一个码流
+    void cancelRendition();                     // 停止准备目标码流
+
 signals:
-    void updateImage(const QImage& image);      // 将读取到的视频图像发送出去
+    void updateImage(const QImage& image);      // 将读取到的视频图像发送出去（多个窗口显示时使用frameBus()）
     void playState(PlayState state);            // 视频播放状态发送改变时触发
+    void clipExported(const QString& fileName, bool ok);   // 时移片段导出完成
+    void reverseFinished();                     // 倒放到达开头，已经停止倒放并暂停
+    void recordState(bool recording);           // 录制实际开始、停止（包括开始失败、新的输入不能继续录制）时触发
 
 private:
     VideoDecoder* m_videoDecode = nullptr;       // 视频解码类
     QString m_url;                              // 打开的视频地址
-    bool m_play   = false;                      // 播放控制
+    bool m_play   = false;                      // 播放控制（只在读取线程中修改，其它线程通过命令控制）
     bool m_pause  = false;                      // 暂停控制
     QElapsedTimer m_etime1;                     // 控制视频播放速度（更精确，但不支持视频后退）
     QTime         m_etime2;                     // 控制视频播放速度（支持视频后退）
+    PacketRecorder* m_recorder = nullptr;       // 录制线程
+    QMutex  m_requestMutex;                     // 保护控制命令和各种请求
+    QWaitCondition m_requestCondition;          // 收到命令、请求时唤醒读取线程
+    QQueue<Command> m_commands;                 // 控制命令队列
+    bool    m_requestWake = false;              // 收到了命令以外的请求
+    QElapsedTimer m_commandClock;               // 计算命令响应延时
+    QString m_recordFile;                       // 需要录制的文件名，为空表示不录制
+    bool    m_recordChanged = false;            // 录制状态是否需要改变
+    bool    m_decode = true;                    // 解码控制
+    TimeShiftBuffer* m_timeShift = nullptr;     // 时移缓冲
+    QThreadPool m_exportPool;                   // 导出时移片段的线程（每个播放器单独使用，析构时只等待自己的导出）
+    bool    m_timeShiftEnabled = false;         // 时移控制
+    qint64  m_rewindRequest = 0;                // 回看请求（毫秒），0表示没有请求
+    bool    m_liveRequest = false;              // 回到直播请求
+    qint64  m_position = 0;                     // 时移缓冲读取位置
+    qint64  m_skipUntil = -1;                   // 回到直播时，这个时间之前的图像只解码不显示
+    qint64  m_clockBase = 0;                    // 时移播放时与m_etime1对应的视频时间
+    bool    m_clockReset = false;               // 跳转或暂停后需要重新对齐播放时钟
+    bool    m_readEnd = false;                  // 时移模式下已经无法读取数据包
+    GopCache* m_gopCache = nullptr;             // 解码后的GOP缓存
+    VideoDecoder* m_prefetchDecoder = nullptr;  // 后台预读GOP使用的解码器（只在预读线程中使用）
+    QThreadPool m_prefetchPool;                 // 预读线程，同时只预读一个GOP
+    QAtomicInt m_prefetching = 0;               // 是否正在预读
+    qint64  m_seekRequest = -1;                 // 跳转请求（毫秒），小于0表示没有请求
+    int     m_stepRequest = 0;                  // 逐帧请求，大于0前进，小于0后退
+    bool    m_reverse = false;                  // 倒放控制（只在读取线程中修改）
+    qint64  m_displayPts = -1;                  // 当前显示的图像时间
+    bool    m_resync = false;                   // 显示的图像来自GOP缓存，解码器读取位置需要重新对齐
+    qreal   m_speed = 1.0;                      // 当前播放倍速
+    qreal   m_speedRequest = 0;                 // 倍速请求，小于等于0表示没有请求
+    qint64  m_lateAverage = 0;                  // 显示延时的平均值（毫秒），用于判断解码是否跟得上
+    qint64  m_lastKeyPts = -1;                  // 只解码关键帧时上一个关键帧的时间
+    qint64  m_keyInterval = 0;                  // 关键帧间隔（毫秒）
+    FrameExporter* m_exporter = nullptr;        // 截图、导出帧
+    QString m_snapshotFile;                     // 截图请求，为空表示没有请求
+    QImage  m_displayImage;                     // 逐帧、倒放时显示的图像（来自GOP缓存，截图时使用）
+    FrameBus* m_frameBus = nullptr;             // 帧总线
+    int     m_session = 0;                      // 内存预算中的播放会话
+    QAtomicInt m_highBitDepth = 0;              // 高位深视频只发布解码帧
+    StandbyPool* m_standby = nullptr;           // 待机会话池，为空时每次都重新打开
+    QString m_nextUrl;                          // 播放列表的下一项，为空时文件结束后停止
+    bool    m_switchRequest = false;            // 立即切换到m_nextUrl
+    bool    m_standbyFirst = false;             // 接管的待机会话：缓存的关键帧立即显示
+    bool    m_standbyCatchUp = false;           // 接管的待机会话：缓存的其余帧只解码，追到最新后重新对齐时钟
+    bool    m_hidden = false;                   // 没有可见的显示
+    bool    m_waitKey = false;                  // 直播流恢复显示后等待下一个关键帧
+    QString m_openedUrl;                        // 上一次打开的地址，再次打开同一地址时计为重连
+    QElapsedTimer m_metricsTimer;               // 控制指标更新间隔
+    RenditionSelector m_renditions;             // 码流选择（只在读取线程中使用）
+    QList<Rendition> m_renditionRequest;        // 码流列表请求
+    bool    m_renditionChanged = false;         // 码流列表需要更新
+    StandbyPool* m_renditionStandby = nullptr;  // 在后台打开目标码流并缓存到关键帧，准备好后再切换
+    int     m_renditionTarget = -1;             // 正在准备的码流，-1表示没有
+    qint64  m_renditionDeadline = 0;            // 准备超时的时间（m_commandClock）
+    qint64  m_renditionRetry = 0;               // 准备、打开失败后，这个时间之前不再尝试
 };
 
 #endif // READTHREAD_H
@@ -0,0 +1,194 @@
+#include "renditionselector.h"
+#include <QStringList>
+
+#define SWITCH_UP         1.2     // 当前码流放大超过这个倍数时换大
+#define SWITCH_DOWN       0.8     // 更小的码流缩小到这个倍数以下时换小
+#define SWITCH_UP_DELAY   500     // 换大前显示大小需要稳定的时间（毫秒）
+#define SWITCH_DOWN_DELAY 5000    // 换小前显示大小需要稳定的时间（毫秒）
+
+/**
+ * @brief      每个码流为"地址 宽x高"，码流之间用"|"分隔，如
+ *             "rtsp://cam/main 1920x1080 | rtsp://cam/sub 640x360"；分辨率可以省略，打开后才参与选择
+ * @param text
+ * @return     少于两个码流时返回空（按普通地址播放）
+ */
+QList<Rendition> RenditionSelector::parse(const QString &text)
+{
+    QList<Rendition> renditions;
+    const QStringList items = text.split('|', Qt::SkipEmptyParts);
+    for(const QString& item : items)
+    {
+        QStringList fields = item.split(' ', Qt::SkipEmptyParts);
+        if(fields.isEmpty()) continue;
+        Rendition rendition;
+        rendition.url = fields.at(0);
+        QStringList wh = (fields.size() > 1) ? fields.at(1).split('x') : QStringList();
+        if(wh.size() == 2)
+        {
+            rendition.size = QSize(wh.at(0).toInt(), wh.at(1).toInt());
+        }
+        renditions.append(rendition);
+    }
+    if(renditions.size() < 2)
+    {
+        renditions.clear();
+    }
+    return renditions;
+}
+
+/**
+ * @brief            列表变化后当前码流需要重新设置
+ * @param renditions
+ */
+void RenditionSelector::setRenditions(const QList<Rendition> &renditions)
+{
+    m_renditions = renditions;
+    m_current = -1;
+    m_candidate = -1;
+}
+
+const QList<Rendition> &RenditionSelector::renditions() const
+{
+    return m_renditions;
+}
+
+bool RenditionSelector::isEmpty() const
+{
+    return m_renditions.isEmpty();
+}
+
+int RenditionSelector::indexOf(const QString &url) const
+{
+    for(int i = 0; i < m_renditions.size(); i++)
+    {
+        if(m_renditions.at(i).url == url) return i;
+    }
+    return -1;
+}
+
+const QString &RenditionSelector::url(int index) const
+{
+    return m_renditions.at(index).url;
+}
+
+void RenditionSelector::setCurrent(int index)
+{
+    m_current = (index >= 0 && index < m_renditions.size()) ? index : -1;
+    m_candidate = -1;
+}
+
+int RenditionSelector::current() const
+{
+    return m_current;
+}
+
+void RenditionSelector::setSize(int index, const QSize &size)
+{
+    if(index < 0 || index >= m_renditions.size() || size.isEmpty()) return;
+    m_renditions[index].size = size;
+}
+
+/**
+ * @brief         不需要放大的最小码流；所有码流都需要放大时选择最大的
+ * @param display
+ * @return
+ */
+int RenditionSelector::best(const QSize &display) const
+{
+    if(display.isEmpty()) return -1;
+    int index = smallest(display, 1.0);
+    return (index >= 0) ? index : largest();
+}
+
+/**
+ * @brief         当前码流不够清晰或有更小的码流足够清晰时，目标码流需要持续一段时间才返回；
+ *                显示分辨率未知（没有可见的显示）时保持不变
+ * @param display
+ * @return
+ */
+int RenditionSelector::update(const QSize &display)
+{
+    if(display.isEmpty() || m_current < 0)
+    {
+        m_candidate = -1;
+        return m_current;
+    }
+    const Rendition& current = m_renditions.at(m_current);
+    int target = m_current;
+    qint64 delay = 0;
+    if(current.size.isEmpty() || scale(current, display) > SWITCH_UP)
+    {
+        target = best(display);
+        delay = SWITCH_UP_DELAY;
+    }
+    else
+    {
+        int lower = smallest(display, SWITCH_DOWN);
+        QSize size = (lower >= 0) ? m_renditions.at(lower).size : QSize();
+        if(lower >= 0 && qint64(size.width()) * size.height() < qint64(current.size.width()) * current.size.height())
+        {
+            target = lower;
+            delay = SWITCH_DOWN_DELAY;
+        }
+    }
+    if(target < 0 || target == m_current)
+    {
+        m_candidate = -1;
+        return m_current;
+    }
+    if(target != m_candidate)
+    {
+        m_candidate = target;
+        m_candidateTimer.start();
+    }
+    return (m_candidateTimer.elapsed() >= delay) ? target : m_current;
+}
+
+/**
+ * @brief           显示时等比缩放，宽、高中先到达显示边界的决定倍数
+ * @param rendition
+ * @param display
+ * @return          大于1表示需要放大（不够清晰），分辨率未知时返回-1
+ */
+qreal RenditionSelector::scale(const Rendition &rendition, const QSize &display)
+{
+    if(rendition.size.isEmpty()) return -1;
+    return qMin(qreal(display.width()) / rendition.size.width(), qreal(display.height()) / rendition.size.height());
+}
+
+int RenditionSelector::smallest(const QSize &display, qreal maxScale) const
+{
+    int index = -1;
+    qint64 area = 0;
+    for(int i = 0; i < m_renditions.size(); i++)
+    {
+        const QSize& size = m_renditions.at(i).size;
+        qreal s = scale(m_renditions.at(i), display);
+        if(s < 0 || s > maxScale) continue;
+        qint64 a = qint64(size.width()) * size.height();
+        if(index < 0 || a < area)
+        {
+            index = i;
+            area = a;
+        }
+    }
+    return index;
+}
+
+int RenditionSelector::largest() const
+{
+    int index = -1;
+    qint64 area = 0;
+    for(int i = 0; i < m_renditions.size(); i++)
+    {
+        const QSize& size = m_renditions.at(i).size;
+        if(size.isEmpty()) continue;
+        qint64 a = qint64(size.width()) * size.height();
+        if(a > area)
+        {
+            index = i;
+            area = a;
+        }
+    }
+    return index;
+}
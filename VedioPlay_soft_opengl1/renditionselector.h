@@ -0,0 +1,52 @@
+#ifndef RENDITIONSELECTOR_H
+#define RENDITIONSELECTOR_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QSize>
+#include <QString>
+
+/**
+ * @brief 同一路视频的一个码流（如摄像机的主码流、子码流）
+ */
+struct Rendition
+{
+    QString url;
+    QSize   size;                               // 视频分辨率，打开后用实际分辨率更新
+};
+
+/**
+ * @brief 按显示分辨率选择码流：当前码流被放大超过SWITCH_UP时换成足够清晰的码流，
+ *        更小的码流也只需要缩小到SWITCH_DOWN以下时才换小，中间的范围保持不变；
+ *        换大在显示大小稳定一小段时间后执行（如最大化格子），换小需要稳定更久，避免窗口缩放、来回切换时反复打开。
+ *        只在读取线程中使用，不加锁
+ */
+class RenditionSelector
+{
+public:
+    static QList<Rendition> parse(const QString& text);   // 解析"地址 宽x高 | 地址 宽x高"，只有一个地址时返回空
+
+    void setRenditions(const QList<Rendition>& renditions);
+    const QList<Rendition>& renditions() const;
+    bool isEmpty() const;
+    int  indexOf(const QString& url) const;
+    const QString& url(int index) const;
+    void setCurrent(int index);                 // 当前播放的码流，-1表示不在列表中
+    int  current() const;
+    void setSize(int index, const QSize& size); // 打开后用实际分辨率更新
+    int  best(const QSize& display) const;      // 不考虑滞后，最匹配显示分辨率的码流，显示分辨率未知时返回-1
+    int  update(const QSize& display);          // 考虑滞后，返回应该播放的码流（不需要切换时为当前码流）
+
+private:
+    static qreal scale(const Rendition& rendition, const QSize& display);   // 码流等比缩放到显示分辨率的倍数
+    int  smallest(const QSize& display, qreal maxScale) const;   // 放大倍数不超过maxScale的最小码流，没有时返回-1
+    int  largest() const;
+
+private:
+    QList<Rendition> m_renditions;
+    int m_current = -1;
+    int m_candidate = -1;                       // 等待显示大小稳定的目标码流
+    QElapsedTimer m_candidateTimer;
+};
+
+#endif // RENDITIONSELECTOR_H
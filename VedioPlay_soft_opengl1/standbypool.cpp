@@ -0,0 +1,221 @@
+#include "standbypool.h"
+#include "videodecoder.h"
+#include "memorybudget.h"
+#include <QDebug>
+
+#define STOP_TIMEOUT 200    // 等待后台线程读完当前数据包的时间（毫秒），超时后中断阻塞的读取
+
+StandbyPool::Standby::~Standby()
+{
+    delete decoder;
+}
+
+StandbyPool::StandbyPool(QObject *parent) : QObject(parent)
+{
+    m_pool.setMaxThreadCount(m_capacity);
+}
+
+StandbyPool::~StandbyPool()
+{
+    prepare(QStringList());
+    m_pool.waitForDone();
+}
+
+/**
+ * @brief       减少时关闭优先级最低的会话
+ * @param count
+ */
+void StandbyPool::setCapacity(int count)
+{
+    QList<QSharedPointer<Standby>> removed;
+    m_mutex.lock();
+    m_capacity = qMax(0, count);
+    m_pool.setMaxThreadCount(qMax(1, m_capacity));
+    while(m_standbys.size() > m_capacity)
+    {
+        removed.append(m_standbys.takeLast());
+    }
+    m_mutex.unlock();
+    for(const QSharedPointer<Standby>& standby : qAsConst(removed))
+    {
+        stop(standby);
+    }
+}
+
+int StandbyPool::capacity()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_capacity;
+}
+
+/**
+ * @brief       只对之后启动的会话生效
+ * @param bytes
+ */
+void StandbyPool::setMaxBytes(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxBytes = qMax(qint64(0), bytes);
+}
+
+/**
+ * @brief      已经待机的地址保持不变，不在列表中（或超出数量上限）的关闭，新的地址开始打开
+ * @param urls 按优先级排列，空地址和重复的地址忽略
+ */
+void StandbyPool::prepare(const QStringList &urls)
+{
+    QList<QSharedPointer<Standby>> keep;
+    QList<QSharedPointer<Standby>> started;
+    m_mutex.lock();
+    for(const QString& url : urls)
+    {
+        if(keep.size() >= m_capacity) break;
+        if(url.isEmpty()) continue;
+        bool exists = false;
+        for(const QSharedPointer<Standby>& standby : qAsConst(keep))
+        {
+            exists |= standby->url == url;
+        }
+        if(exists) continue;
+
+        QSharedPointer<Standby> found;
+        for(int i = 0; i < m_standbys.size(); i++)
+        {
+            if(m_standbys.at(i)->url == url)
+            {
+                found = m_standbys.takeAt(i);
+                break;
+            }
+        }
+        if(!found)
+        {
+            found.reset(new Standby());
+            found->url = url;
+            found->decoder = new VideoDecoder();
+            started.append(found);
+        }
+        keep.append(found);
+    }
+    QList<QSharedPointer<Standby>> removed = m_standbys;
+    m_standbys = keep;
+    m_mutex.unlock();
+
+    for(const QSharedPointer<Standby>& standby : qAsConst(removed))
+    {
+        stop(standby);
+    }
+    for(const QSharedPointer<Standby>& standby : qAsConst(started))
+    {
+        start(standby);
+    }
+}
+
+/**
+ * @brief     停止后台读取后把解码器交给调用者，调用者通过VideoDecoder::takeOver接管
+ * @param url
+ * @return
+ */
+VideoDecoder *StandbyPool::take(const QString &url)
+{
+    QSharedPointer<Standby> standby;
+    m_mutex.lock();
+    for(int i = 0; i < m_standbys.size(); i++)
+    {
+        if(m_standbys.at(i)->url == url)
+        {
+            standby = m_standbys.takeAt(i);
+            break;
+        }
+    }
+    m_mutex.unlock();
+    if(!standby) return nullptr;
+
+    stop(standby);
+    if(!standby->ready.loadAcquire()) return nullptr;
+
+    VideoDecoder* decoder = standby->decoder;
+    standby->decoder = nullptr;
+    decoder->setInterrupted(false);
+    qDebug() << QString("使用待机会话：%1，缓存%2 KB").arg(url).arg(decoder->prerollBytes() / 1024);
+    return decoder;
+}
+
+bool StandbyPool::isReady(const QString &url)
+{
+    QMutexLocker locker(&m_mutex);
+    for(const QSharedPointer<Standby>& standby : qAsConst(m_standbys))
+    {
+        if(standby->url == url) return standby->ready.loadAcquire();
+    }
+    return false;
+}
+
+bool StandbyPool::hasKeyFrame(const QString &url)
+{
+    QMutexLocker locker(&m_mutex);
+    for(const QSharedPointer<Standby>& standby : qAsConst(m_standbys))
+    {
+        if(standby->url == url) return standby->ready.loadAcquire() && standby->keyed.loadAcquire();
+    }
+    return false;
+}
+
+void StandbyPool::start(const QSharedPointer<Standby> &standby)
+{
+    qint64 maxBytes = m_maxBytes;
+    m_pool.start([standby, maxBytes]() {
+        warm(standby.data(), maxBytes);
+    });
+}
+
+/**
+ * @brief         正常情况下网络流很快会读到下一个数据包，等待读完，避免中断读取丢失数据包导致缓存的GOP不完整；
+ *                还在连接（打开被中断，不可用）或等待数据时中断
+ * @param standby
+ */
+void StandbyPool::stop(const QSharedPointer<Standby> &standby)
+{
+    standby->stop.storeRelease(1);
+    if(!standby->done.tryAcquire(1, STOP_TIMEOUT))
+    {
+        standby->decoder->setInterrupted(true);
+        standby->done.acquire();
+    }
+    MemoryBudget::instance()->release(0, MemoryBudget::PacketQueue, standby->bytes);
+    standby->bytes = 0;
+}
+
+/**
+ * @brief          打开后持续读取，直播流总是保留最近的一个GOP；本地文件缓存到第一个关键帧后结束
+ * @param standby
+ * @param maxBytes
+ */
+void StandbyPool::warm(Standby *standby, qint64 maxBytes)
+{
+    VideoDecoder* decoder = standby->decoder;
+    if(!standby->stop.loadAcquire() && decoder->open(standby->url))
+    {
+        standby->ready.storeRelease(1);
+        bool file = decoder->totalTime() > 0;
+        while(!standby->stop.loadAcquire())
+        {
+            bool ok = decoder->preroll(maxBytes);
+            qint64 bytes = decoder->prerollBytes();
+            MemoryBudget::instance()->release(0, MemoryBudget::PacketQueue, standby->bytes);
+            MemoryBudget::instance()->add(0, MemoryBudget::PacketQueue, bytes);
+            standby->bytes = bytes;
+            standby->keyed.storeRelease(decoder->hasPreroll() ? 1 : 0);
+            if(!ok)
+            {
+                if(!file && !standby->stop.loadAcquire())
+                {
+                    standby->ready.storeRelease(0);   // 网络断开，切换时重新打开
+                    qDebug() << "待机会话断开：" << standby->url;
+                }
+                break;
+            }
+            if(file && decoder->hasPreroll()) break;
+        }
+    }
+    standby->done.release();
+}
@@ -0,0 +1,59 @@
+#ifndef STANDBYPOOL_H
+#define STANDBYPOOL_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QList>
+#include <QMutex>
+#include <QSemaphore>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QThreadPool>
+
+class VideoDecoder;
+
+/**
+ * @brief 待机会话池：提前打开相邻频道、播放列表下一项，在后台线程中保持连接并缓存最近一个关键帧开始的数据包（不解码）。
+ *        切换时ReadThread接管已经打开的解码器，省去连接、探测和等待关键帧的时间；本地文件只缓存第一个关键帧后就停止读取。
+ *        待机数量和每个会话缓存的数据包大小都有上限，缓存计入内存预算的数据包队列
+ */
+class StandbyPool : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StandbyPool(QObject* parent = nullptr);
+    ~StandbyPool() override;
+
+    void setCapacity(int count);                // 最多同时待机的会话数，0表示关闭
+    int  capacity();
+    void setMaxBytes(qint64 bytes);             // 每个会话缓存数据包的上限
+    void prepare(const QStringList& urls);      // 按优先级排列的地址，前capacity个保持待机，其它的关闭
+    VideoDecoder* take(const QString& url);     // 取出已经打开的解码器（所有权转移给调用者），没有准备好时返回nullptr
+    bool isReady(const QString& url);           // 是否已经打开（可以立即切换）
+    bool hasKeyFrame(const QString& url);       // 是否已经缓存了关键帧（切换后第一帧就可以显示）
+
+private:
+    struct Standby
+    {
+        QString url;
+        VideoDecoder* decoder = nullptr;
+        QAtomicInt stop = 0;                    // 通知后台线程停止读取
+        QAtomicInt ready = 0;                   // 已经打开
+        QAtomicInt keyed = 0;                   // 缓存中有关键帧
+        QSemaphore done;                        // 后台线程结束时释放
+        qint64 bytes = 0;                       // 记账的缓存大小，只在后台线程中修改
+        ~Standby();
+    };
+    void start(const QSharedPointer<Standby>& standby);
+    void stop(const QSharedPointer<Standby>& standby);   // 停止后台读取并等待线程结束
+    static void warm(Standby* standby, qint64 maxBytes);  // 后台线程：打开并持续缓存最近的GOP
+
+private:
+    QMutex m_mutex;
+    QList<QSharedPointer<Standby>> m_standbys;
+    QThreadPool m_pool;                         // 每个待机会话占用一个线程
+    int    m_capacity = 2;
+    qint64 m_maxBytes = 16 * 1024 * 1024;
+};
+
+#endif // STANDBYPOOL_H
@@ -0,0 +1,108 @@
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QFile>
+#include "readthread.h"
+#include "metrics.h"
+#include "kernelbenchmark.h"
+
+#define COMMAND_BOUND  0.05     // 正常播放时控制命令的响应延时上限（秒）
+#define STOP_BOUND     200      // 读取阻塞在卡住的输入上时停止的响应上限（毫秒），远小于网络读取超时（1秒）
+#define STALL_BYTES    8192     // 卡住的输入只发送文件开头的字节数
+#define OPEN_TIMEOUT   5000     // 等待开始播放的时间（毫秒）
+
+/**
+ * @brief 控制命令（暂停、继续、停止）的响应延时，由读取线程记录到vedioplay_command_seconds直方图
+ */
+class TestControlLatency : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void pauseResumeStop();
+    void stopWhileReadBlocked();
+
+private:
+    QString m_clip;
+};
+
+void TestControlLatency::initTestCase()
+{
+    m_clip = KernelBenchmark::generateClip(QSize(320, 240), 250);    // 25帧/秒，10秒
+    QVERIFY2(!m_clip.isEmpty(), "生成测试视频失败");
+}
+
+/**
+ * @brief 本地文件播放中反复暂停、继续，最后停止，每个命令都要在COMMAND_BOUND内执行
+ */
+void TestControlLatency::pauseResumeStop()
+{
+    ReadThread thread;
+    QSignalSpy state(&thread, &ReadThread::playState);
+    thread.open(m_clip);
+    QTRY_COMPARE_WITH_TIMEOUT(state.count(), 1, OPEN_TIMEOUT);
+    QCOMPARE(state.at(0).at(0).value<ReadThread::PlayState>(), ReadThread::play);
+
+    for(int i = 0; i < 3; i++)
+    {
+        QTest::qWait(100);
+        thread.pause(true);
+        QTest::qWait(100);
+        thread.pause(false);
+    }
+    QTest::qWait(100);
+    thread.close();
+    QVERIFY(thread.wait(1000));
+
+    const char* name = "vedioplay_command_seconds";
+    qint64 total = Metrics::instance()->histogramCount(name, thread.session());
+    QCOMPARE(total, qint64(7));
+    QCOMPARE(Metrics::instance()->histogramCount(name, thread.session(), COMMAND_BOUND), total);
+}
+
+/**
+ * @brief 本地HTTP服务只发送文件开头后不再发送也不断开，读取线程阻塞在av_read_frame中；
+ *        停止时中断回调要立即结束读取，而不是等网络读取超时
+ */
+void TestControlLatency::stopWhileReadBlocked()
+{
+    QFile file(m_clip);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray head = file.read(STALL_BYTES);
+
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    connect(&server, &QTcpServer::newConnection, this, [&server, &head]() {
+        QTcpSocket* socket = server.nextPendingConnection();
+        connect(socket, &QTcpSocket::readyRead, socket, [socket, &head]() {
+            socket->readAll();
+            if(socket->property("answered").toBool()) return;
+            socket->setProperty("answered", true);
+            // 不返回长度和Accept-Ranges，按不能跳转的流读取
+            socket->write("HTTP/1.1 200 OK\r\nContent-Type: video/x-matroska\r\n\r\n");
+            socket->write(head);
+        });
+    });
+
+    ReadThread thread;
+    QSignalSpy state(&thread, &ReadThread::playState);
+    thread.open(QString("http://127.0.0.1:%1/stall.mkv").arg(server.serverPort()));
+    QTRY_COMPARE_WITH_TIMEOUT(state.count(), 1, OPEN_TIMEOUT);
+    QCOMPARE(state.at(0).at(0).value<ReadThread::PlayState>(), ReadThread::play);
+    QTest::qWait(400);                            // 开头的数据很快读完，之后一直阻塞在读取中
+    QVERIFY(thread.isRunning());
+
+    QElapsedTimer timer;
+    timer.start();
+    thread.close();
+    QVERIFY(thread.wait(1000));
+    qint64 elapsed = timer.elapsed();
+    QVERIFY2(elapsed < STOP_BOUND, qPrintable(QString("停止耗时%1 ms").arg(elapsed)));
+    QCOMPARE(Metrics::instance()->histogramCount("vedioplay_command_seconds", thread.session(), STOP_BOUND / 1000.0),
+             qint64(1));
+}
+
+QTEST_GUILESS_MAIN(TestControlLatency)
+
+#include "tst_controllatency.moc"
@@ -0,0 +1,301 @@
+#include "thumbnailgenerator.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QStandardPaths>
+#include <QThread>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libswscale/swscale.h>
+}
+
+#define MAX_PACKETS 500     // 跳转后最多读取的数据包数，防止异常文件一直读取
+
+/**
+ * @brief 生成一段连续序号的缩略图，每个任务使用独立的解封装、解码上下文
+ */
+class ThumbnailTask : public QRunnable
+{
+public:
+    ThumbnailTask(ThumbnailGenerator* generator, const QString& fileName, const QString& cacheDir,
+                  const QSize& size, int count, int first, int last)
+        : m_generator(generator), m_fileName(fileName), m_cacheDir(cacheDir)
+        , m_size(size), m_count(count), m_first(first), m_last(last)
+    {
+    }
+    ~ThumbnailTask() override
+    {
+        close();
+    }
+
+    void run() override
+    {
+        for(int i = m_first; i < m_last && !m_generator->m_cancel.loadAcquire(); i++)
+        {
+            QString cacheFile = QDir(m_cacheDir).filePath(QString("%1.png").arg(i));
+            QImage image(cacheFile);                  // 先查找磁盘缓存
+            if(image.isNull())
+            {
+                if(!m_formatContext && !open()) break;
+                qint64 msec = (m_duration * (2 * i + 1)) / (2 * m_count);   // 取每一段的中间位置
+                image = grab(msec);
+                if(image.isNull()) continue;
+                image.setText("msec", QString::number(msec));     // 时间保存在png文本块中，读取缓存时使用
+                image.save(cacheFile, "PNG");
+            }
+            emit m_generator->thumbnailReady(i, image.text("msec").toLongLong(), image);
+        }
+        close();
+        m_generator->taskFinished();
+    }
+
+private:
+    bool open()
+    {
+        QByteArray name = m_fileName.toUtf8();
+        if(avformat_open_input(&m_formatContext, name.constData(), nullptr, nullptr) < 0)
+        {
+            return false;
+        }
+        if(avformat_find_stream_info(m_formatContext, nullptr) < 0)
+        {
+            close();
+            return false;
+        }
+        const AVCodec* codec = nullptr;
+        m_videoIndex = av_find_best_stream(m_formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+        if(m_videoIndex < 0 || !codec || m_formatContext->duration <= 0)
+        {
+            close();
+            return false;
+        }
+        m_duration = m_formatContext->duration / (AV_TIME_BASE / 1000);
+        AVStream* stream = m_formatContext->streams[m_videoIndex];
+
+        m_codecContext = avcodec_alloc_context3(codec);
+        if(!m_codecContext || avcodec_parameters_to_context(m_codecContext, stream->codecpar) < 0)
+        {
+            close();
+            return false;
+        }
+        // 以下设置只用于缩略图：只解码关键帧、跳过环路滤波、单线程（多个任务已经并行，多线程解码反而增加延时）
+        m_codecContext->skip_frame       = AVDISCARD_NONKEY;
+        m_codecContext->skip_loop_filter = AVDISCARD_ALL;
+        m_codecContext->flags2          |= AV_CODEC_FLAG2_FAST;
+        m_codecContext->thread_count     = 1;
+        // 解码器支持lowres时直接解码为1/2、1/4、1/8分辨率，缩小后仍然不小于缩略图尺寸
+        int lowres = 0;
+        while(lowres < codec->max_lowres && (stream->codecpar->width >> (lowres + 1)) >= m_size.width())
+        {
+            lowres++;
+        }
+        m_codecContext->lowres = lowres;
+        if(avcodec_open2(m_codecContext, codec, nullptr) < 0)
+        {
+            close();
+            return false;
+        }
+        m_packet = av_packet_alloc();
+        m_frame  = av_frame_alloc();
+        return m_packet && m_frame;
+    }
+
+    /**
+     * @brief      跳转到msec之前最近的关键帧并解码这一帧
+     * @param msec
+     * @return
+     */
+    QImage grab(qint64 msec)
+    {
+        AVStream* stream = m_formatContext->streams[m_videoIndex];
+        qint64 ts = av_rescale_q(msec, AVRational{1, 1000}, stream->time_base);
+        if(stream->start_time != AV_NOPTS_VALUE)
+        {
+            ts += stream->start_time;
+        }
+        if(av_seek_frame(m_formatContext, m_videoIndex, ts, AVSEEK_FLAG_BACKWARD) < 0)
+        {
+            return QImage();
+        }
+        avcodec_flush_buffers(m_codecContext);
+
+        QImage image;
+        bool   eof = false;
+        for(int i = 0; i < MAX_PACKETS && image.isNull(); i++)
+        {
+            if(!eof)
+            {
+                int ret = av_read_frame(m_formatContext, m_packet);
+                if(ret < 0)
+                {
+                    eof = true;
+                    avcodec_send_packet(m_codecContext, nullptr);   // 文件结束，取出解码器中剩余的帧
+                }
+                else
+                {
+                    if(m_packet->stream_index == m_videoIndex)
+                    {
+                        avcodec_send_packet(m_codecContext, m_packet);
+                    }
+                    av_packet_unref(m_packet);
+                }
+            }
+            int ret = avcodec_receive_frame(m_codecContext, m_frame);
+            if(ret == 0)
+            {
+                image = convert(m_frame);
+                av_frame_unref(m_frame);
+            }
+            else if(eof)
+            {
+                break;
+            }
+        }
+        return image;
+    }
+
+    QImage convert(AVFrame* frame)
+    {
+        QSize size = QSize(frame->width, frame->height).scaled(m_size, Qt::KeepAspectRatio);
+        if(size.isEmpty()) return QImage();
+        m_swsContext = sws_getCachedContext(m_swsContext,
+                                            frame->width, frame->height, AVPixelFormat(frame->format),
+                                            size.width(), size.height(), AV_PIX_FMT_RGBA,
+                                            SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+        if(!m_swsContext) return QImage();
+
+        QImage image(size, QImage::Format_RGBA8888);
+        uchar* data[]  = {image.bits()};
+        int    lines[] = {int(image.bytesPerLine())};
+        sws_scale(m_swsContext, frame->data, frame->linesize, 0, frame->height, data, lines);
+        return image;
+    }
+
+    void close()
+    {
+        if(m_swsContext)
+        {
+            sws_freeContext(m_swsContext);
+            m_swsContext = nullptr;
+        }
+        if(m_codecContext)
+        {
+            avcodec_free_context(&m_codecContext);
+        }
+        if(m_formatContext)
+        {
+            avformat_close_input(&m_formatContext);
+        }
+        if(m_packet)
+        {
+            av_packet_free(&m_packet);
+        }
+        if(m_frame)
+        {
+            av_frame_free(&m_frame);
+        }
+    }
+
+private:
+    ThumbnailGenerator* m_generator = nullptr;
+    QString m_fileName;
+    QString m_cacheDir;
+    QSize   m_size;
+    int m_count = 0;
+    int m_first = 0;                              // 负责的缩略图序号范围[m_first, m_last)
+    int m_last  = 0;
+    AVFormatContext* m_formatContext = nullptr;
+    AVCodecContext*  m_codecContext  = nullptr;
+    SwsContext* m_swsContext = nullptr;
+    AVPacket* m_packet = nullptr;
+    AVFrame*  m_frame  = nullptr;
+    int    m_videoIndex = -1;
+    qint64 m_duration = 0;                        // 视频总时长（毫秒）
+};
+
+
+ThumbnailGenerator::ThumbnailGenerator(QObject *parent) : QObject(parent)
+{
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+    m_cacheDir = QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("thumbnails");
+}
+
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+    cancel();
+}
+
+void ThumbnailGenerator::setThumbnailSize(const QSize &size)
+{
+    m_size = size;
+}
+
+void ThumbnailGenerator::setCacheDir(const QString &dir)
+{
+    m_cacheDir = dir;
+}
+
+/**
+ * @brief          按线程数把count张缩略图分成连续的几段，每段一个任务，
+ *                 这样每个任务按时间顺序跳转，每次只需要打开一次文件
+ * @param fileName 本地视频文件
+ * @param count    缩略图数量
+ */
+void ThumbnailGenerator::generate(const QString &fileName, int count)
+{
+    cancel();
+    if(count <= 0 || !QFileInfo::exists(fileName)) return;
+
+    QString cacheDir = QDir(m_cacheDir).filePath(cacheKey(fileName, count));
+    QDir().mkpath(cacheDir);
+
+    int tasks = qMin(count, m_pool.maxThreadCount());
+    m_cancel.storeRelease(0);
+    m_running.storeRelease(tasks);
+    for(int i = 0; i < tasks; i++)
+    {
+        int first = count * i / tasks;
+        int last  = count * (i + 1) / tasks;
+        m_pool.start(new ThumbnailTask(this, fileName, cacheDir, m_size, count, first, last));
+    }
+}
+
+void ThumbnailGenerator::cancel()
+{
+    m_cancel.storeRelease(1);
+    m_pool.waitForDone();
+}
+
+/**
+ * @brief          缓存目录名：文件路径、大小、修改时间、缩略图数量和尺寸的MD5，文件被修改后缓存自动失效
+ * @param fileName
+ * @param count
+ * @return
+ */
+QString ThumbnailGenerator::cacheKey(const QString &fileName, int count) const
+{
+    QFileInfo info(fileName);
+    QString identity = QString("%1|%2|%3|%4|%5x%6")
+                           .arg(info.absoluteFilePath())
+                           .arg(info.size())
+                           .arg(info.lastModified().toMSecsSinceEpoch())
+                           .arg(count)
+                           .arg(m_size.width())
+                           .arg(m_size.height());
+    return QCryptographicHash::hash(identity.toUtf8(), QCryptographicHash::Md5).toHex();
+}
+
+void ThumbnailGenerator::taskFinished()
+{
+    if(m_running.fetchAndAddOrdered(-1) == 1 && !m_cancel.loadAcquire())
+    {
+        emit finished();
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef THUMBNAILGENERATOR_H
+#define THUMBNAILGENERATOR_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QThreadPool>
+
+/**
+ * @brief 缩略图生成：在视频中均匀取N个位置，只跳转到关键帧并且只解码关键帧（AVDISCARD_NONKEY + lowres），
+ *        多个线程同时生成，结果按文件（路径、大小、修改时间）缓存到磁盘
+ */
+class ThumbnailGenerator : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ThumbnailGenerator(QObject *parent = nullptr);
+    ~ThumbnailGenerator() override;
+
+    void setThumbnailSize(const QSize& size);     // 缩略图最大尺寸（保持宽高比）
+    void setCacheDir(const QString& dir);         // 磁盘缓存目录
+    void generate(const QString& fileName, int count);  // 开始生成count张缩略图（异步）
+    void cancel();                                // 取消生成，等待工作线程退出
+
+signals:
+    void thumbnailReady(int index, qint64 msec, const QImage& image);   // 一张缩略图生成完成（在工作线程中触发）
+    void finished();                              // 全部缩略图生成完成
+
+private:
+    friend class ThumbnailTask;
+    QString cacheKey(const QString& fileName, int count) const;   // 根据文件标识计算缓存目录名
+    void taskFinished();                          // 工作线程完成时调用
+
+private:
+    QThreadPool m_pool;
+    QSize   m_size = QSize(160, 90);
+    QString m_cacheDir;
+    QAtomicInt m_cancel = 0;                      // 取消标志
+    QAtomicInt m_running = 0;                     // 正在执行的任务数
+};
+
+#endif // THUMBNAILGENERATOR_H
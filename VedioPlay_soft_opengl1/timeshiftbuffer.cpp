@@ -0,0 +1,265 @@
+#include "timeshiftbuffer.h"
+#include "packetmuxer.h"
+#include "memorybudget.h"
+
+#include <QDebug>
+#include <QVector>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+TimeShiftBuffer::TimeShiftBuffer()
+{
+    m_muxer = new PacketMuxer();
+}
+
+TimeShiftBuffer::~TimeShiftBuffer()
+{
+    clear();
+    delete m_muxer;
+}
+
+void TimeShiftBuffer::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_memoryBudget = bytes;
+}
+
+void TimeShiftBuffer::setMaxDuration(qint64 msec)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxDuration = msec;
+}
+
+void TimeShiftBuffer::setMemorySession(int session)
+{
+    QMutexLocker locker(&m_mutex);
+    m_session = session;
+}
+
+/**
+ * @brief             设置输入流参数（导出时使用），并清空之前的缓存
+ * @param input
+ * @param videoIndex
+ * @param audioIndex
+ * @return
+ */
+bool TimeShiftBuffer::setInput(const AVFormatContext *input, int videoIndex, int audioIndex)
+{
+    clear();
+    QMutexLocker locker(&m_mutex);
+    if(!input || videoIndex < 0 || !m_muxer->setInput(input, videoIndex, audioIndex))
+    {
+        return false;
+    }
+    m_videoIndex  = videoIndex;
+    m_timeBaseNum = input->streams[videoIndex]->time_base.num;
+    m_timeBaseDen = input->streams[videoIndex]->time_base.den;
+    return true;
+}
+
+void TimeShiftBuffer::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    while(!m_entries.isEmpty())
+    {
+        Entry entry = m_entries.dequeue();
+        av_packet_free(&entry.packet);
+        m_firstPosition++;              // 位置继续递增，读取者发现位置失效后会重新定位
+    }
+    MemoryBudget::instance()->release(m_session, MemoryBudget::PacketQueue, m_bytes);
+    m_bytes = 0;
+    m_lastTime = 0;
+}
+
+/**
+ * @brief        缓存数据包，缓冲必须从视频关键帧开始，所以之前的数据包直接丢弃
+ * @param packet 时间戳为输入流时间基
+ */
+void TimeShiftBuffer::push(const AVPacket *packet)
+{
+    if(!packet) return;
+
+    QMutexLocker locker(&m_mutex);
+    if(!m_muxer->hasInput(packet->stream_index)) return;   // setInput在锁内修改m_muxer
+    Entry entry;
+    entry.keyFrame = (packet->stream_index == m_videoIndex) && (packet->flags & AV_PKT_FLAG_KEY);
+    if(m_entries.isEmpty() && !entry.keyFrame) return;
+
+    if(packet->stream_index == m_videoIndex)
+    {
+        qint64 ts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+        if(ts != AV_NOPTS_VALUE)
+        {
+            m_lastTime = av_rescale_q(ts, AVRational{m_timeBaseNum, m_timeBaseDen}, AVRational{1, 1000});
+        }
+    }
+    entry.time = m_lastTime;
+    entry.packet = av_packet_clone(packet);
+    if(!entry.packet) return;
+
+    m_entries.enqueue(entry);
+    m_bytes += packet->size;
+    MemoryBudget::instance()->add(m_session, MemoryBudget::PacketQueue, packet->size);
+    while(m_bytes > m_memoryBudget || (m_lastTime - m_entries.head().time) > m_maxDuration
+          || MemoryBudget::instance()->isOverBudget())
+    {
+        int count = m_entries.size();
+        evict();
+        if(count == m_entries.size()) break;    // 只剩一个GOP时不再淘汰
+    }
+}
+
+/**
+ * @brief          读取缓冲中的数据包
+ * @param position 读取位置，读取成功后指向下一个数据包
+ * @param packet   返回数据包的引用，使用后需要调用av_packet_unref
+ * @return
+ */
+TimeShiftBuffer::ReadResult TimeShiftBuffer::read(qint64 *position, AVPacket *packet)
+{
+    QMutexLocker locker(&m_mutex);
+    if(*position < m_firstPosition)
+    {
+        *position = m_firstPosition;     // 读取太慢，数据已经被淘汰，从最早的关键帧重新开始
+        return Discontinuity;
+    }
+    qint64 index = *position - m_firstPosition;
+    if(index >= m_entries.size())
+    {
+        return NoData;
+    }
+    if(av_packet_ref(packet, m_entries.at(int(index)).packet) < 0)
+    {
+        return NoData;
+    }
+    (*position)++;
+    return ReadOk;
+}
+
+/**
+ * @brief       获取距离直播msec毫秒之前最近的关键帧位置，用于回看
+ * @param msec
+ * @return
+ */
+qint64 TimeShiftBuffer::seekPosition(qint64 msec)
+{
+    QMutexLocker locker(&m_mutex);
+    return keyFramePosition(m_lastTime - msec);
+}
+
+qint64 TimeShiftBuffer::livePosition()
+{
+    QMutexLocker locker(&m_mutex);
+    return keyFramePosition(m_lastTime);
+}
+
+qint64 TimeShiftBuffer::endPosition()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_firstPosition + m_entries.size();
+}
+
+qint64 TimeShiftBuffer::liveTime()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lastTime;
+}
+
+qint64 TimeShiftBuffer::duration()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.isEmpty() ? 0 : m_lastTime - m_entries.head().time;
+}
+
+qint64 TimeShiftBuffer::memoryUsage()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_bytes;
+}
+
+int TimeShiftBuffer::packetCount()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_entries.size();
+}
+
+/**
+ * @brief          将最近msec毫秒的数据包直接封装为文件（不重新编码），开始位置向前对齐到关键帧。
+ *                 加锁时只拷贝数据包引用，写文件时不加锁，不会阻塞读取线程
+ * @param fileName
+ * @param msec
+ * @return
+ */
+bool TimeShiftBuffer::exportClip(const QString &fileName, qint64 msec)
+{
+    QVector<AVPacket*> packets;
+    PacketMuxer muxer;
+    m_mutex.lock();
+    qint64 position = keyFramePosition(m_lastTime - msec);
+    for(qint64 i = position - m_firstPosition; i < m_entries.size(); i++)
+    {
+        AVPacket* packet = av_packet_clone(m_entries.at(int(i)).packet);
+        if(packet) packets.append(packet);
+    }
+    bool ok = muxer.copyInput(*m_muxer);
+    m_mutex.unlock();
+
+    if(ok && !packets.isEmpty())
+    {
+        ok = muxer.open(fileName);
+        for(int i = 0; ok && i < packets.size(); i++)
+        {
+            muxer.write(packets.at(i));
+        }
+        muxer.close();
+    }
+    for(AVPacket* packet : packets)
+    {
+        av_packet_free(&packet);
+    }
+    if(!ok)
+    {
+        qWarning() << "导出时移片段失败：" << fileName;
+    }
+    return ok && !packets.isEmpty();
+}
+
+/**
+ * @brief 淘汰最早的一个GOP（从第一个关键帧到下一个关键帧之前），只剩一个GOP时不淘汰
+ */
+void TimeShiftBuffer::evict()
+{
+    int next = 1;
+    while(next < m_entries.size() && !m_entries.at(next).keyFrame)
+    {
+        next++;
+    }
+    if(next >= m_entries.size()) return;
+
+    for(int i = 0; i < next; i++)
+    {
+        Entry entry = m_entries.dequeue();
+        m_bytes -= entry.packet->size;
+        MemoryBudget::instance()->release(m_session, MemoryBudget::PacketQueue, entry.packet->size);
+        av_packet_free(&entry.packet);
+    }
+    m_firstPosition += next;
+}
+
+qint64 TimeShiftBuffer::keyFramePosition(qint64 time)
+{
+    qint64 position = m_firstPosition;
+    for(int i = 0; i < m_entries.size(); i++)
+    {
+        const Entry& entry = m_entries.at(i);
+        if(entry.time > time) break;
+        if(entry.keyFrame)
+        {
+            position = m_firstPosition + i;
+        }
+    }
+    return position;
+}
@@ -0,0 +1,75 @@
+#ifndef TIMESHIFTBUFFER_H
+#define TIMESHIFTBUFFER_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+
+class PacketMuxer;
+struct AVFormatContext;
+struct AVPacket;
+
+/**
+ * @brief 时移缓冲：在内存中按GOP缓存最近一段时间的压缩数据包（视频+音频），
+ *        超出内存预算或最大时长时整个GOP一起淘汰，保证缓冲总是从关键帧开始。
+ *        可以用于直播暂停、回看以及不重新编码导出最近一段视频。线程安全。
+ */
+class TimeShiftBuffer
+{
+public:
+    enum ReadResult
+    {
+        ReadOk,             // 读取成功
+        NoData,             // 已经读取到最新的数据包
+        Discontinuity       // 读取位置已经被淘汰，跳到了最早的关键帧，解码器需要flush
+    };
+
+public:
+    TimeShiftBuffer();
+    ~TimeShiftBuffer();
+
+    void setMemoryBudget(qint64 bytes);          // 最大占用内存（字节）
+    void setMaxDuration(qint64 msec);            // 最长缓存时长（毫秒）
+    void setMemorySession(int session);          // 内存记账的播放会话，超出进程内存预算时也会淘汰
+    bool setInput(const AVFormatContext* input, int videoIndex, int audioIndex);  // 设置输入流，会清空缓冲
+    void clear();
+
+    void push(const AVPacket* packet);           // 缓存一个数据包（引用计数+1，不拷贝数据）
+    ReadResult read(qint64* position, AVPacket* packet);   // 读取position位置的数据包，并将position移动到下一个
+    qint64 seekPosition(qint64 msec);            // 获取距离直播msec毫秒之前最近关键帧的位置
+    qint64 livePosition();                       // 获取最新关键帧的位置
+    qint64 endPosition();                        // 下一个写入数据包的位置
+
+    qint64 liveTime();                           // 最新视频帧的时间（毫秒）
+    qint64 duration();                           // 缓存的时长（毫秒）
+    qint64 memoryUsage();                        // 缓存的数据大小（字节）
+    int    packetCount();                        // 缓存的数据包数
+
+    bool exportClip(const QString& fileName, qint64 msec);  // 将最近msec毫秒（从关键帧开始）导出为文件，不重新编码
+
+private:
+    struct Entry
+    {
+        AVPacket* packet = nullptr;
+        qint64 time = 0;                          // 数据包时间（毫秒），音频数据包使用前一个视频帧的时间
+        bool   keyFrame = false;                  // 是否为视频关键帧（GOP开始）
+    };
+    void evict();                                 // 淘汰最早的GOP
+    qint64 keyFramePosition(qint64 time);         // 时间time之前最近的关键帧位置，调用前需要加锁
+
+private:
+    QMutex m_mutex;
+    QQueue<Entry> m_entries;                      // 缓存的数据包，第一个总是关键帧
+    PacketMuxer* m_muxer = nullptr;               // 只用于保存输入流参数，导出时拷贝
+    qint64 m_firstPosition = 0;                   // m_entries中第一个数据包的位置（位置只增不减）
+    qint64 m_bytes = 0;
+    qint64 m_lastTime = 0;                        // 最新视频帧的时间
+    qint64 m_memoryBudget = 64 * 1024 * 1024;
+    qint64 m_maxDuration  = 5 * 60 * 1000;
+    int m_videoIndex = -1;
+    int m_timeBaseNum = 0;                        // 视频流时间基
+    int m_timeBaseDen = 1;
+    int m_session = 0;                            // 内存记账会话
+};
+
+#endif // TIMESHIFTBUFFER_H
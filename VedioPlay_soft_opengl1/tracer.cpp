@@ -0,0 +1,185 @@
+#include "tracer.h"
+#include <QCoreApplication>
+#include <QDebug>
+#include <QSaveFile>
+#include <QThread>
+
+#define THREAD_EVENTS 65536     // 每个线程最多记录的区间数（约2.5MB），满后丢弃并计数
+
+static QAtomicInt s_enabled = 0;
+
+/**
+ * @brief 线程结束时把缓冲区还给Tracer。线程池会结束空闲的线程、之后再创建新的线程，
+ *        不归还时长时间跟踪的内存会一直增长
+ */
+struct ThreadBufferOwner
+{
+    Tracer::ThreadBuffer* buffer = nullptr;
+    ~ThreadBufferOwner()
+    {
+        if(buffer) Tracer::instance()->releaseBuffer(buffer);
+    }
+};
+static thread_local ThreadBufferOwner t_owner;    // 当前线程的缓冲区
+
+Tracer::Tracer()
+{
+    m_clock.start();
+}
+
+Tracer *Tracer::instance()
+{
+    static Tracer tracer;                         // C++11起局部静态变量初始化是线程安全的
+    return &tracer;
+}
+
+bool Tracer::isEnabled()
+{
+    return s_enabled.loadRelaxed();
+}
+
+qint64 Tracer::now()
+{
+    return instance()->m_clock.nsecsElapsed();
+}
+
+/**
+ * @brief 各线程的缓冲区在下一次记录时发现跟踪编号变化后自己清空，这里不访问其它线程的缓冲区
+ */
+void Tracer::start()
+{
+    m_generation.fetchAndAddOrdered(1);
+    s_enabled.storeRelease(1);
+    qDebug() << "开始逐帧跟踪";
+}
+
+/**
+ * @brief          停止后只读取已经写完的记录（正在写的最后一条可能不包括），
+ *                 输出Chrome trace-event格式：每个区间一个"X"事件，时间单位微秒，线程名称作为元数据
+ * @param fileName
+ * @return
+ */
+bool Tracer::stop(const QString &fileName)
+{
+    s_enabled.storeRelease(0);
+    int generation = m_generation.loadAcquire();
+    m_mutex.lock();
+    QList<ThreadBuffer*> buffers = m_buffers;
+    m_mutex.unlock();
+
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    int events = 0;
+    bool first = true;
+    auto append = [&](const QByteArray& event) {
+        if(!first) out += ",\n";
+        out += event;
+        first = false;
+    };
+    for(ThreadBuffer* buffer : qAsConst(buffers))
+    {
+        if(buffer->generation.loadAcquire() != generation) continue;   // 这次跟踪没有记录
+        QString name = buffer->name;
+        name.replace('\\', "\\\\").replace('"', "\\\"");
+        append(QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%1,\"args\":{\"name\":\"%2\"}}")
+                   .arg(buffer->id).arg(name).toUtf8());
+        int count = buffer->count.loadAcquire();
+        for(int i = 0; i < count; i++)
+        {
+            const Event& e = buffer->events[i];
+            append(QByteArray("{\"name\":\"") + e.name + "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + QByteArray::number(buffer->id)
+                   + ",\"ts\":" + QByteArray::number(e.begin / 1000.0, 'f', 3)
+                   + ",\"dur\":" + QByteArray::number(e.duration / 1000.0, 'f', 3)
+                   + ",\"args\":{\"stream\":" + QByteArray::number(e.stream) + ",\"pts\":" + QByteArray::number(e.pts) + "}}");
+        }
+        events += count;
+    }
+    out += "\n]}\n";
+
+    QSaveFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly) || file.write(out) < 0 || !file.commit())
+    {
+        qWarning() << "写入跟踪文件失败：" << fileName << file.errorString();
+        return false;
+    }
+    qDebug() << QString("跟踪结束：%1个区间，丢弃%2个，%3").arg(events).arg(droppedEvents()).arg(fileName);
+    return true;
+}
+
+/**
+ * @brief        记录一个区间，可以在任意线程中调用；begin可以来自其它线程（如信号跨线程的发送时间）
+ * @param name
+ * @param begin
+ * @param stream 播放会话编号
+ * @param pts    帧时间（毫秒），未知时为-1
+ */
+void Tracer::complete(const char *name, qint64 begin, int stream, qint64 pts)
+{
+    if(!s_enabled.loadAcquire()) return;
+    qint64 end = now();
+    ThreadBuffer* buffer = threadBuffer();
+    int generation = m_generation.loadAcquire();
+    if(buffer->generation.loadRelaxed() != generation)
+    {
+        buffer->count.storeRelease(0);            // 新的一次跟踪，先清空再更新编号
+        buffer->dropped.storeRelaxed(0);
+        buffer->generation.storeRelease(generation);
+    }
+    int count = buffer->count.loadRelaxed();
+    if(count >= THREAD_EVENTS)
+    {
+        buffer->dropped.fetchAndAddRelaxed(1);
+        return;
+    }
+    buffer->events[count] = {name, begin, end - begin, stream, pts};
+    buffer->count.storeRelease(count + 1);
+}
+
+qint64 Tracer::droppedEvents()
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 dropped = 0;
+    int generation = m_generation.loadAcquire();
+    for(ThreadBuffer* buffer : qAsConst(m_buffers))
+    {
+        if(buffer->generation.loadAcquire() == generation) dropped += buffer->dropped.loadRelaxed();
+    }
+    return dropped;
+}
+
+/**
+ * @brief 优先使用已经结束的线程留下的缓冲区：同一次跟踪中继续追加（显示在同一行，线程先后不重叠），
+ *        名称沿用第一个线程的名称（线程池的线程名称相同），停止时不需要加锁读取名称
+ */
+Tracer::ThreadBuffer *Tracer::threadBuffer()
+{
+    if(t_owner.buffer) return t_owner.buffer;
+
+    m_mutex.lock();
+    ThreadBuffer* buffer = m_free.isEmpty() ? nullptr : m_free.takeLast();
+    m_mutex.unlock();
+    if(!buffer)
+    {
+        buffer = new ThreadBuffer();
+        buffer->events = new Event[THREAD_EVENTS];
+        QThread* thread = QThread::currentThread();
+        QString name = thread->objectName();
+        if(name.isEmpty())
+        {
+            bool gui = QCoreApplication::instance() && thread == QCoreApplication::instance()->thread();
+            name = gui ? QString("GUI") : QString(thread->metaObject()->className());
+        }
+        m_mutex.lock();
+        buffer->id = m_buffers.size() + 1;
+        buffer->name = name + QString(" %1").arg(buffer->id);
+        m_buffers.append(buffer);
+        m_mutex.unlock();
+    }
+    t_owner.buffer = buffer;
+    return buffer;
+}
+
+void Tracer::releaseBuffer(ThreadBuffer *buffer)
+{
+    QMutexLocker locker(&m_mutex);
+    m_free.append(buffer);
+}
@@ -0,0 +1,84 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+/**
+ * @brief 逐帧跟踪：记录每一帧在各个线程中的处理区间（解封装、送包、取帧、滤镜、转换、信号跨线程、上传、绘制、交换），
+ *        区间带播放会话编号和帧时间。每个线程写自己的缓冲区（单写者，不加锁），停止时写出Chrome trace-event JSON，
+ *        可以用chrome://tracing或Perfetto UI打开。没有开启时记录函数只读取一次原子变量
+ */
+class Tracer
+{
+public:
+    static Tracer* instance();
+    static bool isEnabled();
+    static qint64 now();                          // 跟踪时钟（纳秒）
+
+    void start();                                 // 清空之前的记录并开始跟踪
+    bool stop(const QString& fileName);           // 停止跟踪并写出文件
+    void complete(const char* name, qint64 begin, int stream, qint64 pts);   // 记录从begin到现在的区间，name必须是字符串常量
+    qint64 droppedEvents();                       // 缓冲区满丢弃的记录数
+
+private:
+    Tracer();
+    struct Event
+    {
+        const char* name;
+        qint64 begin;                             // 纳秒
+        qint64 duration;
+        int    stream;
+        qint64 pts;
+    };
+    struct ThreadBuffer
+    {
+        QString name;
+        int     id = 0;
+        QAtomicInt generation = 0;                // 属于哪一次跟踪，不同时由所属线程清空
+        QAtomicInt count = 0;                     // 已经写完的记录数（所属线程写入后release，停止时acquire读取）
+        QAtomicInt dropped = 0;
+        Event*  events = nullptr;
+    };
+    ThreadBuffer* threadBuffer();                 // 当前线程的缓冲区，第一次使用时取空闲的缓冲区或注册新的
+    void releaseBuffer(ThreadBuffer* buffer);     // 线程结束时把缓冲区放回空闲列表
+    friend struct ThreadBufferOwner;
+
+private:
+    QMutex m_mutex;                               // 只保护缓冲区列表
+    QList<ThreadBuffer*> m_buffers;               // 所有缓冲区，不释放；数量不超过同时记录过的线程数
+    QList<ThreadBuffer*> m_free;                  // 所属线程已经结束的缓冲区，记录保留到被新的线程使用
+    QAtomicInt m_generation = 0;
+    QElapsedTimer m_clock;
+};
+
+/**
+ * @brief 作用域内的一个跟踪区间，析构时记录；帧时间在开始时还不知道时用setPts补充
+ */
+class TraceSpan
+{
+public:
+    TraceSpan(const char* name, int stream, qint64 pts = -1)
+        : m_name(name), m_stream(stream), m_pts(pts), m_begin(Tracer::isEnabled() ? Tracer::now() : -1)
+    {
+    }
+    ~TraceSpan()
+    {
+        if(m_begin >= 0) Tracer::instance()->complete(m_name, m_begin, m_stream, m_pts);
+    }
+    void setPts(qint64 pts)
+    {
+        m_pts = pts;
+    }
+
+private:
+    const char* m_name;
+    int    m_stream;
+    qint64 m_pts;
+    qint64 m_begin;                               // 小于0表示开始时没有开启跟踪
+};
+
+#endif // TRACER_H
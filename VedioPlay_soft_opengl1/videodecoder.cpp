@@ -2,7 +2,14 @@
 
 
 #include "videodecoder.h"
+#include "packetrecorder.h"
+#include "timeshiftbuffer.h"
+#include "frametap.h"
+#include "filtergraph.h"
+#include "metrics.h"
+#include "tracer.h"
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QImage>
 #include <QMutex>
 #include <qdatetime.h>
@@ -25,11 +32,14 @@ extern "C" {        // 用C规则编译指定的代码
 VideoDecoder::VideoDecoder()
 {
     m_error = new char[ERROR_LEN];
+    m_taps = new FrameTapList();
 }
 
 VideoDecoder::~VideoDecoder()
 {
     close();
+    delete m_taps;
+    delete m_filter;
 }
 
 
@@ -42,7 +52,17 @@ bool VideoDecoder::open(const QString &url)
     av_dict_set(&dict, "max_delay", "3", 0);             // 设置最大复用或解复用延迟（以微秒为单位）。当通过【UDP】 接收数据时，解复用器尝试重新排序接收到的数据包（因为它们可能无序到达，或者数据包可能完全丢失）。这可以通过将最大解复用延迟设置为零（通过max_delayAVFormatContext 字段）来禁用。
     av_dict_set(&dict, "timeout", "1000000", 0);         // 以微秒为单位设置套接字 TCP I/O 超时，如果等待时间过短，也可能会还没连接就返回了。
 
-    // 打开输入流并返回解封装上下文
+    // 预先分配解封装上下文，设置中断回调，这样打开、读取网络流阻塞时可以被setInterrupted中断
+    m_formatContext = avformat_alloc_context();
+    if(!m_formatContext)
+    {
+        av_dict_free(&dict);
+        return false;
+    }
+    m_formatContext->interrupt_callback.callback = &VideoDecoder::interruptCallback;
+    m_formatContext->interrupt_callback.opaque   = this;
+
+    // 打开输入流并返回解封装上下文（失败时会释放m_formatContext）
     int ret = avformat_open_input(&m_formatContext,          // 返回解封装上下文
                                   url.toStdString().data(),  // 打开视频地址
                                   nullptr,                   // 如果非null，此参数强制使用特定的输入格式。自动选择解封装器（文件格式）
@@ -71,6 +91,8 @@ bool VideoDecoder::open(const QString &url)
         free();
         return false;
     }
+    // 查找与视频流相关的音频流，没有音频时返回负数（不算错误，只有录制时使用）
+    m_audioIndex = av_find_best_stream(m_formatContext, AVMEDIA_TYPE_AUDIO, -1, m_videoIndex, nullptr, 0);
     AVStream* videoStream = m_formatContext->streams[m_videoIndex];  // 通过查询到的索引获取视频流
 
     // 获取视频图像分辨率（AVStream中的AVCodecContext在新版本中弃用，改为使用AVCodecParameters）
@@ -110,6 +132,7 @@ bool VideoDecoder::open(const QString &url)
     }
     m_codecContext->flags2 |= AV_CODEC_FLAG2_FAST;    // 允许不符合规范的加速技巧。
     m_codecContext->thread_count = 8;                 // 使用8线程解码
+    setFrameSkip(m_frameSkip);
     // 初始化解码器上下文，如果之前avcodec_alloc_context3传入了解码器，这里设置NULL就可以
     ret = avcodec_open2(m_codecContext, nullptr, nullptr);
     if(ret < 0)
@@ -139,72 +162,376 @@ bool VideoDecoder::open(const QString &url)
         free();
         return false;
     }
-    // 分配图像空间
-    int size = av_image_get_buffer_size(AV_PIX_FMT_RGBA, m_size.width(), m_size.height(), 4);
-
-    m_buffer = new uchar[size + 1000];    // 这里多分配1000个字节就基本不会出现拷贝超出的情况了，反正不缺这点内存
-    //    m_image = new QImage(m_buffer, m_size.width(), m_size.height(), QImage::Format_RGBA8888);
-    // 这种方式分配内存大部分情况下也可以，但是因为存在拷贝超出数组的情况，delete时也会报错
+    m_lastFrame = av_frame_alloc();
+    if(!m_lastFrame)
+    {
+#if PRINT_LOG
+        qWarning() << "av_frame_alloc() Error！";
+#endif
+        free();
+        return false;
+    }
+    m_readDts.fill(AV_NOPTS_VALUE, int(m_formatContext->nb_streams));   // AV_NOPTS_VALUE是最小的int64
+    m_rereading = false;
     m_end = false;
+    resumeRecord();
     return true;
 }
 
 QImage VideoDecoder::read()
 {
-    if(!m_formatContext)
+    if(!decodeNext())
     {
         return QImage();
     }
+    return convert();
+}
+
+/**
+ * @brief  与read()相同，但不转换为RGBA，截图、批量导出时直接使用解码后的YUV数据
+ * @return 解码后的一帧，下次读取前有效；没有图像时返回nullptr
+ */
+const AVFrame *VideoDecoder::readFrame()
+{
+    return decodeNext() ? m_lastFrame : nullptr;
+}
+
+/**
+ * @brief  最后解码的一帧，可以通过av_frame_clone增加引用后在其它线程中使用
+ * @return 还没有解码出图像时返回nullptr
+ */
+const AVFrame *VideoDecoder::frame()
+{
+    return (m_lastFrame && m_lastFrame->buf[0]) ? m_lastFrame : nullptr;
+}
+
+/**
+ * @brief       OpenGL显示可以直接上传16位平面，这些格式不需要转换为RGBA
+ * @param frame
+ * @return
+ */
+bool VideoDecoder::isHighBitDepth(const AVFrame *frame)
+{
+    if(!frame) return false;
+    return frame->format == AV_PIX_FMT_YUV420P10LE || frame->format == AV_PIX_FMT_YUV420P12LE
+           || frame->format == AV_PIX_FMT_P010LE;
+}
+
+/**
+ * @brief  读取一个数据包送入解码器，并尝试取出一帧
+ * @return 取出一帧时返回true
+ */
+bool VideoDecoder::decodeNext()
+{
+    if(!m_formatContext)
+    {
+        return false;
+    }
     // 读取下一帧数据
-    int readRet = av_read_frame(m_formatContext, m_packet);
+    int readRet = demux();
+    if(!m_decodeEnabled)
+    {
+        // 只解封装不解码
+        av_packet_unref(m_packet);
+        if(readRet < 0)
+        {
+            m_end = true;
+        }
+        return false;
+    }
     if(readRet < 0)
     {
         avcodec_send_packet(m_codecContext, m_packet); // 读取完成后向解码器中传如空AVPacket，否则无法读取出最后几帧
     }
     else
     {
-        if(m_packet->stream_index == m_videoIndex)     // 如果是图像数据则进行解码
+        sendPacket();
+    }
+    av_packet_unref(m_packet);  // 释放数据包，引用计数-1，为0时释放空间
+    return receive(readRet < 0);
+}
+
+/**
+ * @brief  只读取数据包（转发给录制器和时移缓冲）不解码，时移播放时由调用者从时移缓冲中取数据包解码
+ * @return 读取失败（结束或网络断开）时返回false
+ */
+bool VideoDecoder::readPacket()
+{
+    if(!m_formatContext)
+    {
+        return false;
+    }
+    int readRet = demux();
+    av_packet_unref(m_packet);
+    return readRet >= 0;
+}
+
+/**
+ * @brief         解码外部传入的数据包（比如时移缓冲中的数据包），packet本身不会被修改
+ * @param packet  时间戳为输入流时间基，不是视频数据包时直接忽略
+ * @return        解码得到的图像，解码器还没有输出时返回空图像
+ */
+QImage VideoDecoder::decode(const AVPacket *packet)
+{
+    if(!m_formatContext || !packet || packet->stream_index != m_videoIndex)
+    {
+        return QImage();
+    }
+    if(av_packet_ref(m_packet, packet) < 0)
+    {
+        return QImage();
+    }
+    sendPacket();
+    av_packet_unref(m_packet);
+    if(!receive(false))
+    {
+        return QImage();
+    }
+    return convert();
+}
+
+/**
+ * @brief 清空解码器中缓存的帧，跳转（时移回看、回到直播）后需要调用，否则会输出跳转前的图像
+ */
+void VideoDecoder::flush()
+{
+    if(m_codecContext)
+    {
+        avcodec_flush_buffers(m_codecContext);
+    }
+    if(m_filter)
+    {
+        m_filter->reset();
+    }
+    m_decodeTime = 0;
+}
+
+/**
+ * @brief  读取下一个数据包到m_packet（先取待机缓存的数据包），并转发给录制器、时移缓冲
+ * @return av_read_frame的返回值
+ */
+int VideoDecoder::demux()
+{
+    TraceSpan span("demux", m_metricsSession);
+    int readRet = 0;
+    if(!m_preroll.isEmpty())
+    {
+        AVPacket* packet = m_preroll.dequeue();   // 接管待机解码器后先送入缓存的GOP
+        m_prerollBytes -= packet->size;
+        av_packet_move_ref(m_packet, packet);
+        av_packet_free(&packet);
+    }
+    else
+    {
+        readRet = av_read_frame(m_formatContext, m_packet);
+    }
+    if(readRet >= 0)
+    {
+        if(m_packet->stream_index == m_videoIndex && m_packet->pts != AV_NOPTS_VALUE)
         {
-            // 计算当前帧时间（毫秒）
+            span.setPts(qRound64(m_packet->pts * (1000 * rationalToDouble(&m_formatContext->streams[m_videoIndex]->time_base))));
+        }
+        Metrics::instance()->add("vedioplay_received_bytes_total", m_metricsSession, m_packet->size);
+        // 录制和时移需要原始时间戳，所以要在时间戳转换之前送入；逐帧后退、跳转后重新读取的数据包已经送入过，不再重复
+        bool forward = isNewPacket();
+        if(forward && m_recorder)
+        {
+            m_recorder->pushPacket(m_packet);
+        }
+        if(forward && m_timeShift)
+        {
+            m_timeShift->push(m_packet);
+        }
+    }
+    return readRet;
+}
+
+/**
+ * @brief  按流记录读取到的最大解码时间戳，不超过的数据包是跳转后重新读取的；
+ *         没有时间戳的数据包在重新读取期间不转发
+ * @return
+ */
+bool VideoDecoder::isNewPacket()
+{
+    int index = m_packet->stream_index;
+    if(index < 0 || index >= m_readDts.size()) return false;
+    qint64 ts = (m_packet->dts != AV_NOPTS_VALUE) ? m_packet->dts : m_packet->pts;
+    if(ts == AV_NOPTS_VALUE) return !m_rereading;
+    if(ts <= m_readDts.at(index)) return false;
+    m_readDts[index] = ts;
+    m_rereading = false;                      // 已经追上跳转前读取的位置
+    return true;
+}
+
+/**
+ * @brief 将m_packet中的视频数据包送入解码器
+ */
+void VideoDecoder::sendPacket()
+{
+    if(m_packet->stream_index != m_videoIndex)     // 如果是图像数据则进行解码
+    {
+        return;
+    }
+    // 计算当前帧时间（毫秒）
 #if 1       // 方法一：适用于所有场景，但是存在一定误差
-            m_packet->pts = qRound64(m_packet->pts * (1000 * rationalToDouble(&m_formatContext->streams[m_videoIndex]->time_base)));
-            m_packet->dts = qRound64(m_packet->dts * (1000 * rationalToDouble(&m_formatContext->streams[m_videoIndex]->time_base)));
+    m_packet->pts = qRound64(m_packet->pts * (1000 * rationalToDouble(&m_formatContext->streams[m_videoIndex]->time_base)));
+    m_packet->dts = qRound64(m_packet->dts * (1000 * rationalToDouble(&m_formatContext->streams[m_videoIndex]->time_base)));
 #else       // 方法二：适用于播放本地视频文件，计算每一帧时间较准，但是由于网络视频流无法获取总帧数，所以无法适用
-            m_obtainFrames++;
-            m_packet->pts = qRound64(m_obtainFrames * (qreal(m_totalTime) / m_totalFrames));
-#endif \
+    m_obtainFrames++;
+    m_packet->pts = qRound64(m_obtainFrames * (qreal(m_totalTime) / m_totalFrames));
+#endif
+    if(m_packet->flags & AV_PKT_FLAG_CORRUPT)
+    {
+        Metrics::instance()->add("vedioplay_corrupt_packets_total", m_metricsSession);   // 网络丢包时解封装器标记为损坏
+    }
     // 将读取到的原始数据包传入解码器
-            int ret = avcodec_send_packet(m_codecContext, m_packet);
-            if(ret < 0)
+    TraceSpan span("send", m_metricsSession, m_packet->pts);
+    QElapsedTimer timer;
+    timer.start();
+    int ret = avcodec_send_packet(m_codecContext, m_packet);
+    m_decodeTime += timer.nsecsElapsed();
+    if(ret < 0)
+    {
+        Metrics::instance()->add("vedioplay_decode_errors_total", m_metricsSession);
+        showError(ret);
+    }
+}
+
+/**
+ * @brief         从解码器中取出一帧，保存到m_lastFrame（只移动引用，不拷贝数据）
+ * @param readEnd 是否已经无法读取到数据包，此时解码器中也没有数据表示读取完成
+ * @return        取出一帧时返回true
+ */
+bool VideoDecoder::receive(bool readEnd)
+{
+    if(m_filterChanged.loadAcquire())
+    {
+        updateFilter();
+    }
+    TraceSpan span("receive", m_metricsSession);
+    QElapsedTimer timer;
+    timer.start();
+    if(m_filter)
+    {
+        if(!filterNext(readEnd))
+        {
+            m_decodeTime += timer.nsecsElapsed();
+            return false;
+        }
+    }
+    else
+    {
+        int ret = avcodec_receive_frame(m_codecContext, m_frame);
+        if(ret < 0)
+        {
+            m_decodeTime += timer.nsecsElapsed();
+            av_frame_unref(m_frame);
+            if(readEnd)
             {
-                showError(ret);
+                m_end = true;     // 当无法读取到AVPacket并且解码器中也没有数据时表示读取完成
             }
+            return false;
         }
     }
-    av_packet_unref(m_packet);  // 释放数据包，引用计数-1，为0时释放空间
-    int ret = avcodec_receive_frame(m_codecContext, m_frame);
-    if(ret < 0)
+    // 解码耗时：上一帧之后所有送包、取帧的时间，滤镜的耗时单独统计
+    m_decodeTime += timer.nsecsElapsed();
+    if(m_filter)
     {
-        av_frame_unref(m_frame);
-        if(readRet < 0)
+        qint64 filterTime = m_filter->takeCost();
+        m_decodeTime -= filterTime;
+        Metrics::instance()->observe("vedioplay_filter_seconds", m_metricsSession, filterTime / 1e9);
+    }
+    Metrics::instance()->observe("vedioplay_decode_seconds", m_metricsSession, m_decodeTime / 1e9);
+    Metrics::instance()->add("vedioplay_decoded_frames_total", m_metricsSession);
+    if(m_frame->decode_error_flags)
+    {
+        Metrics::instance()->add("vedioplay_decode_errors_total", m_metricsSession);
+    }
+    m_decodeTime = 0;
+    span.setPts(m_frame->pts);
+
+    m_pts = m_frame->pts;
+    m_keyFrame = m_frame->key_frame;
+    av_frame_unref(m_lastFrame);
+    av_frame_move_ref(m_lastFrame, m_frame);
+    m_taps->deliver(m_lastFrame, m_pts);          // 分析接口直接使用YUV数据，不需要转换
+    return true;
+}
+
+/**
+ * @brief         先取出滤镜中已经处理好的帧，没有时从解码器取帧送入滤镜，直到得到输出或解码器也没有数据
+ * @param readEnd 解码器输出结束后刷新滤镜，取出滤镜中剩余的帧
+ * @return        结果保存在m_frame中
+ */
+bool VideoDecoder::filterNext(bool readEnd)
+{
+    while(true)
+    {
+        {
+            TraceSpan span("filter", m_metricsSession);
+            if(m_filter->pull(m_frame))
+            {
+                span.setPts(m_frame->pts);
+                return true;
+            }
+        }
+        if(m_filter->isEnd())
         {
-            m_end = true;     // 当无法读取到AVPacket并且解码器中也没有数据时表示读取完成
+            m_end = true;
+            return false;
         }
-        return QImage();
+        int ret = avcodec_receive_frame(m_codecContext, m_frame);
+        if(ret < 0)
+        {
+            av_frame_unref(m_frame);
+            if(ret == AVERROR_EOF)
+            {
+                TraceSpan span("filter", m_metricsSession);
+                m_filter->push(nullptr);          // 解码器已经输出全部帧，刷新滤镜
+                continue;
+            }
+            if(readEnd)
+            {
+                m_end = true;
+            }
+            return false;
+        }
+        TraceSpan span("filter", m_metricsSession, m_frame->pts);
+        if(!m_filter->push(m_frame))
+        {
+            return true;                          // 滤镜不可用时直接使用解码后的帧
+        }
+        av_frame_unref(m_frame);                  // 滤镜已经持有引用
     }
+}
 
-    m_pts = m_frame->pts;
+void VideoDecoder::updateFilter()
+{
+    QMutexLocker locker(&m_filterMutex);
+    m_filterChanged.storeRelease(0);
+    delete m_filter;
+    m_filter = m_filterRequest.isEmpty() ? nullptr : new FilterGraph(m_filterRequest, m_filterThreads);
+}
 
-    // 为什么图像转换上下文要放在这里初始化呢，是因为m_frame->format，如果使用硬件解码，解码出来的图像格式和m_codecContext->pix_fmt的图像格式不一样，就会导致无法转换为QImage
-    if(!m_swsContext)
+/**
+ * @brief  将m_lastFrame转换为QImage
+ * @return 每次转换到新分配的图像中，QImage本身有引用计数，可以直接跨线程传递、保存，不需要再拷贝
+ */
+QImage VideoDecoder::convert()
+{
+    if(!frame()) return QImage();
+    TraceSpan span("convert", m_metricsSession, m_pts);
+    AVFrame* frame = m_lastFrame;
+    // 为什么图像转换上下文要放在这里初始化呢，是因为frame->format，如果使用硬件解码，解码出来的图像格式和m_codecContext->pix_fmt的图像格式不一样，就会导致无法转换为QImage
+    // 滤镜可能改变图像尺寸、格式，所以每帧都检查，参数不变时sws_getCachedContext直接返回原来的上下文
     {
         // 获取缓存的图像转换上下文。首先校验参数是否一致，如果校验不通过就释放资源；然后判断上下文是否存在，如果存在直接复用，如不存在进行分配、初始化操作
         m_swsContext = sws_getCachedContext(m_swsContext,
-                                            m_frame->width,                     // 输入图像的宽度
-                                            m_frame->height,                    // 输入图像的高度
-                                            (AVPixelFormat)m_frame->format,     // 输入图像的像素格式
-                                            m_size.width(),                     // 输出图像的宽度
-                                            m_size.height(),                    // 输出图像的高度
+                                            frame->width,                       // 输入图像的宽度
+                                            frame->height,                      // 输入图像的高度
+                                            (AVPixelFormat)frame->format,       // 输入图像的像素格式
+                                            frame->width,                       // 输出图像的宽度
+                                            frame->height,                      // 输出图像的高度
                                             AV_PIX_FMT_RGBA,                    // 输出图像的像素格式
                                             SWS_BILINEAR,                       // 选择缩放算法(只有当输入输出图像大小不同时有效),一般选择SWS_FAST_BILINEAR
                                             nullptr,                            // 输入图像的滤波器信息, 若不需要传NULL
@@ -220,22 +547,22 @@ QImage VideoDecoder::read()
         }
     }
 
-    // AVFrame转QImage
-    uchar* data[]  = {m_buffer};
-    int    lines[4];
-    av_image_fill_linesizes(lines, AV_PIX_FMT_RGBA, m_frame->width);  // 使用像素格式pix_fmt和宽度填充图像的平面线条大小。
-    ret = sws_scale(m_swsContext,             // 缩放上下文
-                    m_frame->data,            // 原图像数组
-                    m_frame->linesize,        // 包含源图像每个平面步幅的数组
-                    0,                        // 开始位置
-                    m_frame->height,          // 行数
-                    data,                     // 目标图像数组
-                    lines);                   // 包含目标图像每个平面的步幅的数组
-    QImage image(m_buffer, m_frame->width, m_frame->height, QImage::Format_RGBA8888);
-    av_frame_unref(m_frame);
-
+    // AVFrame转QImage，sws_scale直接写入QImage的内存
+    QImage image(frame->width, frame->height, QImage::Format_RGBA8888);
+    if(image.isNull())
+    {
+        return QImage();
+    }
+    uchar* data[]  = {image.bits()};
+    int    lines[] = {int(image.bytesPerLine())};
+    sws_scale(m_swsContext,             // 缩放上下文
+              frame->data,              // 原图像数组
+              frame->linesize,          // 包含源图像每个平面步幅的数组
+              0,                        // 开始位置
+              frame->height,            // 行数
+              data,                     // 目标图像数组
+              lines);                   // 包含目标图像每个平面的步幅的数组
     return image;
-
 }
 
 void VideoDecoder::showError(int err)
@@ -249,6 +576,21 @@ void VideoDecoder::showError(int err)
 #endif
 }
 
+/**
+ * @brief             设置中断标志，为true时正在阻塞的avformat_open_input、av_read_frame会立即返回错误（按读取结束处理），
+ *                    需要在下次open之前设置为false
+ * @param interrupted
+ */
+void VideoDecoder::setInterrupted(bool interrupted)
+{
+    m_interrupted.storeRelease(interrupted ? 1 : 0);
+}
+
+int VideoDecoder::interruptCallback(void *opaque)
+{
+    return static_cast<VideoDecoder*>(opaque)->m_interrupted.loadAcquire();
+}
+
 bool VideoDecoder::isEnd()
 {
     return m_end;
@@ -261,22 +603,354 @@ const qint64 &VideoDecoder::pts()
 {
     return m_pts;
 }
+
+bool VideoDecoder::isKeyFrame()
+{
+    return m_keyFrame;
+}
+
+qint64 VideoDecoder::totalTime()
+{
+    return m_totalTime;
+}
+
+qreal VideoDecoder::frameRate()
+{
+    return m_frameRate;
+}
+
+QSize VideoDecoder::videoSize()
+{
+    return m_size;
+}
+
+/**
+ * @brief          跳转到msec之前最近的关键帧，之后read()从这个关键帧开始解码（只支持本地文件等可以跳转的输入）
+ * @param msec     与pts()相同的时间（毫秒）
+ * @param backward true：跳转到msec之前的关键帧  false：跳转到msec之后的关键帧（快进时使用）
+ * @return
+ */
+bool VideoDecoder::seek(qint64 msec, bool backward)
+{
+    if(!m_formatContext)
+    {
+        return false;
+    }
+    AVStream* videoStream = m_formatContext->streams[m_videoIndex];
+    qint64 ts = av_rescale_q(msec, AVRational{1, 1000}, videoStream->time_base);
+    int ret = av_seek_frame(m_formatContext, m_videoIndex, ts, backward ? AVSEEK_FLAG_BACKWARD : 0);
+    if(ret < 0)
+    {
+        showError(ret);
+        return false;
+    }
+    avcodec_flush_buffers(m_codecContext);   // 清空解码器中跳转前的数据
+    clearPreroll();
+    m_rereading = true;
+    if(m_filter)
+    {
+        m_filter->reset();                   // 滤镜中也缓存了跳转前的帧（如yadif、fps）
+    }
+    m_end = false;
+    return true;
+}
+
+/**
+ * @brief      设置解码时跳过的帧，解码过程中可以随时修改，解码器打开前设置也会生效
+ * @param skip
+ */
+void VideoDecoder::setFrameSkip(FrameSkip skip)
+{
+    m_frameSkip = skip;
+    if(!m_codecContext) return;
+    switch (skip)
+    {
+    case SkipNone:
+        m_codecContext->skip_frame = AVDISCARD_DEFAULT;
+        break;
+    case SkipNonRef:
+        m_codecContext->skip_frame = AVDISCARD_NONREF;
+        break;
+    case SkipNonKey:
+        m_codecContext->skip_frame = AVDISCARD_NONKEY;
+        break;
+    }
+}
+
+VideoDecoder::FrameSkip VideoDecoder::frameSkip()
+{
+    return m_frameSkip;
+}
+/**
+ * @brief           开始录制，需要在open成功后调用
+ * @param recorder  录制器，由调用者管理生命周期
+ * @param fileName  录制文件名（.mp4/.mkv）
+ * @return
+ */
+bool VideoDecoder::startRecord(PacketRecorder *recorder, const QString &fileName)
+{
+    if(!m_formatContext || !recorder) return false;
+    stopRecord();
+    if(!recorder->open(fileName, m_formatContext, m_videoIndex, m_audioIndex))
+    {
+        return false;
+    }
+    m_recorder = recorder;
+    return true;
+}
+
+bool VideoDecoder::isRecording()
+{
+    return m_recorder != nullptr;
+}
+
+void VideoDecoder::stopRecord()
+{
+    if(m_recorder)
+    {
+        m_recorder->close();
+        m_recorder = nullptr;
+    }
+}
+
+/**
+ * @brief         开始把读取到的数据包缓存到时移缓冲中，需要在open成功后调用
+ * @param buffer  时移缓冲，由调用者管理生命周期
+ * @return
+ */
+bool VideoDecoder::startTimeShift(TimeShiftBuffer *buffer)
+{
+    if(!m_formatContext || !buffer) return false;
+    if(!buffer->setInput(m_formatContext, m_videoIndex, m_audioIndex))
+    {
+        return false;
+    }
+    m_timeShift = buffer;
+    return true;
+}
+
+void VideoDecoder::stopTimeShift()
+{
+    m_timeShift = nullptr;
+}
+
+/**
+ * @brief       注册分析接口，每解码出一帧时按帧率把缩小后的灰度图（Y平面）交给tap，可以在任意线程中调用
+ * @param tap   由调用者管理生命周期，释放前需要调用removeFrameTap
+ * @param fps   最大回调帧率
+ * @param width 灰度图最大宽度，Y平面按整数倍缩小到不超过这个宽度
+ */
+void VideoDecoder::addFrameTap(FrameTap *tap, qreal fps, int width)
+{
+    m_taps->add(tap, fps, width);
+}
+
+bool VideoDecoder::hasFrameTaps()
+{
+    return !m_taps->isEmpty();
+}
+
+void VideoDecoder::removeFrameTap(FrameTap *tap)
+{
+    m_taps->remove(tap);
+}
+
+/**
+ * @brief         设置解码后、转换之前的滤镜，在解码线程取下一帧时生效；滤镜改变图像尺寸时（crop、scale）输出图像尺寸也随之改变
+ * @param filters ffmpeg滤镜描述，与-vf参数相同，为空时关闭
+ * @param threads 滤镜图使用的线程数，与解码器线程数分开设置
+ */
+void VideoDecoder::setFilter(const QString &filters, int threads)
+{
+    QMutexLocker locker(&m_filterMutex);
+    m_filterRequest = filters;
+    m_filterThreads = threads;
+    m_filterChanged.storeRelease(1);
+}
+
+/**
+ * @brief          设置是否解码，关闭解码后read()只读取数据包（可以录制）不返回图像
+ * @param enabled
+ */
+void VideoDecoder::setDecodeEnabled(bool enabled)
+{
+    m_decodeEnabled = enabled;
+}
+
+/**
+ * @brief         统计读取、解码指标的播放会话，0（默认）表示不统计（待机、预读、缩略图使用的解码器）
+ * @param session
+ */
+void VideoDecoder::setMetricsSession(int session)
+{
+    m_metricsSession = session;
+}
+
+/**
+ * @brief          待机会话（StandbyPool）中调用：读取一个视频数据包保存引用，遇到关键帧时丢弃之前的包，
+ *                 第一个关键帧之前的包直接丢弃，所以缓存总是从最近的关键帧开始，接管后不需要等待下一个关键帧
+ * @param maxBytes 缓存上限，超过时清空并等待下一个关键帧（GOP很长的流）
+ * @return         读取失败（文件结束、网络断开）时返回false
+ */
+bool VideoDecoder::preroll(qint64 maxBytes)
+{
+    if(!m_formatContext) return false;
+
+    int ret = av_read_frame(m_formatContext, m_packet);
+    if(ret < 0)
+    {
+        if(ret == AVERROR_EOF)
+        {
+            m_end = true;
+        }
+        return false;
+    }
+    if(m_packet->stream_index != m_videoIndex)
+    {
+        av_packet_unref(m_packet);              // 待机时只保留视频
+        return true;
+    }
+    bool key = m_packet->flags & AV_PKT_FLAG_KEY;
+    if(key || m_prerollBytes + m_packet->size > maxBytes)
+    {
+        clearPreroll();
+    }
+    if(!key && m_preroll.isEmpty())
+    {
+        av_packet_unref(m_packet);              // 等待关键帧
+        return true;
+    }
+    AVPacket* packet = av_packet_alloc();
+    if(!packet)
+    {
+        av_packet_unref(m_packet);
+        return false;
+    }
+    av_packet_move_ref(packet, m_packet);
+    m_preroll.enqueue(packet);
+    m_prerollBytes += packet->size;
+    if(packet->pts != AV_NOPTS_VALUE)
+    {
+        m_prerollEnd = av_rescale_q(packet->pts, m_formatContext->streams[m_videoIndex]->time_base, AVRational{1, 1000});
+    }
+    return true;
+}
+
+bool VideoDecoder::hasPreroll()
+{
+    return !m_preroll.isEmpty();
+}
+
+qint64 VideoDecoder::prerollBytes()
+{
+    return m_prerollBytes;
+}
+
+qint64 VideoDecoder::prerollEnd()
+{
+    return m_preroll.isEmpty() ? -1 : m_prerollEnd;
+}
+
+/**
+ * @brief         接管待机解码器打开的解封装、解码上下文和缓存的数据包，省去连接、探测和等待关键帧的时间。
+ *                本对象的录制、时移、分析接口、滤镜、跳帧设置保持不变，standby接管后变为关闭状态
+ * @param standby 必须已经停止读取（没有其它线程在使用）
+ * @return        standby没有打开时返回false
+ */
+bool VideoDecoder::takeOver(VideoDecoder *standby)
+{
+    if(!standby || !standby->m_formatContext) return false;
+
+    closeInput();                                 // 正在录制时不停止，接管后写入下一个文件
+    m_formatContext = standby->m_formatContext;
+    m_codecContext  = standby->m_codecContext;
+    m_swsContext    = standby->m_swsContext;
+    m_packet        = standby->m_packet;
+    m_frame         = standby->m_frame;
+    m_lastFrame     = standby->m_lastFrame;
+    standby->m_formatContext = nullptr;
+    standby->m_codecContext  = nullptr;
+    standby->m_swsContext    = nullptr;
+    standby->m_packet        = nullptr;
+    standby->m_frame         = nullptr;
+    standby->m_lastFrame     = nullptr;
+    m_formatContext->interrupt_callback.opaque = this;   // 中断标志改为使用本对象的
+
+    m_videoIndex   = standby->m_videoIndex;
+    m_audioIndex   = standby->m_audioIndex;
+    m_totalTime    = standby->m_totalTime;
+    m_totalFrames  = standby->m_totalFrames;
+    m_frameRate    = standby->m_frameRate;
+    m_size         = standby->m_size;
+    m_end          = standby->m_end;
+    m_preroll.swap(standby->m_preroll);
+    m_prerollBytes = standby->m_prerollBytes;
+    m_prerollEnd   = standby->m_prerollEnd;
+    m_readDts      = standby->m_readDts;
+    m_rereading    = false;
+    standby->m_prerollBytes = 0;
+    standby->close();
+
+    setFrameSkip(m_frameSkip);
+    if(m_filter)
+    {
+        m_filter->reset();
+    }
+    resumeRecord();
+    return true;
+}
+
 void VideoDecoder::close()
 {
+    stopRecord();
+    closeInput();
+}
+
+/**
+ * @brief 关闭输入，录制器仍然保留（这时不会收到数据包），打开失败时由close停止录制
+ */
+void VideoDecoder::closeInput()
+{
+    stopTimeShift();                              // 时移缓冲的参数属于当前输入，打开后由调用者重新开始
+    clearPreroll();
     clear();
     free();
 
     m_totalTime     = 0;
     m_videoIndex    = 0;
+    m_audioIndex    = -1;
     m_totalFrames   = 0;
     m_obtainFrames  = 0;
     m_pts           = 0;
+    m_keyFrame      = false;
     m_frameRate     = 0;
     m_size          = QSize(0, 0);
+    m_readDts.clear();
+    m_rereading     = false;
 }
 
 
 
+void VideoDecoder::resumeRecord()
+{
+    if(m_recorder && !m_recorder->reopen(m_formatContext, m_videoIndex, m_audioIndex))
+    {
+        qWarning() << "切换输入后继续录制失败！";
+        m_recorder = nullptr;
+    }
+}
+
+void VideoDecoder::clearPreroll()
+{
+    while(!m_preroll.isEmpty())
+    {
+        AVPacket* packet = m_preroll.dequeue();
+        av_packet_free(&packet);
+    }
+    m_prerollBytes = 0;
+    m_prerollEnd = -1;
+}
+
 /**
  * @brief 清空读取缓冲
  */
@@ -318,10 +992,9 @@ void VideoDecoder::free()
     {
         av_frame_free(&m_frame);
     }
-    if(m_buffer)
+    if(m_lastFrame)
     {
-        delete [] m_buffer;
-        m_buffer = nullptr;
+        av_frame_free(&m_lastFrame);
     }
 }
 qreal VideoDecoder::rationalToDouble(AVRational* rational)
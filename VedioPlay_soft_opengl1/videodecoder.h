@@ -3,6 +3,10 @@
 
 #include<QString>
 #include<QSize>
+#include<QAtomicInt>
+#include<QMutex>
+#include<QQueue>
+#include<QVector>
 
 
 struct AVFormatContext;
@@ -13,10 +17,22 @@ struct AVFrame;
 struct SwsContext;
 struct AVBufferRef;
 class QImage;
+class PacketRecorder;
+class TimeShiftBuffer;
+class FrameTap;
+class FrameTapList;
+class FilterGraph;
 
 
 class VideoDecoder
 {
+public:
+    enum FrameSkip      // 解码时跳过的帧（用于高倍速播放）
+    {
+        SkipNone,       // 解码全部帧
+        SkipNonRef,     // 跳过非参考帧（一般是B帧）
+        SkipNonKey      // 只解码关键帧
+    };
 public:
     VideoDecoder();
     ~VideoDecoder();
@@ -24,14 +40,57 @@ public:
 
     bool open(const QString& url=  QString());
     QImage read();
-    void close();
+    const AVFrame* readFrame();                   // 读取并解码一帧但不转换为QImage，没有图像时返回nullptr
+    const AVFrame* frame();                       // 最后解码的一帧（引用计数），下次读取前有效
+    QImage convert();                             // 将最后解码的一帧转换为新的QImage（readFrame之后按需转换）
+    static bool isHighBitDepth(const AVFrame* frame);   // 是否为可以直接显示的高位深格式（yuv420p10/yuv420p12/P010）
+    bool readPacket();                            // 只读取数据包不解码（时移播放时使用）
+    QImage decode(const AVPacket* packet);        // 解码外部传入的数据包
+    void flush();                                 // 清空解码器缓存
+    void close();                                 // 关闭输入并停止录制
+    void closeInput();                            // 只关闭输入，录制保留：之后open、takeOver新的输入时录制切换到下一个文件继续
+    void setInterrupted(bool interrupted);        // 中断阻塞的打开、读取（可以在其它线程中调用），关闭网络流时不需要等待超时
     bool isEnd();
     const qint64& pts();
+    bool isKeyFrame();                            // 最后解码的一帧是否为关键帧
+    qint64 totalTime();                           // 视频总时长（毫秒），网络流为0
+    qreal frameRate();                            // 视频帧率
+    QSize videoSize();                            // 视频分辨率
+    bool seek(qint64 msec, bool backward = true); // 跳转到msec之前（backward为false时之后）最近的关键帧
+    void setFrameSkip(FrameSkip skip);            // 设置解码时跳过的帧
+    FrameSkip frameSkip();
+
+    bool startRecord(PacketRecorder* recorder, const QString& fileName);  // 开始录制，读取到的数据包直接转发给录制器
+    void stopRecord();                            // 停止录制
+    bool isRecording();
+    void setDecodeEnabled(bool enabled);          // 是否解码，关闭后只解封装（只录制不显示时使用）
+    bool startTimeShift(TimeShiftBuffer* buffer); // 开始缓存数据包到时移缓冲
+    void stopTimeShift();
+    void addFrameTap(FrameTap* tap, qreal fps = 5, int width = 320);  // 注册分析接口，解码后直接使用Y平面（线程安全）
+    void removeFrameTap(FrameTap* tap);
+    bool hasFrameTaps();                          // 是否注册了分析接口（需要解码全部帧）
+    void setFilter(const QString& filters, int threads = 2);   // 设置libavfilter滤镜（如"yadif"、"fps=5"），为空时关闭，可以在任意线程中调用
+    bool preroll(qint64 maxBytes);                // 待机时读取一个数据包，只保留最近关键帧开始的视频包，不解码；读取失败时返回false
+    bool hasPreroll();                            // 是否已经缓存了关键帧
+    qint64 prerollBytes();                        // 缓存的数据包大小
+    qint64 prerollEnd();                          // 缓存的最后一个数据包时间（毫秒），没有缓存时为-1
+    bool takeOver(VideoDecoder* standby);         // 接管待机解码器已经打开的输入和缓存的数据包（录制、滤镜等设置保留本对象的）
+    void setMetricsSession(int session);          // 统计码率、解码耗时、丢包等指标和逐帧跟踪的会话（在读取线程之外设置时需要在打开之前）
 
 private:
+    int  demux();                                 // 读取数据包到m_packet并转发给录制器、时移缓冲
+    bool isNewPacket();                           // m_packet是否超过了已经读取的位置（跳转后重新读取的包不转发）
+    void sendPacket();                            // 将m_packet送入解码器
+    bool decodeNext();                            // 读取一个数据包并尝试取出一帧
+    bool receive(bool readEnd);                   // 取出解码后的一帧保存到m_lastFrame
+    bool filterNext(bool readEnd);                // 经过滤镜取出一帧到m_frame
+    void updateFilter();                          // 应用setFilter的修改
+    static int interruptCallback(void* opaque);   // ffmpeg阻塞时定期调用，返回非0时中断
     void showError(int err);                      // 显示ffmpeg执行错误时的错误信息
     qreal rationalToDouble(AVRational* rational); // 将AVRational转换为double
     void clear();                                 // 清空读取缓冲
+    void clearPreroll();                          // 释放待机缓存的数据包
+    void resumeRecord();                          // 打开新的输入后录制器切换到新输入
     void free();                                  // 释放
 
 private:
@@ -40,7 +99,9 @@ private:
     SwsContext* m_swsContext = nullptr;
     AVPacket* m_packet = nullptr;
     AVFrame*  m_frame  = nullptr;                 // 解码后的视频帧
+    AVFrame*  m_lastFrame = nullptr;              // 最后解码的一帧，保留引用用于截图、导出（不需要转换回YUV）
     int m_videoIndex = 0;
+    int m_audioIndex = -1;                        // 音频流索引，没有音频时小于0（只用于录制）
     qint64 m_totalTime = 0;//总时长和总帧数
     qint64 m_totalFrames  = 0;
     qint64 m_obtainFrames = 0;//当前已经获取的帧数
@@ -49,7 +110,25 @@ private:
     QSize  m_size;              //分辨率大小,QSize是QT中的一个用于表示二维的类
     char * m_error = nullptr;
     bool m_end = false;
-    uchar * m_buffer = nullptr; //这是用来存储yuv转rgba之后的数据
+    bool m_keyFrame = false;                      // 最后解码的一帧是否为关键帧
+    PacketRecorder* m_recorder = nullptr;         // 录制器，为空时不录制
+    TimeShiftBuffer* m_timeShift = nullptr;       // 时移缓冲，为空时不缓存
+    bool m_decodeEnabled = true;
+    FrameSkip m_frameSkip = SkipNone;
+    FrameTapList* m_taps = nullptr;               // 分析接口，在转换为RGBA之前回调
+    QAtomicInt m_interrupted = 0;                 // 中断标志
+    FilterGraph* m_filter = nullptr;              // 滤镜，为空时不处理
+    QMutex  m_filterMutex;
+    QString m_filterRequest;                      // 等待应用的滤镜设置
+    int     m_filterThreads = 2;
+    QAtomicInt m_filterChanged = 0;
+    QQueue<AVPacket*> m_preroll;                  // 待机时缓存的数据包（从关键帧开始），接管后demux先返回这些包
+    qint64  m_prerollBytes = 0;
+    qint64  m_prerollEnd = -1;
+    int     m_metricsSession = 0;                 // 指标、跟踪的会话，0表示不统计
+    qint64  m_decodeTime = 0;                     // 当前帧累计的解码耗时（纳秒）
+    QVector<qint64> m_readDts;                    // 每个流已经读取到的最大时间戳（读取的最前位置）
+    bool    m_rereading = false;                  // 跳转后正在重新读取已经转发过的位置
 
 };
 
@@ -0,0 +1,742 @@
+#include "videorenderer.h"
+#include "memorybudget.h"
+#include "metrics.h"
+#include <QMatrix3x3>
+#include <QVector2D>
+#include <QVector3D>
+#include <QDebug>
+
+extern "C" {        // 用C规则编译指定的代码
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+#define MAX_ZOOM    16      // 最大放大倍数
+
+// 三个顶点坐标XYZ，VAO、VBO数据播放，范围时[-1 ~ 1]直接
+static GLfloat vertices[] = {  // 前三列点坐标，后两列为纹理坐标
+    1.0f,  1.0f, 0.0f, 1.0f, 1.0f,      // 右上角
+    1.0f, -1.0f, 0.0f, 1.0f, 0.0f,      // 右下
+    -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,      // 左下
+    -1.0f,  1.0f, 0.0f, 0.0f, 1.0f      // 左上
+};
+static GLuint indices[] = {
+    0, 1, 3,
+    1, 2, 3
+};
+
+VideoRenderer::VideoRenderer()
+{
+}
+
+VideoRenderer::~VideoRenderer()
+{
+    if(m_initialized)
+    {
+        qWarning() << "VideoRenderer没有调用destroy释放GL资源";
+    }
+}
+
+/**
+ * @brief  创建着色器和顶点缓冲，调用时上下文必须是当前的
+ * @return 着色器编译失败时返回false
+ */
+bool VideoRenderer::initialize()
+{
+    initializeOpenGLFunctions();
+
+    m_program = createProgram(":/fragment.fsh");
+    // 后处理着色器，与显示使用同一个顶点着色器和VAO
+    m_deinterlaceProgram = createProgram(":/deinterlace.fsh");
+    m_colorProgram       = createProgram(":/coloradjust.fsh");
+    m_sharpenProgram     = createProgram(":/sharpen.fsh");
+    m_yuvProgram         = createProgram(":/yuv16.fsh");
+    m_scaleProgram       = createProgram(":/scale.fsh");
+    m_scaleTimer.create();                       // 不支持计时查询时isCreated()为false，不统计
+
+    // 返回属性名称在此着色器程序的参数列表中的位置。如果名称不是此着色器程序的有效属性，则返回-1。
+    GLuint posAttr = GLuint(m_program->attributeLocation("aPos"));
+    GLuint texCord = GLuint(m_program->attributeLocation("aTexCord"));
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glGenBuffers(1, &EBO);    // 创建一个EBO
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+    // 为当前绑定到的缓冲区对象创建一个新的数据存储target。任何预先存在的数据存储都将被删除。
+    glBufferData(GL_ARRAY_BUFFER,        // 为VBO缓冲绑定顶点数据
+                 sizeof (vertices),      // 数组字节大小
+                 vertices,               // 需要绑定的数组
+                 GL_STATIC_DRAW);        // 指定数据存储的预期使用模式,GL_STATIC_DRAW： 数据几乎不会改变
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);  // 将顶点索引数组传入EBO缓存
+
+    // 设置顶点坐标数据
+    glVertexAttribPointer(posAttr,                     // 指定要修改的通用顶点属性的索引
+                          3,                     // 指定每个通用顶点属性的组件数（如vec3：3，vec4：4）
+                          GL_FLOAT,              // 指定数组中每个组件的数据类型(数组中一行有几个数)
+                          GL_FALSE,              // 指定在访问定点数据值时是否应规范化 ( GL_TRUE) 或直接转换为定点值 ( GL_FALSE)，如果vertices里面单个数超过-1或者1可以选择GL_TRUE
+                          5 * sizeof(GLfloat),   // 指定连续通用顶点属性之间的字节偏移量。
+                          nullptr);              // 指定当前绑定到目标的缓冲区的数据存储中数组中第一个通用顶点属性的第一个组件的偏移量。初始值为0 (一个数组从第几个字节开始读)
+    // 启用通用顶点属性数组
+    glEnableVertexAttribArray(posAttr);                // 属性索引是从调用glGetAttribLocation接收的，或者传递给glBindAttribLocation。
+
+    // 设置纹理坐标数据
+    glVertexAttribPointer(texCord, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), reinterpret_cast<const GLvoid *>(3 * sizeof (GLfloat)));              // 指定当前绑定到目标的缓冲区的数据存储中数组中第一个通用顶点属性的第一个组件的偏移量。初始值为0 (一个数组从第几个字节开始读)
+    // 启用通用顶点属性数组
+    glEnableVertexAttribArray(texCord);                // 属性索引是从调用glGetAttribLocation接收的，或者传递给glBindAttribLocation。
+    // 释放
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);                        // 设置为零以破坏现有的顶点数组对象绑定
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);        // 指定颜色缓冲区的清除值(背景色)
+    m_initialized = true;
+    return m_program->isLinked() && m_yuvProgram->isLinked() && m_scaleProgram->isLinked();
+}
+
+/**
+ * @brief 释放纹理、帧缓冲和着色器，调用时上下文必须是当前的（与initialize相同的上下文）
+ */
+void VideoRenderer::destroy()
+{
+    MemoryBudget::instance()->release(m_session, MemoryBudget::Texture, m_textureBytes + m_fboBytes + m_planeBytes + m_scaleBytes);
+    m_textureBytes = m_fboBytes = m_planeBytes = m_scaleBytes = 0;
+    if(!m_initialized) return;
+
+    // 释放纹理
+    if(m_texture)
+    {
+        m_texture->destroy();
+        delete m_texture;
+        m_texture = nullptr;
+    }
+    delete m_fbo[0];
+    delete m_fbo[1];
+    delete m_scaleFbo;
+    m_fbo[0] = m_fbo[1] = m_scaleFbo = nullptr;
+    m_scaleTimer.destroy();
+    glDeleteTextures(3, m_planes);
+    m_planes[0] = m_planes[1] = m_planes[2] = 0;
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteVertexArrays(1, &VAO);
+    for(QOpenGLShaderProgram** program : {&m_program, &m_deinterlaceProgram, &m_colorProgram,
+                                          &m_sharpenProgram, &m_yuvProgram, &m_scaleProgram})
+    {
+        delete *program;
+        *program = nullptr;
+    }
+    m_postTexture = 0;
+    m_initialized = false;
+}
+
+/**
+ * @brief       保存图像，在下一次upload/render时上传（上下文是当前的），可以在没有上下文时调用
+ * @param image
+ */
+void VideoRenderer::setImage(const QImage &image)
+{
+    if(image.isNull()) return;
+
+    m_image = image;
+    m_yuvFrame.reset();
+    m_yuvDirty = false;
+    m_postTexture = 0;                          // 新的图像需要重新后处理
+    if(image.size() != m_size)
+    {
+        m_size = image.size();
+        updateLayout();
+    }
+}
+
+/**
+ * @brief       显示高位深YUV帧（yuv420p10/yuv420p12/P010），只保存引用，上传时把16位平面上传为GL_R16/GL_RG16纹理，
+ *              颜色转换和HDR（PQ/HLG）色调映射在着色器中完成，不经过8位RGBA
+ * @param frame
+ */
+void VideoRenderer::setFrame(const QSharedPointer<AVFrame> &frame)
+{
+    if(!frame) return;
+
+    QSize size(frame->width, frame->height);
+    m_image = QImage();
+    m_yuvFrame = frame;
+    m_yuvDirty = true;
+    m_postTexture = 0;
+    if(size != m_size)
+    {
+        m_size = size;
+        updateLayout();
+    }
+}
+
+bool VideoRenderer::hasImage() const
+{
+    return m_texture || m_yuvFrame || !m_image.isNull();
+}
+
+QSize VideoRenderer::imageSize() const
+{
+    return m_size;
+}
+
+void VideoRenderer::setViewport(const QSize &size)
+{
+    m_viewport = size;
+    updateLayout();
+}
+
+/**
+ * @brief          设置后处理，下一次绘制时对当前图像重新处理；同一帧多次绘制（如窗口缩放）只处理一次
+ * @param settings
+ */
+void VideoRenderer::setPostProcess(const PostProcess &settings)
+{
+    m_postProcess = settings;
+    m_postTexture = 0;
+}
+
+PostProcess VideoRenderer::postProcess() const
+{
+    return m_postProcess;
+}
+
+/**
+ * @brief        小窗口缩小显示时Lanczos/bicubic可以减少锯齿和摩尔纹，放大时更清晰；缩小时滤波器按缩小倍数展宽，
+ *               每个输出像素的采样数随倍数增加。切换后重新统计GPU耗时
+ * @param kernel
+ */
+void VideoRenderer::setScaleKernel(ScaleKernel kernel)
+{
+    m_scaleKernel = kernel;
+    m_scaleCost  = 0;
+    m_scaleCount = 0;
+}
+
+VideoRenderer::ScaleKernel VideoRenderer::scaleKernel() const
+{
+    return m_scaleKernel;
+}
+
+qreal VideoRenderer::scaleTime() const
+{
+    return (m_scaleCount > 0) ? qreal(m_scaleCost) / m_scaleCount / 1000000 : -1;
+}
+
+static const char* kernelNames[] = {"Bilinear", "Bicubic", "Lanczos2", "Lanczos3"};
+
+QString VideoRenderer::scaleKernelName(ScaleKernel kernel)
+{
+    return kernelNames[kernel];
+}
+
+int VideoRenderer::scaleKernelFromName(const QString &name)
+{
+    for(int i = 0; i <= ScaleLanczos3; i++)
+    {
+        if(name.compare(kernelNames[i], Qt::CaseInsensitive) == 0) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief        区域限制在图像范围内，最大放大MAX_ZOOM倍；显示区域按区域的宽高比重新计算
+ * @param region
+ */
+void VideoRenderer::setZoom(const QRectF &region)
+{
+    qreal w = qBound(1.0 / MAX_ZOOM, region.width(), 1.0);
+    qreal h = qBound(1.0 / MAX_ZOOM, region.height(), 1.0);
+    m_zoom = QRectF(qBound(0.0, region.x(), 1.0 - w), qBound(0.0, region.y(), 1.0 - h), w, h);
+    updateLayout();
+}
+
+QRectF VideoRenderer::zoom() const
+{
+    return m_zoom;
+}
+
+QPointF VideoRenderer::mapToImage(const QPointF &pos) const
+{
+    if(m_zoomSize.isEmpty()) return QPointF();
+    qreal u = (pos.x() - m_pos.x()) / m_zoomSize.width();
+    qreal v = (pos.y() - m_pos.y()) / m_zoomSize.height();   // 居中显示，上下边距相同
+    return QPointF(m_zoom.x() + u * m_zoom.width(), m_zoom.y() + v * m_zoom.height());
+}
+
+QSizeF VideoRenderer::displaySize() const
+{
+    return m_zoomSize;
+}
+
+/**
+ * @brief        同一路视频的多个局部放大窗口只上传一次：来源窗口上传、后处理，其它窗口直接采样来源的结果纹理，
+ *               只是纹理坐标（放大区域）和缩放滤波器不同。需要设置Qt::AA_ShareOpenGLContexts，来源必须先绘制
+ * @param source
+ */
+void VideoRenderer::setSource(VideoRenderer *source)
+{
+    m_source = (source == this) ? nullptr : source;
+}
+
+/**
+ * @brief         纹理、帧缓冲记在显示的播放会话下，已经记账的显存一起转过去
+ * @param session
+ */
+void VideoRenderer::setMemorySession(int session)
+{
+    if(session == m_session) return;
+    qint64 bytes = m_textureBytes + m_fboBytes + m_planeBytes + m_scaleBytes;
+    MemoryBudget::instance()->release(m_session, MemoryBudget::Texture, bytes);
+    MemoryBudget::instance()->add(session, MemoryBudget::Texture, bytes);
+    m_session = session;
+}
+
+GLuint VideoRenderer::outputTexture() const
+{
+    return m_outputTexture;
+}
+
+/**
+ * @brief 上传等待显示的图像或YUV平面，单独调用时可以分开统计上传和绘制的耗时
+ */
+void VideoRenderer::upload()
+{
+    if(!m_image.isNull())
+    {
+        if(!m_texture)
+        {
+            m_texture = new QOpenGLTexture(m_image.mirrored());
+        }
+        else
+        {
+            m_texture->destroy();
+            m_texture->setData(m_image.mirrored());
+        }
+        qint64 bytes = qint64(m_image.width()) * m_image.height() * 4;   // RGBA8纹理
+        MemoryBudget::instance()->release(m_session, MemoryBudget::Texture, m_textureBytes);
+        MemoryBudget::instance()->add(m_session, MemoryBudget::Texture, bytes);
+        m_textureBytes = bytes;
+        m_image = QImage();                     // 已经在纹理中，不再持有
+    }
+    if(m_yuvFrame && m_yuvDirty)
+    {
+        uploadPlanes();
+    }
+}
+
+/**
+ * @brief     绘制当前图像到fbo（PlayImage为控件的帧缓冲），后处理结果在图像变化前重复使用
+ * @param fbo
+ */
+void VideoRenderer::render(GLuint fbo)
+{
+    m_target = fbo;
+    GLuint texture = 0;
+    if(m_source)
+    {
+        texture = m_source->outputTexture();
+        if(m_source->imageSize() != m_size)
+        {
+            m_size = m_source->imageSize();
+            updateLayout();
+        }
+    }
+    else
+    {
+        upload();
+        if(m_texture || m_yuvFrame)
+        {
+            texture = m_postTexture ? m_postTexture : runPostProcess();   // 后处理会改变帧缓冲和视图，需要在绘制之前执行
+        }
+    }
+    m_outputTexture = texture;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_target);
+    glViewport(0, 0, m_viewport.width(), m_viewport.height());
+    glClear(GL_COLOR_BUFFER_BIT);     // 将窗口的位平面区域（背景）设置为先前由glClearColor、glClearDepth和选择的值
+    if(!texture) return;
+    if(m_scaleKernel != ScaleBilinear)
+    {
+        drawScaled(texture);
+        return;
+    }
+    glViewport(m_pos.x(), m_pos.y(), m_zoomSize.width(), m_zoomSize.height());  // 设置视图大小实现图片自适应
+
+    m_program->bind();               // 绑定着色器
+    m_program->setUniformValue("texRect", texRect());
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glBindVertexArray(VAO);           // 绑定VAO
+
+    glDrawElements(GL_TRIANGLES,      // 绘制的图元类型
+                   6,                 // 指定要渲染的元素数(点数)
+                   GL_UNSIGNED_INT,   // 指定索引中值的类型(indices)
+                   nullptr);          // 指定当前绑定到GL_ELEMENT_array_buffer目标的缓冲区的数据存储中数组中第一个索引的偏移量。
+    glBindVertexArray(0);             //解绑,防止绘制出现失误,而修改vao内容
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_program->release();
+}
+
+QOpenGLShaderProgram *VideoRenderer::createProgram(const QString &fragment)
+{
+    QOpenGLShaderProgram* program = new QOpenGLShaderProgram();
+    program->addShaderFromSourceFile(QOpenGLShader::Vertex, ":/vertex.vsh");
+    program->addShaderFromSourceFile(QOpenGLShader::Fragment, fragment);
+    program->link();
+    return program;
+}
+
+void VideoRenderer::updateLayout()
+{
+    int w = m_viewport.width();
+    int h = m_viewport.height();
+    if(m_size.isEmpty() || m_viewport.isEmpty()) return;
+
+    // 计算需要显示图片的窗口大小，用于实现长宽等比自适应显示（局部放大时按显示区域的宽高比）
+    QSizeF size(m_size.width() * m_zoom.width(), m_size.height() * m_zoom.height());
+    if((double(w) / h) < (size.width() / size.height()))
+    {
+        m_zoomSize.setWidth(w);
+        m_zoomSize.setHeight(((double(w) / size.width()) * size.height()));   // 这里不使用QRect，使用QRect第一次设置时有误差bug
+    }
+    else
+    {
+        m_zoomSize.setHeight(h);
+        m_zoomSize.setWidth((double(h) / size.height()) * size.width());
+    }
+    m_pos.setX(double(w - m_zoomSize.width()) / 2);
+    m_pos.setY(double(h - m_zoomSize.height()) / 2);
+}
+
+/**
+ * @brief  依次执行去隔行、颜色调整、锐化，每一步读取上一步的纹理写入另一个帧缓冲（ping-pong），
+ *         没有启用的步骤跳过，全部没有启用时直接返回原始纹理
+ * @return 结果纹理
+ */
+GLuint VideoRenderer::runPostProcess()
+{
+    const PostProcess& p = m_postProcess;
+    bool deinterlace = p.deinterlace != PostProcess::DeinterlaceNone;
+    bool color       = p.brightness != 0 || p.contrast != 1 || p.saturation != 1;
+    bool sharpen     = p.sharpen > 0;
+
+    GLuint texture = 0;
+    int target = 0;
+    if(m_yuvFrame)
+    {
+        // 高位深帧先转换到16位帧缓冲，后处理也保持16位精度
+        createFbo(GL_RGBA16);
+        drawYuv(m_fbo[target]);
+        texture = m_fbo[target]->texture();
+        target ^= 1;
+    }
+    else
+    {
+        texture = m_texture->textureId();
+    }
+    if(!deinterlace && !color && !sharpen)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_target);
+        m_postTexture = texture;
+        return texture;
+    }
+    if(!m_yuvFrame)
+    {
+        createFbo(GL_RGBA8);
+    }
+
+    if(deinterlace)
+    {
+        m_deinterlaceProgram->bind();
+        m_deinterlaceProgram->setUniformValue("mode", int(p.deinterlace));
+        m_deinterlaceProgram->setUniformValue("field", (m_size.height() - 1) & 1);   // 纹理上下翻转过，图像第0行（顶场）在纹理的最后一行
+        drawPass(m_deinterlaceProgram, texture, m_fbo[target]);
+        texture = m_fbo[target]->texture();
+        target ^= 1;
+    }
+    if(color)
+    {
+        m_colorProgram->bind();
+        m_colorProgram->setUniformValue("brightness", p.brightness);
+        m_colorProgram->setUniformValue("contrast", p.contrast);
+        m_colorProgram->setUniformValue("saturation", p.saturation);
+        drawPass(m_colorProgram, texture, m_fbo[target]);
+        texture = m_fbo[target]->texture();
+        target ^= 1;
+    }
+    if(sharpen)
+    {
+        m_sharpenProgram->bind();
+        m_sharpenProgram->setUniformValue("amount", p.sharpen);
+        drawPass(m_sharpenProgram, texture, m_fbo[target]);
+        texture = m_fbo[target]->texture();
+        target ^= 1;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, m_target);   // 恢复输出帧缓冲
+    m_postTexture = texture;
+    return texture;
+}
+
+/**
+ * @brief         绘制一步后处理，调用前已经绑定着色器并设置好参数
+ * @param program
+ * @param texture 输入纹理
+ * @param target  输出帧缓冲
+ */
+void VideoRenderer::drawPass(QOpenGLShaderProgram *program, GLuint texture, QOpenGLFramebufferObject *target)
+{
+    target->bind();
+    glViewport(0, 0, target->width(), target->height());
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    program->setUniformValue("image", 0);
+    glBindVertexArray(VAO);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    program->release();
+}
+
+/**
+ * @brief        帧缓冲大小或格式变化时重新创建
+ * @param format GL_RGBA8（8位图像）或GL_RGBA16（高位深图像）
+ */
+void VideoRenderer::createFbo(GLenum format)
+{
+    if(m_fbo[0] && m_fbo[0]->size() == m_size && m_fbo[0]->format().internalTextureFormat() == format) return;
+
+    for(QOpenGLFramebufferObject*& fbo : m_fbo)
+    {
+        delete fbo;
+        fbo = new QOpenGLFramebufferObject(m_size, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, format);
+        glBindTexture(GL_TEXTURE_2D, fbo->texture());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);   // 结果纹理直接缩放显示
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    qint64 bytes = qint64(m_size.width()) * m_size.height() * (format == GL_RGBA16 ? 8 : 4) * 2;
+    MemoryBudget::instance()->release(m_session, MemoryBudget::Texture, m_fboBytes);
+    MemoryBudget::instance()->add(m_session, MemoryBudget::Texture, bytes);
+    m_fboBytes = bytes;
+}
+
+/**
+ * @brief 把16位平面上传到纹理，尺寸或格式变化时重新创建纹理；按linesize设置行长度，不需要拷贝对齐
+ */
+void VideoRenderer::uploadPlanes()
+{
+    const AVFrame* frame = m_yuvFrame.data();
+    bool semiPlanar  = frame->format == AV_PIX_FMT_P010LE;
+    int chromaWidth  = (frame->width + 1) / 2;
+    int chromaHeight = (frame->height + 1) / 2;
+    int planes = semiPlanar ? 2 : 3;
+    if(!m_planes[0] || m_planeSize != m_size || m_planeFormat != frame->format)
+    {
+        glDeleteTextures(3, m_planes);
+        glGenTextures(planes, m_planes);
+        for(int i = 0; i < planes; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, m_planes[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            if(i == 0)
+            {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, frame->width, frame->height, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+            }
+            else if(semiPlanar)
+            {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, chromaWidth, chromaHeight, 0, GL_RG, GL_UNSIGNED_SHORT, nullptr);
+            }
+            else
+            {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, chromaWidth, chromaHeight, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+            }
+        }
+        m_planeSize   = m_size;
+        m_planeFormat = frame->format;
+
+        qint64 bytes = (qint64(frame->width) * frame->height + qint64(chromaWidth) * chromaHeight * 2) * 2;
+        MemoryBudget::instance()->release(m_session, MemoryBudget::Texture, m_planeBytes);
+        MemoryBudget::instance()->add(m_session, MemoryBudget::Texture, bytes);
+        m_planeBytes = bytes;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    for(int i = 0; i < planes; i++)
+    {
+        int width  = (i == 0) ? frame->width : chromaWidth;
+        int height = (i == 0) ? frame->height : chromaHeight;
+        int components = (i > 0 && semiPlanar) ? 2 : 1;
+        glBindTexture(GL_TEXTURE_2D, m_planes[i]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->linesize[i] / (2 * components));
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, components == 2 ? GL_RG : GL_RED, GL_UNSIGNED_SHORT, frame->data[i]);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_yuvDirty = false;
+}
+
+/**
+ * @brief        根据帧的位深、色彩范围、矩阵系数和传输特性设置着色器参数，绘制到target
+ * @param target
+ */
+void VideoRenderer::drawYuv(QOpenGLFramebufferObject *target)
+{
+    const AVFrame* frame = m_yuvFrame.data();
+    bool semiPlanar = frame->format == AV_PIX_FMT_P010LE;
+    int  bits = (frame->format == AV_PIX_FMT_YUV420P12LE) ? 12 : 10;
+    float maxValue = float((1 << bits) - 1);
+    // 低位对齐的格式换算为[0, 1]；P010的10位数据在高位，等于乘以64
+    float scale = semiPlanar ? 65535.0f / (maxValue * 64) : 65535.0f / maxValue;
+
+    // 色彩范围：有限范围Y为[16, 235]、UV为[16, 240]（按位深放大）
+    bool full = frame->color_range == AVCOL_RANGE_JPEG;
+    float step     = float(1 << (bits - 8));
+    float yOffset  = full ? 0 : 16 * step / maxValue;
+    float cOffset  = 128 * step / maxValue;
+    float yScale   = full ? 1 : maxValue / (219 * step);
+    float cScale   = full ? 1 : maxValue / (224 * step);
+
+    // 矩阵系数，未指定时高清以上按BT.709
+    float kr = 0.2126f, kb = 0.0722f;
+    if(frame->colorspace == AVCOL_SPC_BT2020_NCL || frame->colorspace == AVCOL_SPC_BT2020_CL)
+    {
+        kr = 0.2627f;
+        kb = 0.0593f;
+    }
+    else if(frame->colorspace == AVCOL_SPC_BT470BG || frame->colorspace == AVCOL_SPC_SMPTE170M)
+    {
+        kr = 0.299f;
+        kb = 0.114f;
+    }
+    float kg = 1 - kr - kb;
+    const float values[] = {                   // 行主序，列乘以范围缩放
+        yScale, 0,                               cScale * 2 * (1 - kr),
+        yScale, cScale * -2 * (1 - kb) * kb / kg, cScale * -2 * (1 - kr) * kr / kg,
+        yScale, cScale * 2 * (1 - kb),           0
+    };
+    int transfer = 0;
+    if(frame->color_trc == AVCOL_TRC_SMPTE2084)         transfer = 1;
+    else if(frame->color_trc == AVCOL_TRC_ARIB_STD_B67) transfer = 2;
+
+    target->bind();
+    glViewport(0, 0, m_size.width(), m_size.height());
+    m_yuvProgram->bind();
+    m_yuvProgram->setUniformValue("texY", 0);
+    m_yuvProgram->setUniformValue("texU", 1);
+    m_yuvProgram->setUniformValue("texV", 2);
+    m_yuvProgram->setUniformValue("semiPlanar", semiPlanar ? 1 : 0);
+    m_yuvProgram->setUniformValue("scale", scale);
+    m_yuvProgram->setUniformValue("offset", QVector3D(yOffset, cOffset, cOffset));
+    m_yuvProgram->setUniformValue("yuvToRgb", QMatrix3x3(values));
+    m_yuvProgram->setUniformValue("transfer", transfer);
+    for(int i = 0; i < 3; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, m_planes[i]);
+    }
+    glBindVertexArray(VAO);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+    glBindVertexArray(0);
+    for(int i = 2; i >= 0; i--)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    m_yuvProgram->release();
+}
+
+/**
+ * @brief         先水平缩放到中间帧缓冲（目标宽度 x 原图高度），再垂直缩放绘制到输出，
+ *                二维滤波器的采样数从 n*n 降为 2n
+ * @param texture 后处理后的图像
+ */
+void VideoRenderer::drawScaled(GLuint texture)
+{
+    QSize dst(qRound(m_zoomSize.width()), qRound(m_zoomSize.height()));
+    if(dst.isEmpty() || m_size.isEmpty()) return;
+
+    QSize middle(dst.width(), m_size.height());
+    if(!m_scaleFbo || m_scaleFbo->size() != middle)
+    {
+        delete m_scaleFbo;
+        m_scaleFbo = new QOpenGLFramebufferObject(middle);
+        qint64 bytes = qint64(middle.width()) * middle.height() * 4;
+        MemoryBudget::instance()->release(m_session, MemoryBudget::Texture, m_scaleBytes);
+        MemoryBudget::instance()->add(m_session, MemoryBudget::Texture, bytes);
+        m_scaleBytes = bytes;
+    }
+
+    updateScaleTime();
+    bool timing = m_scaleTimer.isCreated() && !m_timerPending;
+    if(timing)
+    {
+        m_scaleTimer.begin();
+    }
+
+    // 水平，只采样放大区域的列，中间结果保留全部行
+    QVector4D rect = texRect();
+    m_scaleProgram->bind();
+    m_scaleProgram->setUniformValue("texRect", QVector4D(rect.x(), 0, rect.z(), 1));
+    m_scaleProgram->setUniformValue("kernel", int(m_scaleKernel));
+    m_scaleProgram->setUniformValue("direction", QVector2D(1, 0));
+    m_scaleProgram->setUniformValue("srcLength", float(m_size.width()));
+    m_scaleProgram->setUniformValue("ratio", qMax(1.0f, float(m_size.width() * m_zoom.width()) / dst.width()));
+    drawPass(m_scaleProgram, texture, m_scaleFbo);
+
+    // 垂直，直接绘制到输出
+    glBindFramebuffer(GL_FRAMEBUFFER, m_target);
+    glViewport(m_pos.x(), m_pos.y(), dst.width(), dst.height());
+    m_scaleProgram->bind();
+    m_scaleProgram->setUniformValue("texRect", QVector4D(0, rect.y(), 1, rect.w()));
+    m_scaleProgram->setUniformValue("kernel", int(m_scaleKernel));
+    m_scaleProgram->setUniformValue("direction", QVector2D(0, 1));
+    m_scaleProgram->setUniformValue("srcLength", float(m_size.height()));
+    m_scaleProgram->setUniformValue("ratio", qMax(1.0f, float(m_size.height() * m_zoom.height()) / dst.height()));
+    m_scaleProgram->setUniformValue("image", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_scaleFbo->texture());
+    glBindVertexArray(VAO);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_scaleProgram->release();
+
+    if(timing)
+    {
+        m_scaleTimer.end();
+        m_timerPending = true;
+    }
+}
+
+/**
+ * @brief 取出上一次的计时结果（不等待，结果还没有返回时这一帧不计时），记入vedioplay_scale_seconds，
+ *        并累计当前滤波器的平均耗时（scaleTime），用于比较不同滤波器在实际驱动（包括llvmpipe软件渲染）上的开销
+ */
+void VideoRenderer::updateScaleTime()
+{
+    if(!m_timerPending || !m_scaleTimer.isResultAvailable()) return;
+
+    m_timerPending = false;
+    qint64 cost = qint64(m_scaleTimer.waitForResult());
+    m_scaleCost += cost;
+    m_scaleCount++;
+    Metrics::instance()->observe("vedioplay_scale_seconds", m_session, cost / 1e9);
+}
+
+/**
+ * @brief  纹理是上下翻转后上传的（图像第0行在纹理顶部v=1），区域的y需要翻转
+ * @return xy为纹理坐标起点，zw为大小
+ */
+QVector4D VideoRenderer::texRect() const
+{
+    return QVector4D(float(m_zoom.x()), float(1.0 - m_zoom.y() - m_zoom.height()),
+                     float(m_zoom.width()), float(m_zoom.height()));
+}
@@ -0,0 +1,133 @@
+#ifndef VIDEORENDERER_H
+#define VIDEORENDERER_H
+
+#include <QOpenGLTexture>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLTimerQuery>
+#include <QImage>
+#include <QRectF>
+#include <QSharedPointer>
+#include <QVector4D>
+
+struct AVFrame;
+
+/**
+ * @brief 显示前的后处理参数（每个显示窗口单独设置），取默认值的步骤不执行
+ */
+struct PostProcess
+{
+    enum Deinterlace        // 去隔行
+    {
+        DeinterlaceNone,
+        DeinterlaceBob,     // 只保留顶场，逐行复制
+        DeinterlaceLinear   // 只保留顶场，另一场用上下两行插值
+    };
+    Deinterlace deinterlace = DeinterlaceNone;
+    float brightness = 0;   // 亮度 -1 ~ 1
+    float contrast   = 1;   // 对比度 0 ~ 2
+    float saturation = 1;   // 饱和度 0 ~ 2
+    float sharpen    = 0;   // 锐化（反锐化掩模）强度 0 ~ 2
+};
+
+/**
+ * @brief 视频图像的GL上传和绘制（纹理上传、高位深YUV转换、后处理、缩放），不依赖窗口：
+ *        PlayImage在paintGL中绘制到控件的帧缓冲，OffscreenRenderer绘制到离屏帧缓冲。
+ *        除setImage/setFrame等设置参数的接口外，所有函数调用时上下文必须是当前的
+ */
+class VideoRenderer : protected QOpenGLFunctions_3_3_Core
+{
+public:
+    enum ScaleKernel        // 缩放到输出大小时使用的滤波器
+    {
+        ScaleBilinear,      // 纹理硬件双线性（最快）
+        ScaleBicubic,       // Catmull-Rom
+        ScaleLanczos2,
+        ScaleLanczos3
+    };
+
+    VideoRenderer();
+    ~VideoRenderer();
+
+    bool initialize();                          // 创建着色器、顶点缓冲
+    void destroy();                             // 释放所有GL资源
+
+    void setImage(const QImage& image);         // 设置要显示的图像，下一次upload时上传
+    void setFrame(const QSharedPointer<AVFrame>& frame);   // 设置10/12位YUV帧，16位平面直接上传，在着色器中转换
+    bool hasImage() const;
+    QSize imageSize() const;
+    void setViewport(const QSize& size);        // 输出大小，图像等比居中显示
+    void setPostProcess(const PostProcess& settings);
+    PostProcess postProcess() const;
+    void setScaleKernel(ScaleKernel kernel);
+    ScaleKernel scaleKernel() const;
+    qreal scaleTime() const;                    // 当前滤波器缩放两遍的平均GPU耗时（毫秒），没有计时结果时为-1
+    static QString scaleKernelName(ScaleKernel kernel);
+    static int scaleKernelFromName(const QString& name);   // 名称不区分大小写，不存在时返回-1
+    void setZoom(const QRectF& region);         // 只显示图像的一部分（归一化坐标，y向下），在顶点着色器中变换纹理坐标，不重新上传
+    QRectF zoom() const;
+    QPointF mapToImage(const QPointF& pos) const;   // 输出中的位置对应的图像坐标（归一化，考虑局部放大）
+    QSizeF displaySize() const;                 // 图像在输出中的显示大小
+    void setSource(VideoRenderer* source);      // 显示另一个渲染器最后绘制的纹理（上下文需要共享），本对象不上传，为空时恢复
+    GLuint outputTexture() const;               // 最后一次绘制使用的纹理（上传、后处理后的结果）
+    void setMemorySession(int session);         // 显存记账的播放会话，0表示不属于任何会话
+
+    void upload();                              // 上传等待显示的图像，没有新图像时不做任何事
+    void render(GLuint fbo);                    // 上传（如果需要）、后处理后绘制到fbo
+
+private:
+    void updateLayout();                        // 按图像和输出大小计算显示区域
+    GLuint runPostProcess();                    // 执行后处理，返回结果纹理
+    void drawPass(QOpenGLShaderProgram* program, GLuint texture, QOpenGLFramebufferObject* target);
+    void uploadPlanes();                        // 上传m_yuvFrame的各个平面
+    void drawYuv(QOpenGLFramebufferObject* target);   // YUV转RGB（包括HDR色调映射）
+    void createFbo(GLenum format);              // 按图像大小创建后处理使用的帧缓冲
+    void drawScaled(GLuint texture);            // 可分离滤波器缩放绘制到输出
+    void updateScaleTime();                     // 统计缩放的GPU耗时
+    QVector4D texRect() const;                  // 局部放大区域对应的纹理坐标（纹理上下翻转过）
+    QOpenGLShaderProgram* createProgram(const QString& fragment);
+
+private:
+    bool   m_initialized = false;
+    GLuint m_target = 0;                        // 当前绘制的输出帧缓冲
+    QSize  m_viewport;                          // 输出大小
+    QOpenGLShaderProgram* m_program = nullptr;
+    QOpenGLTexture* m_texture = nullptr;
+    QImage m_image;                             // 等待上传的图像
+    GLuint VBO = 0;       // 顶点缓冲对象,负责将数据从内存放到缓存，一个VBO可以用于多个VAO
+    GLuint VAO = 0;       // 顶点数组对象,任何随后的顶点属性调用都会储存在这个VAO中，一个VAO可以有多个VBO
+    GLuint EBO = 0;       // 元素缓冲对象,它存储 OpenGL 用来决定要绘制哪些顶点的索引
+    QSize  m_size;
+    QSizeF  m_zoomSize;
+    QPointF m_pos;
+    qint64 m_textureBytes = 0;                  // 纹理记账的显存大小
+    int    m_session = 0;                       // 显存记账的播放会话
+    PostProcess m_postProcess;
+    QOpenGLShaderProgram* m_deinterlaceProgram = nullptr;
+    QOpenGLShaderProgram* m_colorProgram = nullptr;
+    QOpenGLShaderProgram* m_sharpenProgram = nullptr;
+    QOpenGLFramebufferObject* m_fbo[2] = {nullptr, nullptr};   // 后处理交替读写的两个帧缓冲
+    GLuint m_postTexture = 0;                   // 后处理结果，0表示需要重新处理
+    qint64 m_fboBytes = 0;                      // 帧缓冲记账的显存大小
+    QSharedPointer<AVFrame> m_yuvFrame;         // 高位深帧，为空时显示m_texture
+    bool   m_yuvDirty = false;                  // m_yuvFrame需要上传
+    QOpenGLShaderProgram* m_yuvProgram = nullptr;
+    GLuint m_planes[3] = {0, 0, 0};             // Y、U、V（P010为Y、UV）16位纹理
+    QSize  m_planeSize;                         // 平面纹理对应的图像大小和像素格式，变化时重新创建
+    int    m_planeFormat = -1;
+    qint64 m_planeBytes = 0;
+    ScaleKernel m_scaleKernel = ScaleBilinear;
+    QOpenGLShaderProgram* m_scaleProgram = nullptr;
+    QOpenGLFramebufferObject* m_scaleFbo = nullptr;   // 水平缩放后的中间结果（目标宽度 x 原图高度）
+    qint64 m_scaleBytes = 0;
+    QOpenGLTimerQuery m_scaleTimer;             // 缩放两遍的GPU耗时
+    bool   m_timerPending = false;              // 查询结果还没有取出
+    qint64 m_scaleCost = 0;                     // 统计周期内的GPU耗时（纳秒）
+    int    m_scaleCount = 0;
+    QRectF m_zoom = QRectF(0, 0, 1, 1);         // 显示的图像区域
+    VideoRenderer* m_source = nullptr;          // 共享纹理的来源，为空时自己上传
+    GLuint m_outputTexture = 0;
+};
+
+#endif // VIDEORENDERER_H
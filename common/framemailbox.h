@@ -0,0 +1,77 @@
+#ifndef FRAMEMAILBOX_H
+#define FRAMEMAILBOX_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+/**
+ * @brief 单生产者、单消费者的无锁最新帧信箱（三缓冲）：生产者写入自己的槽后与中间槽原子交换，
+ *        消费者只在中间槽有新帧时交换取出，总是拿到最新的一帧。没有被取走就被替换的帧立即释放（引用计数归还缓冲池）并计数，
+ *        信箱中最多同时持有3帧，消费者处理慢时延时和内存都有上限。
+ *        post只能在一个线程中调用（或由调用者保证互斥），take只能在另一个线程中调用
+ */
+template<typename T>
+class FrameMailbox
+{
+public:
+    /**
+     * @brief            放入一帧
+     * @param value
+     * @param superseded 不为空时返回被替换的帧（用于内存记账），之后由调用者释放
+     * @return           之前的帧已经被取走（消费者可能在等待），需要通知消费者时返回true
+     */
+    bool post(const T& value, T* superseded = nullptr)
+    {
+        m_slots[m_back] = value;
+        int old = m_middle.fetchAndStoreOrdered(m_back | FreshBit);
+        m_back = old & IndexMask;
+        if(!(old & FreshBit)) return true;
+
+        m_dropped.fetchAndAddRelaxed(1);
+        if(superseded)
+        {
+            *superseded = m_slots[m_back];
+        }
+        m_slots[m_back] = T();                   // 释放被替换的帧
+        return false;
+    }
+
+    /**
+     * @brief       取出最新的一帧，槽中不再保留引用
+     * @param value
+     * @return      没有新帧时返回false
+     */
+    bool take(T* value)
+    {
+        if(!(m_middle.loadAcquire() & FreshBit)) return false;
+        int old = m_middle.fetchAndStoreOrdered(m_front);
+        m_front = old & IndexMask;
+        *value = m_slots[m_front];
+        m_slots[m_front] = T();
+        return true;
+    }
+
+    bool hasNew() const
+    {
+        return m_middle.loadAcquire() & FreshBit;
+    }
+
+    qint64 dropped() const                       // 没有被取走就被替换的帧数
+    {
+        return m_dropped.loadRelaxed();
+    }
+
+private:
+    enum
+    {
+        IndexMask = 3,
+        FreshBit  = 4                            // 中间槽中是没有取走的新帧
+    };
+    T m_slots[3];
+    QAtomicInt m_middle = 1;                     // 中间槽序号 | FreshBit
+    int m_back  = 0;                             // 生产者写入的槽，只由生产者访问
+    int m_front = 2;                             // 消费者最后取出的槽，只由消费者访问
+    QAtomicInteger<qint64> m_dropped = 0;
+};
+
+#endif // FRAMEMAILBOX_H
@@ -0,0 +1,52 @@
+#include "visibilitywatcher.h"
+#include <QEvent>
+#include <QWidget>
+#include <QWindow>
+
+#define CHECK_INTERVAL 500      // 定时检查的间隔（毫秒）
+
+VisibilityWatcher::VisibilityWatcher(QWidget *widget) : QObject(widget), m_widget(widget)
+{
+    widget->installEventFilter(this);
+    connect(&m_timer, &QTimer::timeout, this, &VisibilityWatcher::check);
+    m_timer.start(CHECK_INTERVAL);
+}
+
+bool VisibilityWatcher::isVisible() const
+{
+    return m_visible;
+}
+
+/**
+ * @brief 控件本身的事件之后检查（事件处理完成后状态才更新）
+ */
+bool VisibilityWatcher::eventFilter(QObject *watched, QEvent *event)
+{
+    switch(event->type())
+    {
+    case QEvent::Show:
+    case QEvent::Hide:
+    case QEvent::Resize:
+    case QEvent::Move:
+    case QEvent::WindowStateChange:
+        QMetaObject::invokeMethod(this, &VisibilityWatcher::check, Qt::QueuedConnection);
+        break;
+    default:
+        break;
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+void VisibilityWatcher::check()
+{
+    if(!m_widget) return;
+    QWidget* window = m_widget->window();
+    QWindow* handle = window->windowHandle();
+    bool visible = m_widget->isVisible()
+                   && !window->isMinimized()
+                   && handle && handle->isExposed()          // 平台报告窗口被完全遮挡时为false
+                   && !m_widget->visibleRegion().isEmpty();  // 被父控件完全裁剪
+    if(visible == m_visible) return;
+    m_visible = visible;
+    emit visibilityChanged(visible);
+}
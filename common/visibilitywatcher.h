@@ -0,0 +1,38 @@
+#ifndef VISIBILITYWATCHER_H
+#define VISIBILITYWATCHER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+class QWidget;
+
+/**
+ * @brief 判断显示控件是否能被看到：隐藏、所在窗口最小化、窗口不可见（被完全遮挡，平台支持时）、
+ *        被父控件裁剪（滚动出视图、在未显示的标签页中）都算不可见。显示、隐藏、窗口状态变化时立即检查，
+ *        滚动、遮挡没有对应的事件，定时检查
+ */
+class VisibilityWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit VisibilityWatcher(QWidget* widget);
+
+    bool isVisible() const;
+
+signals:
+    void visibilityChanged(bool visible);
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
+private:
+    void check();
+
+private:
+    QPointer<QWidget> m_widget;
+    QTimer m_timer;
+    bool   m_visible = true;                    // 与订阅者的默认状态一致，第一次检查不可见时才通知
+};
+
+#endif // VISIBILITYWATCHER_H